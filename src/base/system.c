@@ -1,5 +1,9 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+	#define _GNU_SOURCE /* recvmmsg and sendmmsg */
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -31,6 +35,11 @@
 		#include <Carbon/Carbon.h>
 	#endif
 
+	#if defined(CONF_PLATFORM_LINUX)
+		#include <sys/epoll.h>
+		#include <sys/timerfd.h>
+	#endif
+
 #elif defined(CONF_FAMILY_WINDOWS)
 	#define WIN32_LEAN_AND_MEAN
 	#include <windows.h>
@@ -83,6 +92,217 @@ void dbg_break()
 	*((volatile unsigned*)0) = 0x0;
 }
 
+/* the lines of the async logger, see dbg_logger_async */
+enum
+{
+	LOG_LINE_SIZE=1024,
+	LOG_QUEUE_SIZE=2048, /* power of two */
+	LOG_BATCH_SIZE=256
+};
+
+typedef struct
+{
+	/* LOG_QUEUE_SIZE steps behind the position that may write it while
+	   free, one past the position that wrote it once full */
+	volatile unsigned sequence;
+	char line[LOG_LINE_SIZE];
+} LOG_CELL;
+
+static LOG_CELL *log_cells = 0;
+static volatile unsigned log_enqueue_pos = 0;
+static unsigned log_dequeue_pos = 0;
+static volatile unsigned log_dropped = 0;
+static volatile unsigned log_async = 0;
+static volatile unsigned log_stop = 0;
+static volatile unsigned log_sleeping = 0;
+static void *log_thread = 0;
+static int log_batching = 0;
+#if !defined(CONF_PLATFORM_MACOSX)
+static SEMAPHORE log_semaphore;
+#endif
+
+#if defined(__GNUC__)
+static unsigned log_compswap(volatile unsigned *value, unsigned comperand, unsigned exchange) { return __sync_val_compare_and_swap(value, comperand, exchange); }
+static void log_barrier() { __sync_synchronize(); }
+#elif defined(_MSC_VER)
+static unsigned log_compswap(volatile unsigned *value, unsigned comperand, unsigned exchange) { return (unsigned)InterlockedCompareExchange((volatile LONG *)value, (LONG)exchange, (LONG)comperand); }
+static void log_barrier() { MemoryBarrier(); }
+#else
+	#error missing atomic implementation for this compiler
+#endif
+
+static void log_wake()
+{
+#if !defined(CONF_PLATFORM_MACOSX)
+	log_barrier();
+	if(log_sleeping && log_compswap(&log_sleeping, 1, 0) == 1)
+		semaphore_signal(&log_semaphore);
+#endif
+}
+
+/* lock free for the printing threads, the line is dropped when the queue is full */
+static void log_enqueue(const char *line)
+{
+	LOG_CELL *cell;
+	unsigned pos = log_enqueue_pos;
+	unsigned dropped;
+	int len;
+	for(;;)
+	{
+		int diff;
+		cell = &log_cells[pos&(LOG_QUEUE_SIZE-1)];
+		diff = (int)(cell->sequence - pos);
+		log_barrier();
+		if(diff == 0)
+		{
+			if(log_compswap(&log_enqueue_pos, pos, pos+1) == pos)
+				break;
+			pos = log_enqueue_pos;
+		}
+		else if(diff < 0)
+		{
+			do
+				dropped = log_dropped;
+			while(log_compswap(&log_dropped, dropped, dropped+1) != dropped);
+			return;
+		}
+		else
+			pos = log_enqueue_pos;
+	}
+
+	len = str_length(line);
+	if(len > LOG_LINE_SIZE-1)
+		len = LOG_LINE_SIZE-1;
+	mem_copy(cell->line, line, len);
+	cell->line[len] = 0;
+	log_barrier();
+	cell->sequence = pos+1;
+	log_wake();
+}
+
+/* only called by one thread at a time, returns 0 when the queue is empty */
+static int log_dequeue(char *line)
+{
+	LOG_CELL *cell = &log_cells[log_dequeue_pos&(LOG_QUEUE_SIZE-1)];
+	if((int)(cell->sequence - (log_dequeue_pos+1)) < 0)
+		return 0;
+	log_barrier();
+	str_copy(line, cell->line, LOG_LINE_SIZE);
+	log_barrier();
+	cell->sequence = log_dequeue_pos+LOG_QUEUE_SIZE;
+	log_dequeue_pos++;
+	return 1;
+}
+
+static void log_flush();
+
+/* hands the queued lines to the loggers, flushing once per batch */
+static int log_drain()
+{
+	static unsigned reported_dropped = 0;
+	char line[LOG_LINE_SIZE];
+	int i, num = 0;
+
+	log_batching = 1;
+	while(num < LOG_BATCH_SIZE && log_dequeue(line))
+	{
+		for(i = 0; i < num_loggers; i++)
+			loggers[i](line);
+		num++;
+	}
+
+	if(log_dropped != reported_dropped)
+	{
+		str_format(line, sizeof(line), "[%08x][dbg/logger]: queue full, dropped %u lines", (int)time(0), log_dropped-reported_dropped);
+		reported_dropped = log_dropped;
+		for(i = 0; i < num_loggers; i++)
+			loggers[i](line);
+		num++;
+	}
+	log_batching = 0;
+
+	if(num)
+		log_flush();
+	return num;
+}
+
+#if !defined(CONF_PLATFORM_MACOSX)
+static void log_thread_func(void *user)
+{
+	for(;;)
+	{
+		if(log_drain())
+			continue;
+		if(log_stop)
+			break;
+
+		/* check the queue again after telling the printing threads to wake us */
+		log_sleeping = 1;
+		log_barrier();
+		if(log_cells[log_dequeue_pos&(LOG_QUEUE_SIZE-1)].sequence == log_dequeue_pos+1 || log_stop)
+		{
+			log_compswap(&log_sleeping, 1, 0);
+			continue;
+		}
+		semaphore_wait(&log_semaphore);
+	}
+}
+#endif
+
+int dbg_logger_async()
+{
+#if defined(CONF_PLATFORM_MACOSX)
+	dbg_msg("dbg/logger", "async logging is not supported on this platform");
+	return 1;
+#else
+	unsigned i;
+	if(log_async)
+		return 0;
+
+	/* kept after dbg_logger_async_stop, a printing thread that still saw
+	   log_async set may write into it */
+	if(!log_cells)
+		log_cells = (LOG_CELL *)mem_alloc(sizeof(LOG_CELL)*LOG_QUEUE_SIZE, 1);
+	for(i = 0; i < LOG_QUEUE_SIZE; i++)
+		log_cells[i].sequence = i;
+	log_enqueue_pos = 0;
+	log_dequeue_pos = 0;
+	log_stop = 0;
+	log_sleeping = 0;
+	semaphore_init(&log_semaphore);
+	log_thread = thread_init(log_thread_func, 0);
+	log_barrier();
+	log_async = 1;
+	return 0;
+#endif
+}
+
+void dbg_logger_async_stop()
+{
+#if !defined(CONF_PLATFORM_MACOSX)
+	if(!log_async)
+		return;
+
+	/* new lines are written directly again */
+	log_async = 0;
+	log_stop = 1;
+	log_barrier();
+	log_sleeping = 1;
+	log_wake();
+	thread_wait(log_thread);
+	log_thread = 0;
+
+	while(log_drain())
+		;
+	semaphore_destroy(&log_semaphore);
+#endif
+}
+
+unsigned dbg_logger_dropped()
+{
+	return log_dropped;
+}
+
 void dbg_msg(const char *sys, const char *fmt, ...)
 {
 	va_list args;
@@ -102,6 +322,12 @@ void dbg_msg(const char *sys, const char *fmt, ...)
 #endif
 	va_end(args);
 
+	if(log_async)
+	{
+		log_enqueue(str);
+		return;
+	}
+
 	for(i = 0; i < num_loggers; i++)
 		loggers[i](str);
 }
@@ -109,7 +335,8 @@ void dbg_msg(const char *sys, const char *fmt, ...)
 static void logger_stdout(const char *line)
 {
 	printf("%s\n", line);
-	fflush(stdout);
+	if(!log_batching)
+		fflush(stdout);
 }
 
 static void logger_debugger(const char *line)
@@ -121,12 +348,64 @@ static void logger_debugger(const char *line)
 }
 
 
+/* the loggers run on every printing thread unless the logger is async */
+static LOCK logfile_lock = 0;
 static IOHANDLE logfile = 0;
+static char logfile_name[512];
+static int logfile_size = 0;
+static time_t logfile_opened = 0;
+static int logfile_max_size = 0;
+static int logfile_max_age = 0;
+
+/* keeps the full logfile with the time of rotation in its name and starts a new one */
+static void logfile_rotate()
+{
+	char timestamp[32];
+	char rotated[sizeof(logfile_name)+sizeof(timestamp)+16];
+	IOHANDLE existing;
+	int i;
+	io_close(logfile);
+	str_timestamp(timestamp, sizeof(timestamp));
+	str_format(rotated, sizeof(rotated), "%s.%s", logfile_name, timestamp);
+	/* don't overwrite a logfile rotated in the same second */
+	for(i = 1; (existing = io_open(rotated, IOFLAG_READ)) != 0; i++)
+	{
+		io_close(existing);
+		str_format(rotated, sizeof(rotated), "%s.%s.%d", logfile_name, timestamp, i);
+	}
+	fs_rename(logfile_name, rotated);
+	logfile = io_open(logfile_name, IOFLAG_WRITE);
+	logfile_size = 0;
+	logfile_opened = time(0);
+}
+
 static void logger_file(const char *line)
 {
-	io_write(logfile, line, strlen(line));
-	io_write_newline(logfile);
-	io_flush(logfile);
+	lock_wait(logfile_lock);
+	if(logfile)
+	{
+		logfile_size += io_write(logfile, line, strlen(line));
+		logfile_size += io_write_newline(logfile);
+		if(!log_batching)
+			io_flush(logfile);
+
+		if((logfile_max_size && logfile_size >= logfile_max_size) ||
+			(logfile_max_age && time(0)-logfile_opened >= logfile_max_age))
+			logfile_rotate();
+	}
+	lock_unlock(logfile_lock);
+}
+
+static void log_flush()
+{
+	fflush(stdout);
+	if(logfile_lock)
+	{
+		lock_wait(logfile_lock);
+		if(logfile)
+			io_flush(logfile);
+		lock_unlock(logfile_lock);
+	}
 }
 
 void dbg_logger_stdout() { dbg_logger(logger_stdout); }
@@ -135,11 +414,24 @@ void dbg_logger_file(const char *filename)
 {
 	logfile = io_open(filename, IOFLAG_WRITE);
 	if(logfile)
+	{
+		str_format(logfile_name, sizeof(logfile_name), "%s", filename);
+		logfile_size = 0;
+		logfile_opened = time(0);
+		if(!logfile_lock)
+			logfile_lock = lock_create();
 		dbg_logger(logger_file);
+	}
 	else
 		dbg_msg("dbg/logger", "failed to open '%s' for logging", filename);
 
 }
+
+void dbg_logger_file_rotation(int max_size, int max_age)
+{
+	logfile_max_size = max_size;
+	logfile_max_age = max_age;
+}
 /* */
 
 typedef struct MEMHEADER
@@ -956,6 +1248,7 @@ int net_udp_send(NETSOCKET sock, const NETADDR *addr, const void *data, int size
 				netaddr_to_sockaddr_in(addr, &sa);
 
 			d = sendto((int)sock.ipv4sock, (const char*)data, size, 0, (struct sockaddr *)&sa, sizeof(sa));
+			network_stats.send_syscalls++;
 		}
 		else
 			dbg_msg("net", "can't sent ipv4 traffic to this socket");
@@ -979,6 +1272,7 @@ int net_udp_send(NETSOCKET sock, const NETADDR *addr, const void *data, int size
 				netaddr_to_sockaddr_in6(addr, &sa);
 
 			d = sendto((int)sock.ipv6sock, (const char*)data, size, 0, (struct sockaddr *)&sa, sizeof(sa));
+			network_stats.send_syscalls++;
 		}
 		else
 			dbg_msg("net", "can't sent ipv6 traffic to this socket");
@@ -1014,12 +1308,14 @@ int net_udp_recv(NETSOCKET sock, NETADDR *addr, void *data, int maxsize)
 	{
 		fromlen = sizeof(struct sockaddr_in);
 		bytes = recvfrom(sock.ipv4sock, (char*)data, maxsize, 0, (struct sockaddr *)&sockaddrbuf, &fromlen);
+		network_stats.recv_syscalls++;
 	}
 
 	if(bytes <= 0 && sock.ipv6sock >= 0)
 	{
 		fromlen = sizeof(struct sockaddr_in6);
 		bytes = recvfrom(sock.ipv6sock, (char*)data, maxsize, 0, (struct sockaddr *)&sockaddrbuf, &fromlen);
+		network_stats.recv_syscalls++;
 	}
 
 	if(bytes > 0)
@@ -1034,6 +1330,134 @@ int net_udp_recv(NETSOCKET sock, NETADDR *addr, void *data, int maxsize)
 	return -1; /* error */
 }
 
+#if defined(CONF_PLATFORM_LINUX)
+/* packets per recvmmsg or sendmmsg call */
+#define NET_UDP_BATCH 64
+
+static int priv_net_udp_recv_batch(int sock, NETADDR *addrs, unsigned char *data, int *sizes, int maxsize, int num)
+{
+	struct mmsghdr msgs[NET_UDP_BATCH];
+	struct iovec iovs[NET_UDP_BATCH];
+	struct sockaddr_storage sockaddrs[NET_UDP_BATCH];
+	int i, received;
+
+	if(num > NET_UDP_BATCH)
+		num = NET_UDP_BATCH;
+
+	mem_zero(msgs, sizeof(struct mmsghdr)*num);
+	for(i = 0; i < num; i++)
+	{
+		iovs[i].iov_base = data + i*maxsize;
+		iovs[i].iov_len = maxsize;
+		msgs[i].msg_hdr.msg_name = &sockaddrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(sockaddrs[i]);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	received = recvmmsg(sock, msgs, num, MSG_DONTWAIT, NULL);
+	network_stats.recv_syscalls++;
+	if(received <= 0)
+		return 0;
+
+	for(i = 0; i < received; i++)
+	{
+		sockaddr_to_netaddr((struct sockaddr *)&sockaddrs[i], &addrs[i]);
+		sizes[i] = msgs[i].msg_len;
+		network_stats.recv_bytes += msgs[i].msg_len;
+		network_stats.recv_packets++;
+	}
+	return received;
+}
+
+static void priv_net_udp_send_batch(int sock, int type, const NETADDR *addrs, const void * const *datas, const int *sizes, int num)
+{
+	struct mmsghdr msgs[NET_UDP_BATCH];
+	struct iovec iovs[NET_UDP_BATCH];
+	struct sockaddr_storage sockaddrs[NET_UDP_BATCH];
+	int i, sent = 0;
+
+	mem_zero(msgs, sizeof(struct mmsghdr)*num);
+	for(i = 0; i < num; i++)
+	{
+		iovs[i].iov_base = (void *)datas[i];
+		iovs[i].iov_len = sizes[i];
+		if(type == NETTYPE_IPV4)
+		{
+			netaddr_to_sockaddr_in(&addrs[i], (struct sockaddr_in *)&sockaddrs[i]);
+			msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		}
+		else
+		{
+			netaddr_to_sockaddr_in6(&addrs[i], (struct sockaddr_in6 *)&sockaddrs[i]);
+			msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+		}
+		msgs[i].msg_hdr.msg_name = &sockaddrs[i];
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		network_stats.sent_bytes += sizes[i];
+		network_stats.sent_packets++;
+	}
+
+	/* a failing packet stops the call, skip it like a failed sendto */
+	while(sent < num)
+	{
+		int result = sendmmsg(sock, msgs+sent, num-sent, 0);
+		network_stats.send_syscalls++;
+		sent += result > 0 ? result : 1;
+	}
+}
+#endif
+
+int net_udp_recv_batch(NETSOCKET sock, NETADDR *addrs, unsigned char *data, int *sizes, int maxsize, int num)
+{
+	int received = 0;
+#if defined(CONF_PLATFORM_LINUX)
+	if(sock.ipv4sock >= 0)
+		received = priv_net_udp_recv_batch(sock.ipv4sock, addrs, data, sizes, maxsize, num);
+	if(received < num && sock.ipv6sock >= 0)
+		received += priv_net_udp_recv_batch(sock.ipv6sock, addrs+received, data+received*maxsize, sizes+received, maxsize, num-received);
+#else
+	while(received < num)
+	{
+		int bytes = net_udp_recv(sock, &addrs[received], data+received*maxsize, maxsize);
+		if(bytes <= 0)
+			break;
+		sizes[received++] = bytes;
+	}
+#endif
+	return received;
+}
+
+void net_udp_send_batch(NETSOCKET sock, const NETADDR *addrs, const void * const *datas, const int *sizes, int num)
+{
+#if defined(CONF_PLATFORM_LINUX)
+	int start = 0;
+	while(start < num)
+	{
+		/* runs of packets to the same address family, broadcasts go alone */
+		unsigned type = addrs[start].type;
+		int end = start+1;
+		if(!(type&NETTYPE_LINK_BROADCAST) && (type == NETTYPE_IPV4 || type == NETTYPE_IPV6))
+		{
+			while(end < num && end-start < NET_UDP_BATCH && addrs[end].type == type)
+				end++;
+			if(type == NETTYPE_IPV4 ? sock.ipv4sock >= 0 : sock.ipv6sock >= 0)
+				priv_net_udp_send_batch(type == NETTYPE_IPV4 ? sock.ipv4sock : sock.ipv6sock, type, addrs+start, datas+start, sizes+start, end-start);
+			else
+				dbg_msg("net", "can't sent %s traffic to this socket", type == NETTYPE_IPV4 ? "ipv4" : "ipv6");
+		}
+		else
+			net_udp_send(sock, &addrs[start], datas[start], sizes[start]);
+		start = end;
+	}
+#else
+	int i;
+	for(i = 0; i < num; i++)
+		net_udp_send(sock, &addrs[i], datas[i], sizes[i]);
+#endif
+}
+
 int net_udp_close(NETSOCKET sock)
 {
 	return priv_net_close_all_sockets(sock);
@@ -1393,6 +1817,23 @@ int fs_is_dir(const char *path)
 #endif
 }
 
+int fs_file_time(const char *path, int64 *modified)
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if(!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+		return 1;
+	*modified = ((int64)attributes.ftLastWriteTime.dwHighDateTime<<32)|attributes.ftLastWriteTime.dwLowDateTime;
+	return 0;
+#else
+	struct stat sb;
+	if(stat(path, &sb) == -1)
+		return 1;
+	*modified = (int64)sb.st_mtime;
+	return 0;
+#endif
+}
+
 int fs_chdir(const char *path)
 {
 	if(fs_is_dir(path))
@@ -1509,6 +1950,100 @@ int net_socket_read_wait(NETSOCKET sock, int time)
 	return 0;
 }
 
+struct NETWAIT
+{
+	NETSOCKET sock;
+#if defined(CONF_PLATFORM_LINUX)
+	int epollfd;
+	int timerfd;
+#endif
+};
+
+NETWAIT *net_wait_create(NETSOCKET sock)
+{
+	NETWAIT *wait = (NETWAIT *)mem_alloc(sizeof(NETWAIT), 1);
+	wait->sock = sock;
+#if defined(CONF_PLATFORM_LINUX)
+	{
+		struct epoll_event event;
+		/* time_get runs on the realtime clock */
+		wait->epollfd = epoll_create1(EPOLL_CLOEXEC);
+		wait->timerfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK|TFD_CLOEXEC);
+		if(wait->epollfd < 0 || wait->timerfd < 0)
+		{
+			net_wait_destroy(wait);
+			return 0;
+		}
+
+		mem_zero(&event, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = wait->timerfd;
+		epoll_ctl(wait->epollfd, EPOLL_CTL_ADD, wait->timerfd, &event);
+		if(sock.ipv4sock >= 0)
+		{
+			event.data.fd = sock.ipv4sock;
+			epoll_ctl(wait->epollfd, EPOLL_CTL_ADD, sock.ipv4sock, &event);
+		}
+		if(sock.ipv6sock >= 0)
+		{
+			event.data.fd = sock.ipv6sock;
+			epoll_ctl(wait->epollfd, EPOLL_CTL_ADD, sock.ipv6sock, &event);
+		}
+	}
+#endif
+	return wait;
+}
+
+int net_wait(NETWAIT *wait, int64 deadline)
+{
+#if defined(CONF_PLATFORM_LINUX)
+	struct itimerspec spec;
+	struct epoll_event events[3];
+	int num, i, readable = 0;
+
+	/* arming the timer also clears an old expiration */
+	mem_zero(&spec, sizeof(spec));
+	spec.it_value.tv_sec = deadline/1000000;
+	spec.it_value.tv_nsec = (deadline%1000000)*1000;
+	if(spec.it_value.tv_sec <= 0 && spec.it_value.tv_nsec <= 0)
+		spec.it_value.tv_nsec = 1;
+	timerfd_settime(wait->timerfd, TFD_TIMER_ABSTIME, &spec, NULL);
+
+	num = epoll_wait(wait->epollfd, events, 3, -1);
+	for(i = 0; i < num; i++)
+	{
+		if(events[i].data.fd == wait->timerfd)
+		{
+			unsigned long long expirations;
+			if(read(wait->timerfd, &expirations, sizeof(expirations)) < 0)
+				continue;
+		}
+		else
+			readable = 1;
+	}
+	return readable;
+#else
+	int64 left = deadline-time_get();
+	if(left <= 0)
+		return 0;
+	/* round up, waking up early would spin until the deadline */
+	return net_socket_read_wait(wait->sock, (int)((left*1000+time_freq()-1)/time_freq()));
+#endif
+}
+
+void net_wait_destroy(NETWAIT *wait)
+{
+	if(!wait)
+		return;
+#if defined(CONF_PLATFORM_LINUX)
+	if(wait->epollfd >= 0)
+		close(wait->epollfd);
+	if(wait->timerfd >= 0)
+		close(wait->timerfd);
+#endif
+	mem_free(wait);
+}
+
 int time_timestamp()
 {
 	return time(0);
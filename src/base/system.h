@@ -320,7 +320,6 @@ int io_close(IOHANDLE io);
 */
 int io_flush(IOHANDLE io);
 
-
 /*
 	Function: io_stdin
 		Returns an <IOHANDLE> to the standard input.
@@ -606,6 +605,40 @@ int net_udp_send(NETSOCKET sock, const NETADDR *addr, const void *data, int size
 */
 int net_udp_recv(NETSOCKET sock, NETADDR *addr, void *data, int maxsize);
 
+/*
+	Function: net_udp_recv_batch
+		Receives up to num waiting packets over an UDP socket, with a
+		single system call per address family on Linux.
+
+	Parameters:
+		sock - Socket to use.
+		addrs - Array of num NETADDRs that will recive the addresses.
+		data - Buffer of num*maxsize bytes, packet i is stored at
+			data+i*maxsize.
+		sizes - Array of num ints that will recive the sizes.
+		maxsize - Maximum size of one packet.
+		num - Maximum number of packets to recive.
+
+	Returns:
+		The number of packets recived, 0 if none were waiting.
+*/
+int net_udp_recv_batch(NETSOCKET sock, NETADDR *addrs, unsigned char *data, int *sizes, int maxsize, int num);
+
+/*
+	Function: net_udp_send_batch
+		Sends several packets over an UDP socket, with a single system
+		call per run of packets to the same address family on Linux.
+		Failed packets are skipped like with net_udp_send.
+
+	Parameters:
+		sock - Socket to use.
+		addrs - Where to send the packets.
+		datas - Pointers to the packet data.
+		sizes - Sizes of the packets.
+		num - Number of packets.
+*/
+void net_udp_send_batch(NETSOCKET sock, const NETADDR *addrs, const void * const *datas, const int *sizes, int num);
+
 /*
 	Function: net_udp_close
 		Closes an UDP socket.
@@ -1077,6 +1110,20 @@ int fs_storage_path(const char *appname, char *path, int max);
 */
 int fs_is_dir(const char *path);
 
+/*
+	Function: fs_file_time
+		Gets the time a file was last modified.
+
+	Parameters:
+		path - Path of the file.
+		modified - Receives the modification time, only comparable
+			to other results of this function.
+
+	Returns:
+		Returns 0 on success, 1 on failure.
+*/
+int fs_file_time(const char *path, int64 *modified);
+
 /*
 	Function: fs_chdir
 		Changes current working directory
@@ -1183,6 +1230,38 @@ int net_would_block();
 
 int net_socket_read_wait(NETSOCKET sock, int time);
 
+typedef struct NETWAIT NETWAIT;
+
+/*
+	Function: net_wait_create
+		Creates a waiter for a socket and a deadline. On Linux it is
+		an epoll set with the socket and a timerfd, which wakes up at
+		the deadline to the microsecond.
+
+	Parameters:
+		sock - Socket to watch.
+
+	Returns:
+		The waiter, 0 if it couldn't be created.
+*/
+NETWAIT *net_wait_create(NETSOCKET sock);
+
+/*
+	Function: net_wait
+		Sleeps until the socket of the waiter has data to read or
+		time_get() reaches the deadline.
+
+	Parameters:
+		wait - Waiter to use.
+		deadline - Time to wake up at, in time_get() units.
+
+	Returns:
+		1 if the socket has data to read, 0 if the deadline passed.
+*/
+int net_wait(NETWAIT *wait, int64 deadline);
+
+void net_wait_destroy(NETWAIT *wait);
+
 void mem_debug_dump(IOHANDLE file);
 
 void swap_endian(void *data, unsigned elem_size, unsigned num);
@@ -1195,6 +1274,48 @@ void dbg_logger_stdout();
 void dbg_logger_debugger();
 void dbg_logger_file(const char *filename);
 
+/*
+	Function: dbg_logger_file_rotation
+		Starts a new logfile once the current one reached a size or
+		an age, the old one is kept with the time appended to its
+		name.
+
+	Parameters:
+		max_size - Size in bytes, 0 for no limit.
+		max_age - Age in seconds, 0 for no limit.
+*/
+void dbg_logger_file_rotation(int max_size, int max_age);
+
+/*
+	Function: dbg_logger_async
+		Makes <dbg_msg> queue its lines for a writer thread that
+		hands them to the loggers in batches, instead of writing and
+		flushing them on the calling thread. Lines are cut to 1023
+		characters, and dropped while the queue is full.
+
+	Returns:
+		0 on success, 1 if the platform does not support it.
+
+	Remarks:
+		- Add the loggers before, the writer thread calls them
+		  without locking.
+*/
+int dbg_logger_async();
+
+/*
+	Function: dbg_logger_async_stop
+		Writes the queued lines and stops the writer thread, lines
+		are written directly again.
+*/
+void dbg_logger_async_stop();
+
+/*
+	Function: dbg_logger_dropped
+		Returns the number of lines dropped because the queue of the
+		async logger was full.
+*/
+unsigned dbg_logger_dropped();
+
 typedef struct
 {
 	int allocated;
@@ -1210,6 +1331,8 @@ typedef struct
 	int sent_bytes;
 	int recv_packets;
 	int recv_bytes;
+	int send_syscalls;
+	int recv_syscalls;
 } NETSTATS;
 
 
@@ -2,6 +2,8 @@
 
 #include "../system.h"
 
+#include <atomic>
+
 /*
 	atomic_inc - should return the value after increment
 	atomic_dec - should return the value after decrement
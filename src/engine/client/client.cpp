@@ -2389,5 +2389,6 @@ int main(int argc, const char **argv) // ignore_convention
 	// write down the config and quit
 	pConfig->Save();
 
+	dbg_logger_async_stop();
 	return 0;
 }
@@ -5,6 +5,8 @@
 
 #include "kernel.h"
 
+#include <mutex>
+
 class IConsole : public IInterface
 {
 	MACRO_INTERFACE("console", 0)
@@ -87,6 +89,9 @@ public:
 	virtual void Print(int Level, const char *pFrom, const char *pStr) = 0;
 
 	virtual void SetAccessLevel(int AccessLevel) = 0;
+
+	// serializes command execution and output, needed when game instances tick on their own threads
+	virtual void SetExecutionLock(std::recursive_mutex *pLock) = 0;
 };
 
 extern IConsole *CreateConsole(int FlagMask);
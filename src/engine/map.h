@@ -28,6 +28,10 @@ public:
 	virtual bool IsLoaded() = 0;
 	virtual void Unload() = 0;
 	virtual unsigned Crc() = 0;
+
+	// the map file for downloads, valid while the map is loaded
+	virtual const unsigned char *FileData() = 0;
+	virtual int FileSize() = 0;
 };
 
 extern IEngineMap *CreateEngineMap();
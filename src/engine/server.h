@@ -10,9 +10,9 @@
 struct sGame{
 	class IGameServer *m_pGameServer;
 	unsigned int m_uiGameID;
-	sGame* m_pNext;
+	class CGameThread *m_pGameThread;
 	
-	sGame() : m_pGameServer(0), m_uiGameID(GAME_ID_INVALID), m_pNext(0){
+	sGame() : m_pGameServer(0), m_uiGameID(GAME_ID_INVALID), m_pGameThread(0){
 		
 	}
 	class IGameServer *GameServer() { return m_pGameServer; }
@@ -21,15 +21,18 @@ struct sGame{
 struct sMap {
 	char m_aCurrentMap[64];
 	unsigned m_CurrentMapCrc;
-	unsigned char *m_pCurrentMapData;
+	// points into the loaded map
+	const unsigned char *m_pCurrentMapData;
 	int m_CurrentMapSize;
-	unsigned int m_uiGameID;
+	int m_RefCount;
+	bool m_Loaded;
+	// the file the map was loaded from, a changed file isn't shared
+	int m_FileSize;
+	int64 m_FileTime;
 
 	class IMap* m_pMap;
-	
-	sMap* m_pNextMap;
 
-	sMap() : m_pCurrentMapData(0), m_pMap(0), m_pNextMap(0) {
+	sMap() : m_pCurrentMapData(0), m_RefCount(0), m_Loaded(false), m_FileSize(-1), m_FileTime(0), m_pMap(0) {
 	}
 	
 	~sMap();
@@ -83,6 +86,9 @@ public:
 	virtual void SetClientScore(int ClientID, int Score) = 0;
 	virtual void SetClientVersion(int ClientID, int Version) = 0;
 	virtual void SetClientUnknownFlags(int ClientID, int UnknownFlags) = 0;
+	// the server info gets packed again with the next request, call
+	// it when a player joins or leaves the spectators
+	virtual void ExpireServerInfo() = 0;
 
 	virtual int SnapNewID() = 0;
 	virtual void SnapFreeID(int ID) = 0;
@@ -99,9 +105,10 @@ public:
 	virtual bool IsAuthed(int ClientID) = 0;
 	virtual void Kick(int ClientID, const char *pReason) = 0;
 
-	virtual void DemoRecorder_HandleAutoStart() = 0;
-	virtual bool DemoRecorder_IsRecording() = 0;
+	virtual void DemoRecorder_HandleAutoStart(class IGameServer *pGameServer) = 0;
+	virtual bool DemoRecorder_IsRecording(class IGameServer *pGameServer) = 0;
 	
+	// returns the id of the new game, -1 if it failed or if it got queued from a game thread
 	virtual int StartGameServer(const char* pMap, struct CConfiguration* pConfig = 0) = 0;
 	virtual void StopGameServer(unsigned int GameID, int MoveToGameID = -1) = 0;
 	virtual bool ChangeGameServerMap(unsigned int GameID, const char* pMapName) = 0;
@@ -113,6 +120,8 @@ public:
 	
 	virtual struct sGame* GetGame(unsigned int GameID) = 0;
 
+	// 0 if the database is disabled
+	virtual class CDbConnectionPool *DbPool() = 0;
 };
 
 class IGameServer : public IInterface
@@ -90,3 +90,27 @@ void IDbConnection::FormatCreatePoints(char *aBuf, unsigned int BufferSize) cons
 		")",
 		GetPrefix(), MAX_NAME_LENGTH_SQL, BinaryCollate());
 }
+
+void IDbConnection::FormatCreateStats(char *aBuf, unsigned int BufferSize) const
+{
+	str_format(aBuf, BufferSize,
+		"CREATE TABLE IF NOT EXISTS %s_stats ("
+		"  Name VARCHAR(%d) COLLATE %s NOT NULL, "
+		"  Rounds INT DEFAULT 0, "
+		"  Kills INT DEFAULT 0, "
+		"  Hits INT DEFAULT 0, "
+		"  Deaths INT DEFAULT 0, "
+		"  Shots INT DEFAULT 0, "
+		"  GrabsNormal INT DEFAULT 0, "
+		"  GrabsTeam INT DEFAULT 0, "
+		"  GrabsGold INT DEFAULT 0, "
+		"  GrabsGreen INT DEFAULT 0, "
+		"  GrabsPurple INT DEFAULT 0, "
+		"  GrabsFalse INT DEFAULT 0, "
+		"  Selfkills INT DEFAULT 0, "
+		"  Teamkills INT DEFAULT 0, "
+		"  Unfreezes INT DEFAULT 0, "
+		"  PRIMARY KEY (Name)"
+		")",
+		GetPrefix(), MAX_NAME_LENGTH_SQL, BinaryCollate());
+}
@@ -2,6 +2,7 @@
 #include "connection.h"
 #include <engine/shared/config.h>
 
+#include <base/math.h>
 #include <base/system.h>
 #include <cstring>
 #include <engine/console.h>
@@ -65,6 +66,10 @@ struct CSqlExecData
 
 	std::unique_ptr<const ISqlData> m_pThreadData;
 	const char *m_pName;
+
+	// see CDbConnectionPool::Execute
+	int m_Key = -1;
+	int64 m_EnqueueTime = 0;
 };
 
 CSqlExecData::CSqlExecData(
@@ -118,53 +123,231 @@ CSqlExecData::CSqlExecData(IConsole *pConsole, CDbConnectionPool::Mode m) :
 	m_Ptr.m_Print.m_Mode = m;
 }
 
-void CDbConnectionPool::Print(IConsole *pConsole, Mode DatabaseMode)
+// Bounded queue that any number of threads can push to without taking a
+// lock, while a single thread pops. Every cell carries a sequence number
+// telling whether it is free for the producer of that round or filled for
+// the consumer.
+template<typename T, unsigned Size>
+class CMpscQueue
+{
+	static_assert((Size & (Size - 1)) == 0, "queue size has to be a power of two");
+
+	struct CCell
+	{
+		std::atomic<unsigned> m_Sequence;
+		T m_Data;
+	};
+
+	CCell m_aCells[Size];
+	std::atomic<unsigned> m_EnqueuePos{0};
+	unsigned m_DequeuePos = 0;
+
+public:
+	CMpscQueue()
+	{
+		for(unsigned i = 0; i < Size; i++)
+			m_aCells[i].m_Sequence.store(i, std::memory_order_relaxed);
+	}
+
+	// Moves Data into the queue, leaves it untouched if the queue is full.
+	bool Push(T &Data)
+	{
+		unsigned Pos = m_EnqueuePos.load(std::memory_order_relaxed);
+		while(true)
+		{
+			CCell *pCell = &m_aCells[Pos & (Size - 1)];
+			int Diff = (int)(pCell->m_Sequence.load(std::memory_order_acquire) - Pos);
+			if(Diff == 0)
+			{
+				if(m_EnqueuePos.compare_exchange_weak(Pos, Pos + 1, std::memory_order_relaxed))
+				{
+					pCell->m_Data = std::move(Data);
+					pCell->m_Sequence.store(Pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if(Diff < 0)
+				return false;
+			else
+				Pos = m_EnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	// Fails if the oldest entry isn't completely pushed yet. Only one
+	// thread may pop.
+	bool Pop(T *pData)
+	{
+		CCell *pCell = &m_aCells[m_DequeuePos & (Size - 1)];
+		if((int)(pCell->m_Sequence.load(std::memory_order_acquire) - (m_DequeuePos + 1)) < 0)
+			return false;
+		*pData = std::move(pCell->m_Data);
+		pCell->m_Sequence.store(m_DequeuePos + Size, std::memory_order_release);
+		m_DequeuePos++;
+		return true;
+	}
+
+	// Waits for the entry the semaphore signalled. A producer that claimed
+	// an earlier cell may still be writing to it.
+	T PopSignalled(CSemaphore *pSignal)
+	{
+		pSignal->Wait();
+		T Data;
+		while(!Pop(&Data))
+			std::this_thread::yield();
+		return Data;
+	}
+};
+
+struct CDbConnectionPool::CSharedData
 {
-	m_pShared->m_aQueries[m_InsertIdx++] = std::make_unique<CSqlExecData>(pConsole, DatabaseMode);
-	m_InsertIdx %= std::size(m_pShared->m_aQueries);
+	// Used as signal that shutdown is in progress from main thread to
+	// speed up the queries by discarding read queries and writing to
+	// the sqlite file instead of the remote mysql server.
+	// The last worker thread signals the main thread that all queries are
+	// processed by setting this variable to false again.
+	std::atomic_bool m_Shutdown{false};
+	std::atomic_int m_NumRunning{0};
+	int m_NumWorkers = 0;
+
+	// Queries go first to the backup thread. This semaphore signals about
+	// new queries.
+	CSemaphore m_NumBackup;
+	CMpscQueue<std::unique_ptr<CSqlExecData>, 1024> m_Queries;
+
+	// When the backup thread processed the query, it hands it to one worker
+	// and signals it with the worker's semaphore
+	struct CWorkerQueue
+	{
+		CSemaphore m_NumQueries;
+		CMpscQueue<std::unique_ptr<CSqlExecData>, 256> m_Queries;
+	} m_aWorkers[MAX_WORKERS];
+
+	// counters for sqlstatus. The latencies are summed up since they were
+	// last printed
+	std::atomic<int64> m_NumDone{0};
+	std::atomic<int64> m_NumFailed{0};
+	std::atomic<int64> m_NumDropped{0};
+	std::atomic<int64> m_NumTimed{0};
+	std::atomic<int64> m_WaitTime{0};
+	std::atomic<int64> m_MaxWaitTime{0};
+	std::atomic<int64> m_ExecTime{0};
+	std::atomic<int64> m_MaxExecTime{0};
+
+	void AddTiming(int64 WaitTime, int64 ExecTime)
+	{
+		m_NumTimed++;
+		m_WaitTime += WaitTime;
+		m_ExecTime += ExecTime;
+		int64 Max = m_MaxWaitTime.load();
+		while(WaitTime > Max && !m_MaxWaitTime.compare_exchange_weak(Max, WaitTime))
+			;
+		Max = m_MaxExecTime.load();
+		while(ExecTime > Max && !m_MaxExecTime.compare_exchange_weak(Max, ExecTime))
+			;
+	}
+};
+
+void CDbConnectionPool::Enqueue(std::unique_ptr<CSqlExecData> pData)
+{
+	dbg_assert(m_NumWorkers > 0, "database pool used before it was started");
+
+	// games running on their own threads submit queries too, the queue
+	// takes them without locking
+	pData->m_EnqueueTime = time_get();
+	if(!m_pShared->m_Queries.Push(pData))
+	{
+		m_pShared->m_NumDropped++;
+		dbg_msg("sql", "%s dropped, the query queue is full", pData->m_pName);
+		if(pData->m_pThreadData != nullptr && pData->m_pThreadData->m_pResult != nullptr)
+			pData->m_pThreadData->m_pResult->m_Completed.store(true);
+		return;
+	}
 	m_pShared->m_NumBackup.Signal();
 }
 
+void CDbConnectionPool::Print(IConsole *pConsole, Mode DatabaseMode)
+{
+	Enqueue(std::make_unique<CSqlExecData>(pConsole, DatabaseMode));
+}
+
 void CDbConnectionPool::RegisterSqliteDatabase(Mode DatabaseMode, const char aFileName[64])
 {
-	m_pShared->m_aQueries[m_InsertIdx++] = std::make_unique<CSqlExecData>(DatabaseMode, aFileName);
-	m_InsertIdx %= std::size(m_pShared->m_aQueries);
-	m_pShared->m_NumBackup.Signal();
+	Enqueue(std::make_unique<CSqlExecData>(DatabaseMode, aFileName));
 }
 
 void CDbConnectionPool::RegisterMysqlDatabase(Mode DatabaseMode, const CMysqlConfig *pMysqlConfig)
 {
-	m_pShared->m_aQueries[m_InsertIdx++] = std::make_unique<CSqlExecData>(DatabaseMode, pMysqlConfig);
-	m_InsertIdx %= std::size(m_pShared->m_aQueries);
-	m_pShared->m_NumBackup.Signal();
+	Enqueue(std::make_unique<CSqlExecData>(DatabaseMode, pMysqlConfig));
+}
+
+void CDbConnectionPool::PrintStats(IConsole *pConsole)
+{
+	char aBuf[256];
+	if(!m_NumWorkers)
+	{
+		pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "sql", "no database in use");
+		return;
+	}
+
+	str_format(aBuf, sizeof(aBuf), "workers=%d done=%lld failed=%lld dropped=%lld",
+		m_NumWorkers, m_pShared->m_NumDone.load(), m_pShared->m_NumFailed.load(), m_pShared->m_NumDropped.load());
+	pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "sql", aBuf);
+
+	str_format(aBuf, sizeof(aBuf), "queue depth: backup=%d", m_pShared->m_NumBackup.GetApproximateValue());
+	for(int i = 0; i < m_NumWorkers; i++)
+	{
+		char aWorker[32];
+		str_format(aWorker, sizeof(aWorker), " worker%d=%d", i, m_pShared->m_aWorkers[i].m_NumQueries.GetApproximateValue());
+		str_append(aBuf, aWorker, sizeof(aBuf));
+	}
+	pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "sql", aBuf);
+
+	// latencies since the last call
+	int64 NumTimed = m_pShared->m_NumTimed.exchange(0);
+	int64 WaitTime = m_pShared->m_WaitTime.exchange(0);
+	int64 MaxWaitTime = m_pShared->m_MaxWaitTime.exchange(0);
+	int64 ExecTime = m_pShared->m_ExecTime.exchange(0);
+	int64 MaxExecTime = m_pShared->m_MaxExecTime.exchange(0);
+	float Scale = 1000.0f / time_freq();
+	str_format(aBuf, sizeof(aBuf), "latency of %lld queries: wait avg=%.2fms max=%.2fms, execute avg=%.2fms max=%.2fms",
+		NumTimed,
+		NumTimed ? WaitTime * Scale / NumTimed : 0.0f, MaxWaitTime * Scale,
+		NumTimed ? ExecTime * Scale / NumTimed : 0.0f, MaxExecTime * Scale);
+	pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "sql", aBuf);
 }
 
 void CDbConnectionPool::Execute(
 	FRead pFunc,
 	std::unique_ptr<const ISqlData> pSqlRequestData,
-	const char *pName)
+	const char *pName,
+	int Key)
 {
-	m_pShared->m_aQueries[m_InsertIdx++] = std::make_unique<CSqlExecData>(pFunc, std::move(pSqlRequestData), pName);
-	m_InsertIdx %= std::size(m_pShared->m_aQueries);
-	m_pShared->m_NumBackup.Signal();
+	auto pData = std::make_unique<CSqlExecData>(pFunc, std::move(pSqlRequestData), pName);
+	pData->m_Key = Key;
+	Enqueue(std::move(pData));
 }
 
 void CDbConnectionPool::ExecuteWrite(
 	FWrite pFunc,
 	std::unique_ptr<const ISqlData> pSqlRequestData,
-	const char *pName)
+	const char *pName,
+	int Key)
 {
-	m_pShared->m_aQueries[m_InsertIdx++] = std::make_unique<CSqlExecData>(pFunc, std::move(pSqlRequestData), pName);
-	m_InsertIdx %= std::size(m_pShared->m_aQueries);
-	m_pShared->m_NumBackup.Signal();
+	auto pData = std::make_unique<CSqlExecData>(pFunc, std::move(pSqlRequestData), pName);
+	pData->m_Key = Key;
+	Enqueue(std::move(pData));
 }
 
 void CDbConnectionPool::OnShutdown()
 {
-	if(m_Shutdown)
+	if(m_Shutdown || !m_NumWorkers)
 		return;
 	m_Shutdown = true;
 	m_pShared->m_Shutdown.store(true);
+	// an empty query tells the threads to exit once they reach it
+	std::unique_ptr<CSqlExecData> pEnd;
+	while(!m_pShared->m_Queries.Push(pEnd))
+		std::this_thread::sleep_for(10ms);
 	m_pShared->m_NumBackup.Signal();
 	int i = 0;
 	while(m_pShared->m_Shutdown.load())
@@ -181,7 +364,7 @@ void CDbConnectionPool::OnShutdown()
 
 // The backup worker thread looks at write queries and stores them
 // in the sqlite database (WRITE_BACKUP). It skips over read queries.
-// After processing the query, it gets passed on to the Worker thread.
+// After processing the query, it gets passed on to one of the Worker threads.
 // This is done to not loose ranks when the server shuts down before all
 // queries are executed on the mysql server
 class CBackup
@@ -193,8 +376,10 @@ public:
 
 private:
 	bool m_DebugSql;
+	int m_NextWorker = 0;
 
 	void ProcessQueries();
+	void PassOn(int Worker, std::unique_ptr<CSqlExecData> pThreadData);
 
 	std::unique_ptr<IDbConnection> m_pWriteBackup;
 
@@ -209,17 +394,26 @@ void CBackup::Start(void *pUser)
 	delete pThis;
 }
 
+void CBackup::PassOn(int Worker, std::unique_ptr<CSqlExecData> pThreadData)
+{
+	// a slow worker holds up the others, but never the game
+	CDbConnectionPool::CSharedData::CWorkerQueue *pQueue = &m_pShared->m_aWorkers[Worker];
+	while(!pQueue->m_Queries.Push(pThreadData))
+		std::this_thread::sleep_for(1ms);
+	pQueue->m_NumQueries.Signal();
+}
+
 void CBackup::ProcessQueries()
 {
 	for(int JobNum = 0;; JobNum++)
 	{
-		m_pShared->m_NumBackup.Wait();
-		CSqlExecData *pThreadData = m_pShared->m_aQueries[JobNum % std::size(m_pShared->m_aQueries)].get();
+		auto pThreadData = m_pShared->m_Queries.PopSignalled(&m_pShared->m_NumBackup);
 
 		// work through all database jobs after OnShutdown is called before exiting the thread
 		if(pThreadData == nullptr)
 		{
-			m_pShared->m_NumWorker.Signal();
+			for(int i = 0; i < m_pShared->m_NumWorkers; i++)
+				PassOn(i, nullptr);
 			return;
 		}
 
@@ -230,11 +424,34 @@ void CBackup::ProcessQueries()
 		}
 		else if(pThreadData->m_Mode == CSqlExecData::WRITE_ACCESS && m_pWriteBackup.get())
 		{
-			bool Success = CDbConnectionPool::ExecSqlFunc(m_pWriteBackup.get(), pThreadData, Write::BACKUP_FIRST);
+			bool Success = CDbConnectionPool::ExecSqlFunc(m_pWriteBackup.get(), pThreadData.get(), Write::BACKUP_FIRST);
 			if(m_DebugSql || !Success)
 				dbg_msg("sql", "[%i] %s done on write backup database, Success=%i", JobNum, pThreadData->m_pName, Success);
 		}
-		m_pShared->m_NumWorker.Signal();
+
+		// every worker opens its own connection to a new database
+		if(pThreadData->m_Mode == CSqlExecData::ADD_SQLITE)
+		{
+			for(int i = 1; i < m_pShared->m_NumWorkers; i++)
+				PassOn(i, std::make_unique<CSqlExecData>(pThreadData->m_Ptr.m_Sqlite.m_Mode, pThreadData->m_Ptr.m_Sqlite.m_FileName));
+			PassOn(0, std::move(pThreadData));
+		}
+		else if(pThreadData->m_Mode == CSqlExecData::ADD_MYSQL)
+		{
+			for(int i = 1; i < m_pShared->m_NumWorkers; i++)
+				PassOn(i, std::make_unique<CSqlExecData>(pThreadData->m_Ptr.m_Mysql.m_Mode, &pThreadData->m_Ptr.m_Mysql.m_Config));
+			PassOn(0, std::move(pThreadData));
+		}
+		else if(pThreadData->m_Key >= 0)
+		{
+			int Worker = pThreadData->m_Key % m_pShared->m_NumWorkers;
+			PassOn(Worker, std::move(pThreadData));
+		}
+		else
+		{
+			PassOn(m_NextWorker, std::move(pThreadData));
+			m_NextWorker = (m_NextWorker + 1) % m_pShared->m_NumWorkers;
+		}
 	}
 }
 
@@ -245,14 +462,15 @@ void CBackup::ProcessQueries()
 class CWorker
 {
 public:
-	CWorker(std::shared_ptr<CDbConnectionPool::CSharedData> pShared, int DebugSql) :
-		m_DebugSql(DebugSql), m_pShared(std::move(pShared)) {}
+	CWorker(std::shared_ptr<CDbConnectionPool::CSharedData> pShared, int Index, int DebugSql) :
+		m_Index(Index), m_DebugSql(DebugSql), m_pShared(std::move(pShared)) {}
 	static void Start(void *pUser);
 	void ProcessQueries();
 
 private:
 	void Print(IConsole *pConsole, CDbConnectionPool::Mode DatabaseMode);
 
+	int m_Index;
 	bool m_DebugSql;
 
 	// There are two possible configurations
@@ -263,6 +481,7 @@ private:
 	//                Servers must be the same (to counteract double loads).
 	//                There may be one WRITE_BACKUP sqlite server.
 	// This variable should only change, before the worker threads
+	// Every worker has its own connections, so they don't wait on each other
 	std::vector<std::unique_ptr<IDbConnection>> m_vpReadConnections;
 	std::unique_ptr<IDbConnection> m_pWriteConnection;
 	std::unique_ptr<IDbConnection> m_pWriteBackup;
@@ -285,20 +504,23 @@ void CWorker::ProcessQueries()
 	// enter fail mode when a sql request fails, skip read request during it and
 	// write to the backup database until all requests are handled
 	bool FailMode = false;
+	CDbConnectionPool::CSharedData::CWorkerQueue *pQueue = &m_pShared->m_aWorkers[m_Index];
 	for(int JobNum = 0;; JobNum++)
 	{
-		if(FailMode && m_pShared->m_NumWorker.GetApproximateValue() == 0)
+		if(FailMode && pQueue->m_NumQueries.GetApproximateValue() == 0)
 		{
 			FailMode = false;
 		}
-		m_pShared->m_NumWorker.Wait();
-		auto pThreadData = std::move(m_pShared->m_aQueries[JobNum % std::size(m_pShared->m_aQueries)]);
+		auto pThreadData = pQueue->m_Queries.PopSignalled(&pQueue->m_NumQueries);
 		// work through all database jobs after OnShutdown is called before exiting the thread
 		if(pThreadData == nullptr)
 		{
-			m_pShared->m_Shutdown.store(false);
+			// the last worker tells the main thread that everything is written
+			if(--m_pShared->m_NumRunning == 0)
+				m_pShared->m_Shutdown.store(false);
 			return;
 		}
+		int64 StartTime = time_get();
 		bool Success = false;
 		switch(pThreadData->m_Mode)
 		{
@@ -406,6 +628,14 @@ void CWorker::ProcessQueries()
 		}
 		if(!Success)
 			dbg_msg("sql", "[%i] %s failed on all databases", JobNum, pThreadData->m_pName);
+		if(pThreadData->m_Mode == CSqlExecData::READ_ACCESS || pThreadData->m_Mode == CSqlExecData::WRITE_ACCESS)
+		{
+			m_pShared->AddTiming(StartTime - pThreadData->m_EnqueueTime, time_get() - StartTime);
+			if(Success)
+				m_pShared->m_NumDone++;
+			else
+				m_pShared->m_NumFailed++;
+		}
 		if(pThreadData->m_pThreadData != nullptr && pThreadData->m_pThreadData->m_pResult != nullptr)
 		{
 			pThreadData->m_pThreadData->m_pResult->m_Success = Success;
@@ -476,15 +706,26 @@ bool CDbConnectionPool::ExecSqlFunc(IDbConnection *pConnection, CSqlExecData *pD
 CDbConnectionPool::CDbConnectionPool()
 {
 	m_pShared = std::make_shared<CSharedData>();
-	m_pWorkerThread = thread_init(CWorker::Start, new CWorker(m_pShared, 0));
+}
+
+void CDbConnectionPool::Start(int NumWorkers)
+{
+	if(m_NumWorkers)
+		return;
+
+	m_NumWorkers = clamp(NumWorkers, 1, (int)MAX_WORKERS);
+	m_pShared->m_NumWorkers = m_NumWorkers;
+	m_pShared->m_NumRunning = m_NumWorkers;
+	for(int i = 0; i < m_NumWorkers; i++)
+		m_apWorkerThreads[i] = thread_init(CWorker::Start, new CWorker(m_pShared, i, 0));
 	m_pBackupThread = thread_init(CBackup::Start, new CBackup(m_pShared, 0));
 }
 
 CDbConnectionPool::~CDbConnectionPool()
 {
 	OnShutdown();
-	if(m_pWorkerThread)
-		thread_wait(m_pWorkerThread);
+	for(int i = 0; i < m_NumWorkers; i++)
+		thread_wait(m_apWorkerThreads[i]);
 	if(m_pBackupThread)
 		thread_wait(m_pBackupThread);
 }
@@ -76,21 +76,36 @@ public:
 		NUM_MODES,
 	};
 
+	enum
+	{
+		MAX_WORKERS=16,
+	};
+
+	// Starts the worker threads, each with its own connections to every
+	// registered database. Has to be called before anything else.
+	void Start(int NumWorkers);
+
 	void Print(IConsole *pConsole, Mode DatabaseMode);
+	// prints queue depth and latency, read directly on the calling thread
+	void PrintStats(IConsole *pConsole);
 
 	void RegisterSqliteDatabase(Mode DatabaseMode, const char FileName[64]);
 	void RegisterMysqlDatabase(Mode DatabaseMode, const CMysqlConfig *pMysqlConfig);
 
+	// Queries with the same non-negative key run on the same worker in the
+	// order they were added, queries without a key go to any worker.
 	void Execute(
 		FRead pFunc,
 		std::unique_ptr<const ISqlData> pSqlRequestData,
-		const char *pName);
+		const char *pName,
+		int Key = -1);
 	// writes to WRITE_BACKUP first and removes it from there when successfully
 	// executed on WRITE server
 	void ExecuteWrite(
 		FWrite pFunc,
 		std::unique_ptr<const ISqlData> pSqlRequestData,
-		const char *pName);
+		const char *pName,
+		int Key = -1);
 
 	void OnShutdown();
 
@@ -99,34 +114,16 @@ public:
 
 private:
 	static bool ExecSqlFunc(IDbConnection *pConnection, struct CSqlExecData *pData, Write w);
-
-	// Only the main thread accesses this variable. It points to the index,
-	// where the next query is added to the queue.
-	int m_InsertIdx = 0;
+	void Enqueue(std::unique_ptr<struct CSqlExecData> pData);
 
 	bool m_Shutdown = false;
 
-	struct CSharedData
-	{
-		// Used as signal that shutdown is in progress from main thread to
-		// speed up the queries by discarding read queries and writing to
-		// the sqlite file instead of the remote mysql server.
-		// The worker thread signals the main thread that all queries are
-		// processed by setting this variable to false again.
-		std::atomic_bool m_Shutdown{false};
-		// Queries go first to the backup thread. This semaphore signals about
-		// new queries.
-		CSemaphore m_NumBackup;
-		// When the backup thread processed the query, it signals the main
-		// thread with this semaphore about the new query
-		CSemaphore m_NumWorker;
-
-		// spsc queue with additional backup worker to look at queries first.
-		std::unique_ptr<struct CSqlExecData> m_aQueries[512];
-	};
+	// defined in connection_pool.cpp, shared with the worker threads
+	struct CSharedData;
 
 	std::shared_ptr<CSharedData> m_pShared;
-	void *m_pWorkerThread = nullptr;
+	void *m_apWorkerThreads[MAX_WORKERS];
+	int m_NumWorkers = 0;
 	void *m_pBackupThread = nullptr;
 };
 
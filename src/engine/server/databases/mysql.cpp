@@ -104,6 +104,10 @@ public:
 
 	bool AddPoints(const char *pPlayer, int Points, char *pError, int ErrorSize) override;
 
+	bool BeginTransaction(char *pError, int ErrorSize) override;
+	bool CommitTransaction(char *pError, int ErrorSize) override;
+	bool RollbackTransaction(char *pError, int ErrorSize) override;
+
 private:
 	class CStmtDeleter
 	{
@@ -294,17 +298,20 @@ bool CMysqlConnection::ConnectImpl()
 		char aCreateMaps[1024];
 		char aCreateSaves[1024];
 		char aCreatePoints[1024];
+		char aCreateStats[1024];
 		FormatCreateRace(aCreateRace, sizeof(aCreateRace), /* Backup */ false);
 		FormatCreateTeamrace(aCreateTeamrace, sizeof(aCreateTeamrace), "VARBINARY(16)", /* Backup */ false);
 		FormatCreateMaps(aCreateMaps, sizeof(aCreateMaps));
 		FormatCreateSaves(aCreateSaves, sizeof(aCreateSaves), /* Backup */ false);
 		FormatCreatePoints(aCreatePoints, sizeof(aCreatePoints));
+		FormatCreateStats(aCreateStats, sizeof(aCreateStats));
 
 		if(PrepareAndExecuteStatement(aCreateRace) ||
 			PrepareAndExecuteStatement(aCreateTeamrace) ||
 			PrepareAndExecuteStatement(aCreateMaps) ||
 			PrepareAndExecuteStatement(aCreateSaves) ||
-			PrepareAndExecuteStatement(aCreatePoints))
+			PrepareAndExecuteStatement(aCreatePoints) ||
+			PrepareAndExecuteStatement(aCreateStats))
 		{
 			return true;
 		}
@@ -705,6 +712,41 @@ bool CMysqlConnection::AddPoints(const char *pPlayer, int Points, char *pError,
 	return ExecuteUpdate(&NumUpdated, pError, ErrorSize);
 }
 
+bool CMysqlConnection::BeginTransaction(char *pError, int ErrorSize)
+{
+	if(mysql_autocommit(&m_Mysql, false))
+	{
+		StoreErrorMysql("autocommit");
+		str_copy(pError, m_aErrorDetail, ErrorSize);
+		return true;
+	}
+	return false;
+}
+
+bool CMysqlConnection::CommitTransaction(char *pError, int ErrorSize)
+{
+	bool Error = mysql_commit(&m_Mysql);
+	if(Error)
+	{
+		StoreErrorMysql("commit");
+		str_copy(pError, m_aErrorDetail, ErrorSize);
+	}
+	mysql_autocommit(&m_Mysql, true);
+	return Error;
+}
+
+bool CMysqlConnection::RollbackTransaction(char *pError, int ErrorSize)
+{
+	bool Error = mysql_rollback(&m_Mysql);
+	if(Error)
+	{
+		StoreErrorMysql("rollback");
+		str_copy(pError, m_aErrorDetail, ErrorSize);
+	}
+	mysql_autocommit(&m_Mysql, true);
+	return Error;
+}
+
 std::unique_ptr<IDbConnection> CreateMysqlConnection(CMysqlConfig Config)
 {
 	return std::make_unique<CMysqlConnection>(Config);
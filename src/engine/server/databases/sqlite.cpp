@@ -53,6 +53,10 @@ public:
 
 	bool AddPoints(const char *pPlayer, int Points, char *pError, int ErrorSize) override;
 
+	bool BeginTransaction(char *pError, int ErrorSize) override { return Execute("BEGIN", pError, ErrorSize); }
+	bool CommitTransaction(char *pError, int ErrorSize) override { return Execute("COMMIT", pError, ErrorSize); }
+	bool RollbackTransaction(char *pError, int ErrorSize) override { return Execute("ROLLBACK", pError, ErrorSize); }
+
 	// fail safe
 	bool CreateFailsafeTables();
 
@@ -144,8 +148,10 @@ bool CSqliteConnection::ConnectImpl(char *pError, int ErrorSize)
 		return true;
 	}
 
-	// wait for database to unlock so we don't have to handle SQLITE_BUSY errors
-	sqlite3_busy_timeout(m_pDb, -1);
+	// wait for database to unlock so we don't have to handle SQLITE_BUSY errors,
+	// every database worker writes through its own connection. A timeout of
+	// zero or less would disable the wait
+	sqlite3_busy_timeout(m_pDb, 60000);
 
 	if(m_Setup)
 	{
@@ -165,6 +171,9 @@ bool CSqliteConnection::ConnectImpl(char *pError, int ErrorSize)
 		if(Execute(aBuf, pError, ErrorSize))
 			return true;
 		FormatCreatePoints(aBuf, sizeof(aBuf));
+		if(Execute(aBuf, pError, ErrorSize))
+			return true;
+		FormatCreateStats(aBuf, sizeof(aBuf));
 		if(Execute(aBuf, pError, ErrorSize))
 			return true;
 
@@ -0,0 +1,207 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <engine/shared/demo.h>
+
+#include "demowriter.h"
+
+CDemoWriter::CDemoWriter()
+{
+	m_pStorage = 0;
+	m_Lock = lock_create();
+	m_pQueue = 0;
+	m_QueueStart = 0;
+	m_QueueUsed = 0;
+	mem_zero(m_aStaticSizes, sizeof(m_aStaticSizes));
+	m_Shutdown = false;
+	m_pThread = 0;
+	for(int i = 0; i < MAX_GAMES; i++)
+	{
+		m_aRecording[i] = false;
+		m_aDropped[i] = 0;
+		m_apRecorders[i] = 0;
+	}
+}
+
+CDemoWriter::~CDemoWriter()
+{
+	Shutdown();
+	for(int i = 0; i < MAX_GAMES; i++)
+		delete m_apRecorders[i];
+	if(m_pQueue)
+		mem_free(m_pQueue);
+	lock_destroy(m_Lock);
+}
+
+void CDemoWriter::Init(IStorage *pStorage)
+{
+	m_pStorage = pStorage;
+}
+
+void CDemoWriter::SetStaticsize(int ItemType, int Size)
+{
+	// handed to the delta of the writer thread when a demo starts
+	lock_wait(m_Lock);
+	m_aStaticSizes[ItemType] = Size;
+	lock_unlock(m_Lock);
+}
+
+bool CDemoWriter::Push(int Type, int GameID, int Tick, const void *pData, int Size, bool Wait)
+{
+	int RecordSize = sizeof(CRecord)+((Size+3)&~3);
+	while(1)
+	{
+		lock_wait(m_Lock);
+		int End = (m_QueueStart+m_QueueUsed)%QUEUE_SIZE;
+		// a record is kept in one piece, the end of the queue is skipped if it doesn't fit there
+		int Pad = End+RecordSize > QUEUE_SIZE ? QUEUE_SIZE-End : 0;
+		bool Fits = m_QueueUsed+Pad+RecordSize <= QUEUE_SIZE;
+		lock_unlock(m_Lock);
+
+		if(Fits)
+		{
+			// the writer thread doesn't read past the used part, no need to lock while copying
+			if(Pad >= (int)sizeof(CRecord))
+				((CRecord *)(m_pQueue+End))->m_Type = RECORD_PAD;
+			CRecord *pRecord = (CRecord *)(m_pQueue+(End+Pad)%QUEUE_SIZE);
+			pRecord->m_Type = Type;
+			pRecord->m_GameID = GameID;
+			pRecord->m_Tick = Tick;
+			pRecord->m_Size = Size;
+			if(Size)
+				mem_copy(pRecord+1, pData, Size);
+
+			lock_wait(m_Lock);
+			m_QueueUsed += Pad+RecordSize;
+			lock_unlock(m_Lock);
+			m_Work.Signal();
+			return true;
+		}
+
+		if(!Wait)
+			return false;
+		thread_sleep(1);
+	}
+}
+
+void CDemoWriter::WriteRecord(const CRecord *pRecord, const void *pData)
+{
+	CDemoRecorder *pRecorder = m_apRecorders[pRecord->m_GameID];
+	if(pRecord->m_Type == RECORD_START)
+	{
+		const CStartInfo *pInfo = (const CStartInfo *)pData;
+		if(pRecorder)
+			pRecorder->Stop();
+		else
+			pRecorder = m_apRecorders[pRecord->m_GameID] = new CDemoRecorder(&m_SnapshotDelta);
+
+		lock_wait(m_Lock);
+		for(int i = 0; i < 64; i++)
+			m_SnapshotDelta.SetStaticsize(i, m_aStaticSizes[i]);
+		lock_unlock(m_Lock);
+
+		pRecorder->Start(m_pStorage, 0, pInfo->m_aFilename, pInfo->m_aNetVersion, pInfo->m_aMap, pInfo->m_MapCrc, "server");
+	}
+	else if(!pRecorder || !pRecorder->IsRecording())
+		return;
+	else if(pRecord->m_Type == RECORD_STOP)
+		pRecorder->Stop();
+	else if(pRecord->m_Type == RECORD_SNAPSHOT)
+		pRecorder->RecordSnapshot(pRecord->m_Tick, pData, pRecord->m_Size);
+	else if(pRecord->m_Type == RECORD_MESSAGE)
+		pRecorder->RecordMessage(pData, pRecord->m_Size);
+}
+
+void CDemoWriter::WriterThread(void *pUser)
+{
+	CDemoWriter *pThis = (CDemoWriter *)pUser;
+
+	// one signal for every record, the last one after shutdown was set
+	while(1)
+	{
+		pThis->m_Work.Wait();
+
+		lock_wait(pThis->m_Lock);
+		if(!pThis->m_QueueUsed)
+		{
+			lock_unlock(pThis->m_Lock);
+			if(pThis->m_Shutdown)
+				break;
+			continue;
+		}
+		const CRecord *pRecord = (const CRecord *)(pThis->m_pQueue+pThis->m_QueueStart);
+		if(QUEUE_SIZE-pThis->m_QueueStart < (int)sizeof(CRecord) || pRecord->m_Type == RECORD_PAD)
+		{
+			pThis->m_QueueUsed -= QUEUE_SIZE-pThis->m_QueueStart;
+			pThis->m_QueueStart = 0;
+			pRecord = (const CRecord *)pThis->m_pQueue;
+		}
+		lock_unlock(pThis->m_Lock);
+
+		pThis->WriteRecord(pRecord, pRecord+1);
+
+		int RecordSize = sizeof(CRecord)+((pRecord->m_Size+3)&~3);
+		lock_wait(pThis->m_Lock);
+		pThis->m_QueueStart = (pThis->m_QueueStart+RecordSize)%QUEUE_SIZE;
+		pThis->m_QueueUsed -= RecordSize;
+		lock_unlock(pThis->m_Lock);
+	}
+}
+
+void CDemoWriter::Start(int GameID, const char *pFilename, const char *pNetVersion, const char *pMap, unsigned MapCrc)
+{
+	if(!m_pThread)
+	{
+		if(!m_pQueue)
+			m_pQueue = (unsigned char *)mem_alloc(QUEUE_SIZE, sizeof(int));
+		m_Shutdown = false;
+		m_pThread = thread_init(WriterThread, this);
+	}
+
+	CStartInfo Info;
+	mem_zero(&Info, sizeof(Info));
+	str_copy(Info.m_aFilename, pFilename, sizeof(Info.m_aFilename));
+	str_copy(Info.m_aNetVersion, pNetVersion, sizeof(Info.m_aNetVersion));
+	str_copy(Info.m_aMap, pMap, sizeof(Info.m_aMap));
+	Info.m_MapCrc = MapCrc;
+	Push(RECORD_START, GameID, 0, &Info, sizeof(Info), true);
+
+	m_aRecording[GameID] = true;
+	m_aDropped[GameID] = 0;
+}
+
+void CDemoWriter::Stop(int GameID)
+{
+	if(!m_aRecording[GameID])
+		return;
+
+	Push(RECORD_STOP, GameID, 0, 0, 0, true);
+	m_aRecording[GameID] = false;
+	if(m_aDropped[GameID])
+		dbg_msg("demo_recorder", "game %d: %d snapshots and messages didn't fit into the queue", GameID, m_aDropped[GameID]);
+}
+
+void CDemoWriter::RecordSnapshot(int GameID, int Tick, const void *pData, int Size)
+{
+	if(m_aRecording[GameID] && !Push(RECORD_SNAPSHOT, GameID, Tick, pData, Size, false))
+		m_aDropped[GameID]++;
+}
+
+void CDemoWriter::RecordMessage(int GameID, const void *pData, int Size)
+{
+	if(m_aRecording[GameID] && !Push(RECORD_MESSAGE, GameID, 0, pData, Size, false))
+		m_aDropped[GameID]++;
+}
+
+void CDemoWriter::Shutdown()
+{
+	for(int i = 0; i < MAX_GAMES; i++)
+		Stop(i);
+
+	if(m_pThread)
+	{
+		m_Shutdown = true;
+		m_Work.Signal();
+		thread_wait(m_pThread);
+		m_pThread = 0;
+	}
+}
@@ -0,0 +1,112 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SERVER_DEMOWRITER_H
+#define ENGINE_SERVER_DEMOWRITER_H
+
+#include <base/system.h>
+#include <base/tl/threading.h>
+
+#include <engine/shared/snapshot.h>
+
+/*
+	Class: Demo writer
+		Records the demos of the games on a background thread. The
+		main thread only copies snapshots and messages into a bounded
+		queue, the deltas, the compression and the file writes
+		happen on the writer thread. Snapshots and messages that
+		don't fit into the queue are dropped and counted. Only the
+		main thread calls the public functions.
+*/
+class CDemoWriter
+{
+public:
+	enum
+	{
+		// same as the game limit of the server
+		MAX_GAMES=64,
+	};
+
+private:
+	enum
+	{
+		QUEUE_SIZE=4*1024*1024,
+
+		RECORD_START=0,
+		RECORD_STOP,
+		RECORD_SNAPSHOT,
+		RECORD_MESSAGE,
+		// fills the end of the queue when the next record doesn't fit there
+		RECORD_PAD,
+	};
+
+	// followed by m_Size bytes of data, padded to 4
+	class CRecord
+	{
+	public:
+		int m_Type;
+		int m_GameID;
+		int m_Tick;
+		int m_Size;
+	};
+
+	class CStartInfo
+	{
+	public:
+		char m_aFilename[128];
+		char m_aNetVersion[64];
+		char m_aMap[64];
+		unsigned m_MapCrc;
+	};
+
+	class IStorage *m_pStorage;
+
+	// shared with the writer thread, guarded by m_Lock. the main
+	// thread writes behind the used part, the writer thread reads
+	// its start
+	LOCK m_Lock;
+	unsigned char *m_pQueue;
+	int m_QueueStart;
+	int m_QueueUsed;
+	short m_aStaticSizes[64];
+
+	CSemaphore m_Work;
+	std::atomic_bool m_Shutdown;
+	void *m_pThread;
+
+	// main thread
+	bool m_aRecording[MAX_GAMES];
+	int m_aDropped[MAX_GAMES];
+
+	// writer thread
+	class CDemoRecorder *m_apRecorders[MAX_GAMES];
+	CSnapshotDelta m_SnapshotDelta;
+
+	static void WriterThread(void *pUser);
+	void WriteRecord(const CRecord *pRecord, const void *pData);
+	bool Push(int Type, int GameID, int Tick, const void *pData, int Size, bool Wait);
+
+public:
+	CDemoWriter();
+	~CDemoWriter();
+
+	void Init(class IStorage *pStorage);
+	void SetStaticsize(int ItemType, int Size);
+
+	/*
+		Function: Start
+			Queues the start of a demo of a game, the file is opened
+			and the map written to it by the writer thread. Stops the
+			demo the game is recording.
+	*/
+	void Start(int GameID, const char *pFilename, const char *pNetVersion, const char *pMap, unsigned MapCrc);
+	void Stop(int GameID);
+	bool IsRecording(int GameID) const { return m_aRecording[GameID]; }
+
+	void RecordSnapshot(int GameID, int Tick, const void *pData, int Size);
+	void RecordMessage(int GameID, const void *pData, int Size);
+
+	// stops all demos and waits until everything is written
+	void Shutdown();
+};
+
+#endif
@@ -0,0 +1,134 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <engine/map.h>
+#include <engine/server.h>
+#include <engine/storage.h>
+#include <engine/shared/mapchecker.h>
+
+#include "maploader.h"
+
+CMapLoader::CMapLoader()
+{
+	m_pKernel = 0;
+	m_pStorage = 0;
+	m_pMapChecker = 0;
+	m_Lock = lock_create();
+	m_QueueStart = 0;
+	m_QueueNum = 0;
+	m_NumResults = 0;
+	m_Shutdown = false;
+	m_pThread = 0;
+}
+
+CMapLoader::~CMapLoader()
+{
+	if(m_pThread)
+	{
+		m_Shutdown = true;
+		m_Work.Signal();
+		thread_wait(m_pThread);
+	}
+	lock_destroy(m_Lock);
+}
+
+void CMapLoader::Init(IKernel *pKernel, IStorage *pStorage, CMapChecker *pMapChecker)
+{
+	if(m_pThread)
+		return;
+
+	m_pKernel = pKernel;
+	m_pStorage = pStorage;
+	m_pMapChecker = pMapChecker;
+	m_pThread = thread_init(LoaderThread, this);
+}
+
+bool CMapLoader::Load(sMap *pMap)
+{
+	lock_wait(m_Lock);
+	if(m_QueueNum == MAX_QUEUE)
+	{
+		lock_unlock(m_Lock);
+		return false;
+	}
+	m_apQueue[(m_QueueStart+m_QueueNum)%MAX_QUEUE] = pMap;
+	m_QueueNum++;
+	lock_unlock(m_Lock);
+	m_Work.Signal();
+	return true;
+}
+
+bool CMapLoader::PopResult(CResult *pResult)
+{
+	lock_wait(m_Lock);
+	if(!m_NumResults)
+	{
+		lock_unlock(m_Lock);
+		return false;
+	}
+
+	// hand results out in the order the maps finished
+	*pResult = m_aResults[0];
+	for(int i = 1; i < m_NumResults; i++)
+		m_aResults[i-1] = m_aResults[i];
+	m_NumResults--;
+	lock_unlock(m_Lock);
+	return true;
+}
+
+int CMapLoader::LoadMap(sMap *pMap)
+{
+	char aBuf[512];
+	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMap->m_aCurrentMap);
+
+	// check for valid standard map
+	if(!m_pMapChecker->ReadAndValidateMap(m_pStorage, aBuf, IStorage::TYPE_ALL))
+		return ERROR_INVALID;
+
+	IEngineMap *pEngineMap = CreateEngineMap();
+	if(!pEngineMap->Load(aBuf, m_pKernel))
+	{
+		delete pEngineMap;
+		return ERROR_LOAD;
+	}
+
+	// downloads are served from the file the map was loaded from
+	pMap->m_pCurrentMapData = pEngineMap->FileData();
+	pMap->m_CurrentMapSize = pEngineMap->FileSize();
+
+	pMap->m_pMap = pEngineMap;
+	pMap->m_CurrentMapCrc = pEngineMap->Crc();
+	return ERROR_NONE;
+}
+
+void CMapLoader::LoaderThread(void *pUser)
+{
+	CMapLoader *pThis = (CMapLoader *)pUser;
+
+	while(1)
+	{
+		pThis->m_Work.Wait();
+		if(pThis->m_Shutdown)
+			break;
+
+		sMap *pMap;
+		lock_wait(pThis->m_Lock);
+		if(!pThis->m_QueueNum)
+		{
+			lock_unlock(pThis->m_Lock);
+			continue;
+		}
+		pMap = pThis->m_apQueue[pThis->m_QueueStart];
+		pThis->m_QueueStart = (pThis->m_QueueStart+1)%MAX_QUEUE;
+		pThis->m_QueueNum--;
+		lock_unlock(pThis->m_Lock);
+
+		CResult Result;
+		Result.m_pMap = pMap;
+		Result.m_Error = pThis->LoadMap(pMap);
+
+		// every queued map has one result, so this can't overflow
+		lock_wait(pThis->m_Lock);
+		pThis->m_aResults[pThis->m_NumResults++] = Result;
+		lock_unlock(pThis->m_Lock);
+	}
+}
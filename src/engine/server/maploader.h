@@ -0,0 +1,87 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SERVER_MAPLOADER_H
+#define ENGINE_SERVER_MAPLOADER_H
+
+#include <base/system.h>
+#include <base/tl/threading.h>
+
+#include <atomic>
+
+/*
+	Class: Map loader
+		Validates, opens and reads maps for the map store on a
+		background thread, so loading a map for one game doesn't
+		stall the tick of every other game. The finished map is
+		handed back to the main thread by PopResult.
+*/
+class CMapLoader
+{
+public:
+	enum
+	{
+		ERROR_NONE=0,
+		ERROR_INVALID,
+		ERROR_LOAD,
+	};
+
+	class CResult
+	{
+	public:
+		struct sMap *m_pMap;
+		int m_Error;
+	};
+
+private:
+	enum
+	{
+		MAX_QUEUE=64,
+	};
+
+	class IKernel *m_pKernel;
+	class IStorage *m_pStorage;
+	class CMapChecker *m_pMapChecker;
+
+	// shared with the loader thread, guarded by m_Lock
+	LOCK m_Lock;
+	struct sMap *m_apQueue[MAX_QUEUE];
+	int m_QueueStart;
+	int m_QueueNum;
+	CResult m_aResults[MAX_QUEUE];
+	int m_NumResults;
+
+	CSemaphore m_Work;
+	std::atomic_bool m_Shutdown;
+	void *m_pThread;
+
+	static void LoaderThread(void *pUser);
+	int LoadMap(struct sMap *pMap);
+
+public:
+	CMapLoader();
+	~CMapLoader();
+
+	void Init(class IKernel *pKernel, class IStorage *pStorage, class CMapChecker *pMapChecker);
+
+	/*
+		Function: Load
+			Queues the map named by pMap->m_aCurrentMap. The loader
+			fills in the map, its crc and the download data, the
+			entry must not be touched until PopResult returned it.
+
+		Returns:
+			False if the queue is full.
+	*/
+	bool Load(struct sMap *pMap);
+
+	/*
+		Function: PopResult
+			Fetches a map that finished loading.
+
+		Returns:
+			False if no map has finished.
+	*/
+	bool PopResult(CResult *pResult);
+};
+
+#endif
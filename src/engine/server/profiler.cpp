@@ -0,0 +1,116 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include <algorithm>
+
+#include "profiler.h"
+
+static const struct
+{
+	const char *m_pName;
+	int m_Level;
+} s_aPhaseInfo[CTickProfiler::NUM_PHASES] = {
+	{"loop", 0},
+	{"tick", 1},
+	{"input", 2},
+	{"game tick", 2},
+	{"snapshot", 1},
+	{"presnap", 2},
+	{"build", 2},
+	{"delta", 2},
+	{"compress", 2},
+	{"send", 2},
+	{"postsnap", 2},
+	{"network", 1},
+	{"update", 1},
+	{"tick delay", 0},
+};
+
+static const char *s_apCounterNames[CTickProfiler::NUM_COUNTERS] = {
+	"recv syscalls",
+	"send syscalls",
+	"recv packets",
+	"sent packets",
+	"snap allocs",
+	"snap kbytes",
+	"snaps shared",
+	"deltas reused",
+};
+
+void CTickProfiler::CSamples::AddValue(int Value)
+{
+	m_aSamples[m_Next] = Value;
+	m_Next = (m_Next+1)%NUM_SAMPLES;
+	if(m_Num < NUM_SAMPLES)
+		m_Num++;
+}
+
+CTickProfiler::CTickProfiler()
+{
+	for(int i = 0; i < NUM_PHASES; i++)
+		m_aPhases[i].Clear();
+	for(int i = 0; i < NUM_COUNTERS; i++)
+		m_aCounters[i].Clear();
+	for(int g = 0; g < MAX_GAMES; g++)
+		ClearGame(g);
+}
+
+void CTickProfiler::ClearGame(int GameID)
+{
+	for(int i = 0; i < NUM_GAMEPHASES; i++)
+		m_aaGames[GameID][i].Clear();
+}
+
+void CTickProfiler::FormatSamples(const CSamples *pSamples, const char *pName, int Indent, bool Duration, char *pBuf, int BufSize)
+{
+	if(!pSamples->m_Num)
+	{
+		str_format(pBuf, BufSize, "%*s%-*s no samples", Indent*2, "", 14-Indent*2, pName);
+		return;
+	}
+
+	int aSorted[NUM_SAMPLES];
+	mem_copy(aSorted, pSamples->m_aSamples, pSamples->m_Num*sizeof(int));
+	std::sort(aSorted, aSorted+pSamples->m_Num);
+
+	int Num = pSamples->m_Num;
+	if(Duration)
+		str_format(pBuf, BufSize, "%*s%-*s p50=%7.3fms p99=%7.3fms max=%7.3fms n=%d", Indent*2, "", 14-Indent*2, pName,
+			aSorted[Num/2]/1000.0f, aSorted[min(Num-1, Num*99/100)]/1000.0f, aSorted[Num-1]/1000.0f, Num);
+	else
+		str_format(pBuf, BufSize, "%*s%-*s p50=%7d   p99=%7d   max=%7d   n=%d", Indent*2, "", 14-Indent*2, pName,
+			aSorted[Num/2], aSorted[min(Num-1, Num*99/100)], aSorted[Num-1], Num);
+}
+
+void CTickProfiler::Report(FLineCallback pfnCallback, void *pUser)
+{
+	char aBuf[256];
+	for(int i = 0; i < NUM_PHASES; i++)
+	{
+		FormatSamples(&m_aPhases[i], s_aPhaseInfo[i].m_pName, s_aPhaseInfo[i].m_Level, true, aBuf, sizeof(aBuf));
+		pfnCallback(aBuf, pUser);
+	}
+
+	pfnCallback("per tick", pUser);
+	for(int i = 0; i < NUM_COUNTERS; i++)
+	{
+		FormatSamples(&m_aCounters[i], s_apCounterNames[i], 1, false, aBuf, sizeof(aBuf));
+		pfnCallback(aBuf, pUser);
+	}
+
+	static const char *s_apGamePhases[NUM_GAMEPHASES] = {"tick", "snapshot"};
+	for(int g = 0; g < MAX_GAMES; g++)
+	{
+		if(!m_aaGames[g][GAMEPHASE_TICK].m_Num && !m_aaGames[g][GAMEPHASE_SNAP].m_Num)
+			continue;
+
+		str_format(aBuf, sizeof(aBuf), "game %d", g);
+		pfnCallback(aBuf, pUser);
+		for(int i = 0; i < NUM_GAMEPHASES; i++)
+		{
+			FormatSamples(&m_aaGames[g][i], s_apGamePhases[i], 1, true, aBuf, sizeof(aBuf));
+			pfnCallback(aBuf, pUser);
+		}
+	}
+}
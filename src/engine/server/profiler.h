@@ -0,0 +1,118 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SERVER_PROFILER_H
+#define ENGINE_SERVER_PROFILER_H
+
+#include <base/system.h>
+
+/*
+	Class: Tick profiler
+		Keeps the durations of the last samples of every phase of the
+		server loop and of every game instance, and the last values
+		of a few per tick counters, to report their percentiles. Recording a sample only stores it in a ring, the
+		sorting happens when the report is requested. Only used by
+		the main thread.
+*/
+class CTickProfiler
+{
+public:
+	enum
+	{
+		PHASE_LOOP=0,
+		PHASE_TICK,
+		PHASE_INPUT,
+		PHASE_GAMETICK,
+		PHASE_SNAP,
+		PHASE_SNAP_PRESNAP,
+		PHASE_SNAP_BUILD,
+		PHASE_SNAP_DELTA,
+		PHASE_SNAP_COMPRESS,
+		PHASE_SNAP_SEND,
+		PHASE_SNAP_POSTSNAP,
+		PHASE_NETWORK,
+		PHASE_UPDATE,
+		// how late a tick started after its due time
+		PHASE_TICK_DELAY,
+		NUM_PHASES,
+
+		GAMEPHASE_TICK=0,
+		GAMEPHASE_SNAP,
+		NUM_GAMEPHASES,
+
+		COUNTER_RECV_SYSCALLS=0,
+		COUNTER_SEND_SYSCALLS,
+		COUNTER_RECV_PACKETS,
+		COUNTER_SENT_PACKETS,
+		COUNTER_SNAP_ALLOCS,
+		COUNTER_SNAP_KBYTES,
+		COUNTER_SNAPS_SHARED,
+		COUNTER_DELTAS_REUSED,
+		NUM_COUNTERS,
+
+		// same as the game limit of the server
+		MAX_GAMES=64,
+		NUM_SAMPLES=512,
+	};
+
+	typedef void (*FLineCallback)(const char *pLine, void *pUser);
+
+	/*
+		Class: Scope
+			Records the time until it goes out of scope as one sample.
+	*/
+	class CScope
+	{
+		CTickProfiler *m_pProfiler;
+		int m_Phase;
+		int64 m_Start;
+
+	public:
+		CScope(CTickProfiler *pProfiler, int Phase) : m_pProfiler(pProfiler), m_Phase(Phase), m_Start(time_get()) {}
+		~CScope() { m_pProfiler->Record(m_Phase, time_get()-m_Start); }
+	};
+
+private:
+	class CSamples
+	{
+	public:
+		// in microseconds for durations
+		int m_aSamples[NUM_SAMPLES];
+		int m_Next;
+		int m_Num;
+
+		void Add(int64 Time) { AddValue((int)(Time*1000000/time_freq())); }
+		void AddValue(int Value);
+		void Clear() { m_Next = 0; m_Num = 0; }
+	};
+
+	CSamples m_aPhases[NUM_PHASES];
+	CSamples m_aaGames[MAX_GAMES][NUM_GAMEPHASES];
+	CSamples m_aCounters[NUM_COUNTERS];
+
+	static void FormatSamples(const CSamples *pSamples, const char *pName, int Indent, bool Duration, char *pBuf, int BufSize);
+
+public:
+	CTickProfiler();
+
+	/*
+		Function: Record
+			Adds a sample of Time in time_get() units.
+	*/
+	void Record(int Phase, int64 Time) { m_aPhases[Phase].Add(Time); }
+	void RecordGame(int GameID, int GamePhase, int64 Time) { m_aaGames[GameID][GamePhase].Add(Time); }
+	// adds the value of a counter for one tick
+	void RecordCount(int Counter, int Value) { m_aCounters[Counter].AddValue(Value); }
+
+	// forgets the samples of a game, called when its id is reused
+	void ClearGame(int GameID);
+
+	/*
+		Function: Report
+			Calls pfnCallback with one line for every phase, indented
+			by its level, one for every counter and one for every game
+			that has samples.
+	*/
+	void Report(FLineCallback pfnCallback, void *pUser);
+};
+
+#endif
@@ -0,0 +1,247 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include <engine/shared/config.h>
+
+#include "proxycheck.h"
+
+#include "curl/curl.h"
+
+class CResponseBuffer
+{
+public:
+	char m_aData[4096];
+	int m_Size;
+};
+
+static size_t WriteCallback(char *pContents, size_t Size, size_t NMemb, void *pUser)
+{
+	CResponseBuffer *pBuf = (CResponseBuffer *)pUser;
+	int Len = (int)(Size*NMemb);
+	int Copy = min(Len, (int)sizeof(pBuf->m_aData)-1-pBuf->m_Size);
+	if(Copy > 0)
+	{
+		mem_copy(pBuf->m_aData+pBuf->m_Size, pContents, Copy);
+		pBuf->m_Size += Copy;
+		pBuf->m_aData[pBuf->m_Size] = 0;
+	}
+	return Size*NMemb;
+}
+
+CProxyCheck::CProxyCheck()
+{
+	m_NumCache = 0;
+	m_NumPending = 0;
+	m_Lock = lock_create();
+	m_QueueStart = 0;
+	m_QueueNum = 0;
+	m_NumResults = 0;
+	m_Shutdown = false;
+	m_pThread = 0;
+}
+
+CProxyCheck::~CProxyCheck()
+{
+	if(m_pThread)
+	{
+		m_Shutdown = true;
+		m_Work.Signal();
+		thread_wait(m_pThread);
+	}
+	lock_destroy(m_Lock);
+}
+
+void CProxyCheck::Init()
+{
+	if(m_pThread)
+		return;
+
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+	m_pThread = thread_init(LookupThread, this);
+}
+
+void CProxyCheck::GetKey(const NETADDR *pAddr, NETADDR *pKey)
+{
+	*pKey = *pAddr;
+	pKey->port = 0;
+
+	// providers hand out whole /64 networks, don't let them hop addresses
+	if(pKey->type == NETTYPE_IPV6)
+		mem_zero(&pKey->ip[8], 8);
+}
+
+bool CProxyCheck::SameKey(const NETADDR *pAddr1, const NETADDR *pAddr2)
+{
+	NETADDR Key1, Key2;
+	GetKey(pAddr1, &Key1);
+	GetKey(pAddr2, &Key2);
+	return net_addr_comp(&Key1, &Key2) == 0;
+}
+
+CProxyCheck::CCacheEntry *CProxyCheck::FindCache(const NETADDR *pKey)
+{
+	int64 Now = time_get();
+	for(int i = 0; i < m_NumCache; i++)
+	{
+		if(net_addr_comp(&m_aCache[i].m_Key, pKey) != 0)
+			continue;
+
+		if(m_aCache[i].m_Expire < Now)
+		{
+			m_aCache[i] = m_aCache[--m_NumCache];
+			return 0;
+		}
+		m_aCache[i].m_LastUsed = Now;
+		return &m_aCache[i];
+	}
+	return 0;
+}
+
+void CProxyCheck::AddCache(const NETADDR *pKey, int Verdict)
+{
+	CCacheEntry *pEntry = FindCache(pKey);
+	if(!pEntry)
+	{
+		if(m_NumCache < MAX_CACHE)
+			pEntry = &m_aCache[m_NumCache++];
+		else
+		{
+			// evict the least recently used entry
+			pEntry = &m_aCache[0];
+			for(int i = 1; i < m_NumCache; i++)
+				if(m_aCache[i].m_LastUsed < pEntry->m_LastUsed)
+					pEntry = &m_aCache[i];
+		}
+	}
+
+	int64 Now = time_get();
+	pEntry->m_Key = *pKey;
+	pEntry->m_Verdict = Verdict;
+	pEntry->m_LastUsed = Now;
+	pEntry->m_Expire = Now + time_freq()*g_Config.m_SvProxyCheckTTL;
+}
+
+int CProxyCheck::Check(const NETADDR *pAddr)
+{
+	NETADDR Key;
+	GetKey(pAddr, &Key);
+
+	CCacheEntry *pEntry = FindCache(&Key);
+	if(pEntry)
+		return pEntry->m_Verdict;
+
+	// already being looked up
+	for(int i = 0; i < m_NumPending; i++)
+		if(net_addr_comp(&m_aPending[i], &Key) == 0)
+			return VERDICT_UNKNOWN;
+
+	if(m_NumPending == MAX_QUEUE || !m_pThread)
+	{
+		dbg_msg("antiproxy", "lookup queue full, skipping check");
+		return VERDICT_UNKNOWN;
+	}
+
+	CRequest Request;
+	char aAddrStr[NETADDR_MAXSTRSIZE];
+	net_addr_str(pAddr, aAddrStr, sizeof(aAddrStr), false);
+	Request.m_Addr = Key;
+	Request.m_Timeout = g_Config.m_SvProxyCheckTimeout;
+	if(g_Config.m_SvProxyCheckKey[0])
+		str_format(Request.m_aUrl, sizeof(Request.m_aUrl), "%s%s?key=%s", g_Config.m_SvProxyCheckUrl, aAddrStr, g_Config.m_SvProxyCheckKey);
+	else
+		str_format(Request.m_aUrl, sizeof(Request.m_aUrl), "%s%s", g_Config.m_SvProxyCheckUrl, aAddrStr);
+
+	m_aPending[m_NumPending++] = Key;
+
+	lock_wait(m_Lock);
+	m_aQueue[(m_QueueStart+m_QueueNum)%MAX_QUEUE] = Request;
+	m_QueueNum++;
+	lock_unlock(m_Lock);
+	m_Work.Signal();
+
+	return VERDICT_UNKNOWN;
+}
+
+bool CProxyCheck::PopResult(CResult *pResult)
+{
+	lock_wait(m_Lock);
+	if(!m_NumResults)
+	{
+		lock_unlock(m_Lock);
+		return false;
+	}
+	*pResult = m_aResults[--m_NumResults];
+	lock_unlock(m_Lock);
+
+	for(int i = 0; i < m_NumPending; i++)
+	{
+		if(net_addr_comp(&m_aPending[i], &pResult->m_Addr) == 0)
+		{
+			m_aPending[i] = m_aPending[--m_NumPending];
+			break;
+		}
+	}
+
+	// failed lookups are not cached, the next connect tries again
+	if(pResult->m_Verdict != VERDICT_UNKNOWN)
+		AddCache(&pResult->m_Addr, pResult->m_Verdict);
+	return true;
+}
+
+int CProxyCheck::Query(const CRequest *pRequest)
+{
+	CURL *pCurl = curl_easy_init();
+	if(!pCurl)
+		return VERDICT_UNKNOWN;
+
+	CResponseBuffer Response;
+	Response.m_aData[0] = 0;
+	Response.m_Size = 0;
+	curl_easy_setopt(pCurl, CURLOPT_URL, pRequest->m_aUrl);
+	curl_easy_setopt(pCurl, CURLOPT_WRITEFUNCTION, WriteCallback);
+	curl_easy_setopt(pCurl, CURLOPT_WRITEDATA, &Response);
+	curl_easy_setopt(pCurl, CURLOPT_TIMEOUT, (long)pRequest->m_Timeout);
+	curl_easy_setopt(pCurl, CURLOPT_NOSIGNAL, 1L);
+
+	CURLcode Res = curl_easy_perform(pCurl);
+	curl_easy_cleanup(pCurl);
+
+	if(Res != CURLE_OK || !str_find_nocase(Response.m_aData, "\"status\":\"ok\""))
+		return VERDICT_UNKNOWN;
+
+	return str_find_nocase(Response.m_aData, "\"proxy\":\"yes\"") ? VERDICT_PROXY : VERDICT_CLEAN;
+}
+
+void CProxyCheck::LookupThread(void *pUser)
+{
+	CProxyCheck *pThis = (CProxyCheck *)pUser;
+
+	while(1)
+	{
+		pThis->m_Work.Wait();
+		if(pThis->m_Shutdown)
+			break;
+
+		CRequest Request;
+		lock_wait(pThis->m_Lock);
+		if(!pThis->m_QueueNum)
+		{
+			lock_unlock(pThis->m_Lock);
+			continue;
+		}
+		Request = pThis->m_aQueue[pThis->m_QueueStart];
+		pThis->m_QueueStart = (pThis->m_QueueStart+1)%MAX_QUEUE;
+		pThis->m_QueueNum--;
+		lock_unlock(pThis->m_Lock);
+
+		CResult Result;
+		Result.m_Addr = Request.m_Addr;
+		Result.m_Verdict = Query(&Request);
+
+		// results never outnumber the pending lookups, so this can't overflow
+		lock_wait(pThis->m_Lock);
+		pThis->m_aResults[pThis->m_NumResults++] = Result;
+		lock_unlock(pThis->m_Lock);
+	}
+}
@@ -0,0 +1,118 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SERVER_PROXYCHECK_H
+#define ENGINE_SERVER_PROXYCHECK_H
+
+#include <base/system.h>
+#include <base/tl/threading.h>
+
+#include <atomic>
+
+/*
+	Class: Proxy check
+		Looks up whether an address belongs to a proxy/VPN on a
+		background thread. Verdicts are cached per address (per /64
+		for IPv6) for a limited time. Everything but the lookup
+		itself runs on the main thread.
+*/
+class CProxyCheck
+{
+public:
+	enum
+	{
+		VERDICT_UNKNOWN=-1,
+		VERDICT_CLEAN=0,
+		VERDICT_PROXY,
+	};
+
+	class CResult
+	{
+	public:
+		NETADDR m_Addr;
+		int m_Verdict;
+	};
+
+private:
+	enum
+	{
+		MAX_QUEUE=64,
+		MAX_CACHE=1024,
+		MAX_URL_LENGTH=256,
+	};
+
+	class CRequest
+	{
+	public:
+		NETADDR m_Addr;
+		char m_aUrl[MAX_URL_LENGTH];
+		int m_Timeout;
+	};
+
+	class CCacheEntry
+	{
+	public:
+		NETADDR m_Key;
+		int m_Verdict;
+		int64 m_Expire;
+		int64 m_LastUsed;
+	};
+
+	// main thread only
+	CCacheEntry m_aCache[MAX_CACHE];
+	int m_NumCache;
+	NETADDR m_aPending[MAX_QUEUE];
+	int m_NumPending;
+
+	// shared with the lookup thread, guarded by m_Lock
+	LOCK m_Lock;
+	CRequest m_aQueue[MAX_QUEUE];
+	int m_QueueStart;
+	int m_QueueNum;
+	CResult m_aResults[MAX_QUEUE];
+	int m_NumResults;
+
+	CSemaphore m_Work;
+	std::atomic_bool m_Shutdown;
+	void *m_pThread;
+
+	static void LookupThread(void *pUser);
+	static int Query(const CRequest *pRequest);
+	static void GetKey(const NETADDR *pAddr, NETADDR *pKey);
+
+	CCacheEntry *FindCache(const NETADDR *pKey);
+	void AddCache(const NETADDR *pKey, int Verdict);
+
+public:
+	CProxyCheck();
+	~CProxyCheck();
+
+	void Init();
+
+	/*
+		Function: Check
+			Returns the cached verdict for the address. On a cache miss
+			a lookup is queued and VERDICT_UNKNOWN is returned, the
+			verdict is handed out later by PopResult.
+	*/
+	int Check(const NETADDR *pAddr);
+
+	/*
+		Function: PopResult
+			Fetches a finished lookup and stores it in the cache.
+
+		Returns:
+			False if no lookup has finished.
+	*/
+	bool PopResult(CResult *pResult);
+
+	/*
+		Function: SameKey
+			Returns true if both addresses share one cache entry.
+	*/
+	static bool SameKey(const NETADDR *pAddr1, const NETADDR *pAddr2);
+
+	int NumPending() const { return m_NumPending; }
+	int NumCached() const { return m_NumCache; }
+};
+
+#endif
@@ -30,7 +30,6 @@
 #include "register.h"
 #include "server.h"
 
-#include "curl/curl.h"
 #include <cstring>
 
 #if defined(CONF_FAMILY_WINDOWS)
@@ -63,8 +62,6 @@ static void StrRtrim(char *pStr)
 }
 
 sMap::~sMap() {
-	if (m_pCurrentMapData)
-		mem_free(m_pCurrentMapData);
 	if (m_pMap) {
 		delete m_pMap;
 	}
@@ -291,10 +288,14 @@ void CServerBan::ConBanExt(IConsole::IResult *pResult, void *pUser)
 void CServer::CClient::Reset()
 {
 	// reset input
-	for(int i = 0; i < 200; i++)
+	for(int i = 0; i < INPUT_RING_SIZE; i++)
 		m_aInputs[i].m_GameTick = -1;
-	m_CurrentInput = 0;
 	mem_zero(&m_LatestInput, sizeof(m_LatestInput));
+	m_NumInputsApplied = 0;
+	m_NumInputsMissing = 0;
+	m_NumInputsLate = 0;
+	m_NumInputsEarly = 0;
+	m_NumInputsDuplicate = 0;
 
 	m_Snapshots.PurgeAll();
 	m_LastAckedSnapshot = -1;
@@ -305,12 +306,69 @@ void CServer::CClient::Reset()
 	m_UnknownFlags = 0;
 }
 
-CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
+// set on game threads, engine calls made from there are queued for the main thread
+static thread_local CGameThread *s_pCurrentGameThread = 0;
+
+CGameThread::CGameThread(CServer *pServer, sGame *pGame)
+{
+	m_pServer = pServer;
+	m_pGame = pGame;
+	m_pThread = 0;
+	m_Phase = PHASE_TICK;
+	m_Shutdown = false;
+	m_PhaseTime = 0;
+}
+
+void CGameThread::QueueMsg(CMsgPacker *pMsg, int Flags, int ClientID, bool System)
+{
+	CQueuedMsg Msg;
+	Msg.m_ClientID = ClientID;
+	Msg.m_Flags = Flags;
+	Msg.m_System = System;
+	Msg.m_Offset = m_MsgData.size();
+	Msg.m_Size = pMsg->Size();
+	m_MsgData.insert(m_MsgData.end(), pMsg->Data(), pMsg->Data()+pMsg->Size());
+	m_lMsgs.push_back(Msg);
+}
+
+void CGameThread::QueueAction(int Type, int ClientID, unsigned int GameID, int Param, const char *pStr, const NETADDR *pAddr)
+{
+	CAction Action;
+	mem_zero(&Action, sizeof(Action));
+	Action.m_Type = Type;
+	Action.m_ClientID = ClientID;
+	Action.m_GameID = GameID;
+	Action.m_Param = Param;
+	if(pStr)
+		str_copy(Action.m_aStr, pStr, sizeof(Action.m_aStr));
+	if(pAddr)
+		Action.m_Addr = *pAddr;
+	m_lActions.push_back(Action);
+}
+
+CServer::CServer()
 {
 	m_TickSpeed = SERVER_TICK_SPEED;
 
-	m_pGames = new sGame;
-	m_pMaps = NULL;
+	for(int i = 0; i < MAX_GAMES; i++)
+	{
+		m_aGameSlots[i] = -1;
+		m_apGameMaps[i] = 0;
+		m_apStoredMaps[i] = 0;
+		m_apPendingMaps[i] = 0;
+		m_apPendingConfigs[i] = 0;
+		m_aNumGameClients[i] = 0;
+	}
+	m_NumStoredMaps = 0;
+	m_NumFreeGameIDs = 0;
+	for(int i = MAX_GAMES-1; i > 0; i--)
+		m_aFreeGameIDs[m_NumFreeGameIDs++] = i;
+
+	// the main game always has id 0
+	m_apGames[0] = new sGame;
+	m_apGames[0]->m_uiGameID = 0;
+	m_aGameSlots[0] = 0;
+	m_NumGames = 1;
 
 	m_CurrentGameTick = 0;
 	m_RunServer = 1;
@@ -318,17 +376,36 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 
 	m_pCurrentMapData = 0;
 	m_CurrentMapSize = 0;
+	m_CurrentGameID = GAME_ID_INVALID;
+	m_DbEnabled = false;
+
+	m_ServerInfoDirty = true;
+	m_NumServerInfo64Chunks = 0;
 
 	m_MapReload = 0;
+	m_MapChange = 0;
+	m_pNetWait = 0;
 
 	m_RconClientID = IServer::RCON_CID_SERV;
 	m_RconAuthLevel = AUTHED_ADMIN;
 	
 	m_PlayerCount = 0;
 
+	m_pSnapJobs = 0;
+	m_NumSnapJobs = 0;
+	m_NumDeltasReused = 0;
+	m_NextSnapJob = 0;
+	m_SnapWorkShutdown = false;
+
 	Init();
 }
 
+CServer::~CServer()
+{
+	// the game server of the main game belongs to the kernel
+	delete m_apGames[0];
+}
+
 
 int CServer::TrySetClientName(int ClientID, const char *pName)
 {
@@ -361,6 +438,7 @@ int CServer::TrySetClientName(int ClientID, const char *pName)
 
 	// set the client name
 	str_copy(m_aClients[ClientID].m_aName, pName, MAX_NAME_LENGTH);
+	m_ServerInfoDirty = true;
 	return 0;
 }
 
@@ -403,7 +481,10 @@ void CServer::SetClientClan(int ClientID, const char *pClan)
 	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State < CClient::STATE_READY || !pClan)
 		return;
 
+	if(str_comp_num(m_aClients[ClientID].m_aClan, pClan, MAX_CLAN_LENGTH-1) == 0)
+		return;
 	str_copy(m_aClients[ClientID].m_aClan, pClan, MAX_CLAN_LENGTH);
+	m_ServerInfoDirty = true;
 }
 
 void CServer::SetClientCountry(int ClientID, int Country)
@@ -411,14 +492,20 @@ void CServer::SetClientCountry(int ClientID, int Country)
 	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State < CClient::STATE_READY)
 		return;
 
+	if(m_aClients[ClientID].m_Country == Country)
+		return;
 	m_aClients[ClientID].m_Country = Country;
+	m_ServerInfoDirty = true;
 }
 
 void CServer::SetClientScore(int ClientID, int Score)
 {
 	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State < CClient::STATE_READY)
 		return;
+	if(m_aClients[ClientID].m_Score == Score)
+		return;
 	m_aClients[ClientID].m_Score = Score;
+	m_ServerInfoDirty = true;
 }
 
 void CServer::SetClientVersion(int ClientID, int Version)
@@ -453,6 +540,12 @@ void CServer::Kick(int ClientID, const char *pReason)
  		return;
 	}
 
+	if(s_pCurrentGameThread)
+	{
+		s_pCurrentGameThread->QueueAction(CGameThread::ACTION_KICK, ClientID, 0, 0, pReason);
+		return;
+	}
+
 	m_NetServer.Drop(ClientID, pReason);
 }
 
@@ -464,9 +557,26 @@ void CServer::KickForce(int ClientID, const char *pReason)
 		return;
 	}
 
+	if(s_pCurrentGameThread)
+	{
+		s_pCurrentGameThread->QueueAction(CGameThread::ACTION_KICK, ClientID, 0, 0, pReason);
+		return;
+	}
+
 	m_NetServer.Drop(ClientID, pReason);
 }
 
+int CServer::BanAddr(const NETADDR *pAddr, int Seconds, const char *pReason, bool Force)
+{
+	if(s_pCurrentGameThread)
+	{
+		s_pCurrentGameThread->QueueAction(CGameThread::ACTION_BAN, -1, 0, Seconds, pReason, pAddr);
+		return 0;
+	}
+
+	return m_ServerBan.BanAddr(pAddr, Seconds, pReason, Force);
+}
+
 /*int CServer::Tick()
 {
 	return m_CurrentGameTick;
@@ -490,11 +600,12 @@ int CServer::Init()
 		m_aClients[i].m_aName[0] = 0;
 		m_aClients[i].m_aClan[0] = 0;
 		m_aClients[i].m_Country = -1;
-		m_aClients[i].m_Snapshots.Init();
+		m_aClients[i].m_Snapshots.Init(&m_SnapshotPool);
 		m_aClients[i].m_Traffic = 0;
 		m_aClients[i].m_TrafficSince = 0;
 		m_aClients[i].m_PreferedTeam = -2;
 		m_aClients[i].m_uiGameID = GAME_ID_INVALID;
+		m_aClients[i].m_GameClientSlot = -1;
 	}
 
 	m_CurrentGameTick = 0;
@@ -585,6 +696,12 @@ int CServer::SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System)
 	if(!pMsg)
 		return -1;
 
+	if(s_pCurrentGameThread)
+	{
+		s_pCurrentGameThread->QueueMsg(pMsg, Flags, ClientID, System);
+		return 0;
+	}
+
 	mem_zero(&Packet, sizeof(CNetChunk));
 
 	Packet.m_ClientID = ClientID;
@@ -601,9 +718,13 @@ int CServer::SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System)
 	if(Flags&MSGFLAG_FLUSH)
 		Packet.m_Flags |= NETSENDFLAG_FLUSH;
 
-	// write message to demo recorder
+	// write message to the demo of the game it's sent in
 	if(!(Flags&MSGFLAG_NORECORD))
-		m_DemoRecorder.RecordMessage(pMsg->Data(), pMsg->Size());
+	{
+		unsigned int GameID = ClientID >= 0 && ClientID < MAX_CLIENTS ? m_aClients[ClientID].m_uiGameID : m_CurrentGameID;
+		if(GameID < CDemoWriter::MAX_GAMES && m_DemoWriter.IsRecording(GameID))
+			m_DemoWriter.RecordMessage(GameID, pMsg->Data(), pMsg->Size());
+	}
 
 	if(!(Flags&MSGFLAG_NOSEND))
 	{
@@ -624,28 +745,319 @@ int CServer::SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System)
 	return 0;
 }
 
+void CServer::GameThread(void *pUser)
+{
+	CGameThread *pThread = (CGameThread *)pUser;
+	CServer *pThis = pThread->m_pServer;
+	s_pCurrentGameThread = pThread;
+
+	while(1)
+	{
+		pThread->m_Start.Wait();
+		if(pThread->m_Shutdown)
+			break;
+
+		IGameServer *pGameServer = pThread->m_pGame->GameServer();
+		int64 Start = time_get();
+		if(pThread->m_Phase == CGameThread::PHASE_TICK)
+		{
+			for(unsigned i = 0; i < pThread->m_lInputs.size(); i++)
+				pGameServer->OnClientPredictedInput(pThread->m_lInputs[i].m_ClientID, pThread->m_lInputs[i].m_aData);
+			pThread->m_lInputs.clear();
+			pGameServer->OnTick();
+		}
+		else if(pThread->m_Phase == CGameThread::PHASE_PRESNAP)
+			pGameServer->OnPreSnap();
+		pThread->m_PhaseTime = time_get()-Start;
+
+		pThis->m_GameThreadsDone.Signal();
+	}
+}
+
+CGameThread *CServer::GetGameThread(sGame *pGame)
+{
+	if(!pGame->m_pGameThread)
+	{
+		CGameThread *pThread = new CGameThread(this, pGame);
+		pThread->m_pThread = thread_init(GameThread, pThread);
+		pGame->m_pGameThread = pThread;
+	}
+	return pGame->m_pGameThread;
+}
+
+void CServer::StopGameThread(sGame *pGame)
+{
+	CGameThread *pThread = pGame->m_pGameThread;
+	if(!pThread)
+		return;
+
+	pThread->m_Shutdown = true;
+	pThread->m_Start.Signal();
+	thread_wait(pThread->m_pThread);
+	pGame->m_pGameThread = 0;
+	delete pThread;
+}
+
+void CServer::RunGameAction(const CGameThread::CAction *pAction)
+{
+	switch(pAction->m_Type)
+	{
+	case CGameThread::ACTION_KICK: KickForce(pAction->m_ClientID, pAction->m_aStr); break;
+	case CGameThread::ACTION_BAN: m_ServerBan.BanAddr(&pAction->m_Addr, pAction->m_Param, pAction->m_aStr, true); break;
+	case CGameThread::ACTION_STOPGAME: StopGameServer(pAction->m_GameID, pAction->m_Param); break;
+	case CGameThread::ACTION_MOVEPLAYER: MovePlayerToGameServer(pAction->m_ClientID, pAction->m_GameID); break;
+	case CGameThread::ACTION_CHANGEMAP: ChangeGameServerMap(pAction->m_GameID, pAction->m_aStr); break;
+	case CGameThread::ACTION_KICKCONNECTING: KickConnectingPlayers(pAction->m_GameID, pAction->m_aStr); break;
+	case CGameThread::ACTION_AUTODEMO: AutoStartDemo(pAction->m_GameID); break;
+	case CGameThread::ACTION_STARTGAME: StartGameServer(pAction->m_aStr, pAction->m_pConfig); break;
+	}
+}
+
+void CServer::RunGameThreads(int Phase)
+{
+	int NumThreads = 0;
+	for(int g = 0; g < m_NumGames; g++)
+	{
+		if(IsGameLoading(m_apGames[g]->m_uiGameID))
+			continue;
+
+		CGameThread *pThread = GetGameThread(m_apGames[g]);
+		pThread->m_Phase = Phase;
+		pThread->m_Start.Signal();
+		NumThreads++;
+	}
+
+	for(int i = 0; i < NumThreads; i++)
+		m_GameThreadsDone.Wait();
+
+	if(Phase == CGameThread::PHASE_TICK)
+	{
+		for(int g = 0; g < m_NumGames; g++)
+			if(!IsGameLoading(m_apGames[g]->m_uiGameID) && m_apGames[g]->m_pGameThread)
+				m_Profiler.RecordGame(m_apGames[g]->m_uiGameID, CTickProfiler::GAMEPHASE_TICK, m_apGames[g]->m_pGameThread->m_PhaseTime);
+	}
+
+	// hand out the queued messages in game order, then run the engine
+	// actions, those may start or stop games
+	std::vector<CGameThread::CAction> lActions;
+	for(int g = 0; g < m_NumGames; g++)
+	{
+		CGameThread *pThread = m_apGames[g]->m_pGameThread;
+		if(!pThread)
+			continue;
+
+		m_CurrentGameID = m_apGames[g]->m_uiGameID;
+		for(unsigned i = 0; i < pThread->m_lMsgs.size(); i++)
+		{
+			const CGameThread::CQueuedMsg *pMsg = &pThread->m_lMsgs[i];
+			CMsgPacker Msg(0);
+			Msg.Reset();
+			Msg.AddRaw(&pThread->m_MsgData[pMsg->m_Offset], pMsg->m_Size);
+			SendMsgEx(&Msg, pMsg->m_Flags, pMsg->m_ClientID, pMsg->m_System);
+		}
+		pThread->m_lMsgs.clear();
+		pThread->m_MsgData.clear();
+
+		lActions.insert(lActions.end(), pThread->m_lActions.begin(), pThread->m_lActions.end());
+		pThread->m_lActions.clear();
+	}
+	m_CurrentGameID = GAME_ID_INVALID;
+
+	for(unsigned i = 0; i < lActions.size(); i++)
+		RunGameAction(&lActions[i]);
+}
+
+void CServer::SendSnapshot(int ClientID, int DeltaTick, int Crc, const char *pCompData, int CompSize)
+{
+	if(CompSize)
+	{
+		const int MaxSize = MAX_SNAPSHOT_PACKSIZE;
+		int NumPackets = (CompSize+MaxSize-1)/MaxSize;
+
+		for(int n = 0, Left = CompSize; Left; n++)
+		{
+			int Chunk = Left < MaxSize ? Left : MaxSize;
+			Left -= Chunk;
+
+			if(NumPackets == 1)
+			{
+				CMsgPacker Msg(NETMSG_SNAPSINGLE);
+				Msg.AddInt(m_CurrentGameTick);
+				Msg.AddInt(m_CurrentGameTick-DeltaTick);
+				Msg.AddInt(Crc);
+				Msg.AddInt(Chunk);
+				Msg.AddRaw(&pCompData[n*MaxSize], Chunk);
+				SendMsgEx(&Msg, MSGFLAG_FLUSH, ClientID, true);
+			}
+			else
+			{
+				CMsgPacker Msg(NETMSG_SNAP);
+				Msg.AddInt(m_CurrentGameTick);
+				Msg.AddInt(m_CurrentGameTick-DeltaTick);
+				Msg.AddInt(NumPackets);
+				Msg.AddInt(n);
+				Msg.AddInt(Crc);
+				Msg.AddInt(Chunk);
+				Msg.AddRaw(&pCompData[n*MaxSize], Chunk);
+				SendMsgEx(&Msg, MSGFLAG_FLUSH, ClientID, true);
+			}
+		}
+	}
+	else
+	{
+		CMsgPacker Msg(NETMSG_SNAPEMPTY);
+		Msg.AddInt(m_CurrentGameTick);
+		Msg.AddInt(m_CurrentGameTick-DeltaTick);
+		SendMsgEx(&Msg, MSGFLAG_FLUSH, ClientID, true);
+	}
+}
+
+void CServer::RunSnapJob(CSnapJob *pJob)
+{
+	// create delta and compress it, only touches the job and the client's snapshots
+	if(pJob->m_SourceJob != -1)
+	{
+		// sent with the data of the job with the same snapshots
+		pJob->m_DeltaTime = 0;
+		pJob->m_CompressTime = 0;
+		return;
+	}
+
+	int64 Start = time_get();
+	int DeltaSize = m_SnapshotDelta.CreateDelta(pJob->m_pFrom, pJob->m_pTo, pJob->m_aDeltaData);
+	int64 DeltaEnd = time_get();
+	if(DeltaSize)
+		pJob->m_CompSize = CVariableInt::Compress(pJob->m_aDeltaData, DeltaSize, pJob->m_aCompData);
+	else
+		pJob->m_CompSize = 0;
+	pJob->m_DeltaTime = DeltaEnd-Start;
+	pJob->m_CompressTime = time_get()-DeltaEnd;
+}
+
+void CServer::SnapWorkerThread(void *pUser)
+{
+	CServer *pThis = (CServer *)pUser;
+
+	while(1)
+	{
+		pThis->m_SnapWorkStart.Wait();
+		if(pThis->m_SnapWorkShutdown)
+			break;
+
+		int Job;
+		while((Job = pThis->m_NextSnapJob.fetch_add(1)) < pThis->m_NumSnapJobs)
+			pThis->RunSnapJob(&pThis->m_pSnapJobs[Job]);
+
+		pThis->m_SnapWorkDone.Signal();
+	}
+}
+
+void CServer::ProcessSnapJobs()
+{
+	// start additional workers if the thread count got raised
+	while((int)m_lSnapWorkers.size() < g_Config.m_SvSnapThreads)
+	{
+		void *pThread = thread_init(SnapWorkerThread, this);
+		if(!pThread)
+			break;
+		m_lSnapWorkers.push_back(pThread);
+	}
+
+	int NumWorkers = min(g_Config.m_SvSnapThreads, (int)m_lSnapWorkers.size());
+	NumWorkers = min(NumWorkers, m_NumSnapJobs-1);
+
+	m_NextSnapJob = 0;
+	for(int i = 0; i < NumWorkers; i++)
+		m_SnapWorkStart.Signal();
+
+	// the main thread helps out until the queue is drained
+	int Job;
+	while((Job = m_NextSnapJob.fetch_add(1)) < m_NumSnapJobs)
+		RunSnapJob(&m_pSnapJobs[Job]);
+
+	for(int i = 0; i < NumWorkers; i++)
+		m_SnapWorkDone.Wait();
+}
+
+void CServer::StopSnapWorkers()
+{
+	m_SnapWorkShutdown = true;
+	for(unsigned i = 0; i < m_lSnapWorkers.size(); i++)
+		m_SnapWorkStart.Signal();
+	for(unsigned i = 0; i < m_lSnapWorkers.size(); i++)
+		thread_wait(m_lSnapWorkers[i]);
+	m_lSnapWorkers.clear();
+
+	delete[] m_pSnapJobs;
+	m_pSnapJobs = 0;
+}
+
 void CServer::DoSnapshot()
 {
-	sGame* p = m_pGames;
-	while(p != NULL){	
-		p->GameServer()->OnPreSnap();
-		p = p->m_pNext;
+	// time spent per game, reported to the profiler at the end
+	int64 aGameTime[MAX_GAMES] = {0};
+	int64 BuildTime = 0, DeltaTime = 0, CompressTime = 0, SendTime = 0;
+
+	{
+		CTickProfiler::CScope PresnapScope(&m_Profiler, CTickProfiler::PHASE_SNAP_PRESNAP);
+		if(g_Config.m_SvGameThreads)
+		{
+			RunGameThreads(CGameThread::PHASE_PRESNAP);
+			// games started by the queued actions have no thread yet
+			for(int g = 0; g < m_NumGames; g++)
+				if(m_apGames[g]->m_pGameThread)
+					aGameTime[m_apGames[g]->m_uiGameID] = m_apGames[g]->m_pGameThread->m_PhaseTime;
+		}
+		else
+		{
+			for(int g = 0; g < m_NumGames; g++)
+			{
+				if(IsGameLoading(m_apGames[g]->m_uiGameID))
+					continue;
+				int64 Start = time_get();
+				m_CurrentGameID = m_apGames[g]->m_uiGameID;
+				m_apGames[g]->GameServer()->OnPreSnap();
+				aGameTime[m_apGames[g]->m_uiGameID] = time_get()-Start;
+			}
+			m_CurrentGameID = GAME_ID_INVALID;
+		}
 	}
 
-	// create snapshot for demo recording
-	if(m_DemoRecorder.IsRecording())
+	// create the snapshots of the games that record a demo, the
+	// writer thread makes the deltas and writes them
+	for(int g = 0; g < m_NumGames; g++)
 	{
+		unsigned int GameID = m_apGames[g]->m_uiGameID;
+		if(IsGameLoading(GameID) || !m_DemoWriter.IsRecording(GameID))
+			continue;
+
 		char aData[CSnapshot::MAX_SIZE];
 		int SnapshotSize;
+		int64 Start = time_get();
 
 		// build snap and possibly add some messages
+		m_CurrentGameID = GameID;
 		m_SnapshotBuilder.Init();
-		GameServer()->OnSnap(-1);
+		m_apGames[g]->GameServer()->OnSnap(-1);
 		SnapshotSize = m_SnapshotBuilder.Finish(aData);
 
-		// write snapshot
-		m_DemoRecorder.RecordSnapshot(Tick(), aData, SnapshotSize);
+		m_DemoWriter.RecordSnapshot(GameID, Tick(), aData, SnapshotSize);
+		aGameTime[GameID] += time_get()-Start;
 	}
+	m_CurrentGameID = GAME_ID_INVALID;
+
+	// with snapshot threads the delta and compression stage is queued
+	// and run after all snapshots are built, see ProcessSnapJobs()
+	bool Parallel = g_Config.m_SvSnapThreads > 0;
+	if(Parallel && !m_pSnapJobs)
+		m_pSnapJobs = new CSnapJob[MAX_CLIENTS];
+	m_NumSnapJobs = 0;
+
+	bool Dedup = g_Config.m_SvSnapDedup;
+	m_SnapDeltaCache.Clear();
+
+	static CSnapshot EmptySnap;
+	EmptySnap.Clear();
 
 	// create snapshots for all clients
 	for(int i = 0; i < MAX_CLIENTS; i++)
@@ -665,20 +1077,21 @@ void CServer::DoSnapshot()
 		{
 			char aData[CSnapshot::MAX_SIZE];
 			CSnapshot *pData = (CSnapshot*)aData;	// Fix compiler warning for strict-aliasing
-			char aDeltaData[CSnapshot::MAX_SIZE];
-			char aCompData[CSnapshot::MAX_SIZE];
 			int SnapshotSize;
 			int Crc;
-			static CSnapshot EmptySnap;
 			CSnapshot *pDeltashot = &EmptySnap;
 			int DeltashotSize;
 			int DeltaTick = -1;
-			int DeltaSize;
+			int64 Start = time_get();
 
 			m_SnapshotBuilder.Init();
 
 			sGame* p = GetGame(m_aClients[i].m_uiGameID);
-			if(p != NULL) p->GameServer()->OnSnap(i);
+			if(p != NULL)
+			{
+				p->GameServer()->OnSnap(i);
+				aGameTime[p->m_uiGameID] += time_get()-Start;
+			}
 
 			// finish snapshot
 			SnapshotSize = m_SnapshotBuilder.Finish(pData);
@@ -692,8 +1105,6 @@ void CServer::DoSnapshot()
 			m_aClients[i].m_Snapshots.Add(m_CurrentGameTick, time_get(), SnapshotSize, pData, 0);
 
 			// find snapshot that we can preform delta against
-			EmptySnap.Clear();
-
 			{
 				DeltashotSize = m_aClients[i].m_Snapshots.Get(m_aClients[i].m_LastAckedSnapshot, 0, &pDeltashot, 0);
 				if(DeltashotSize >= 0)
@@ -706,63 +1117,106 @@ void CServer::DoSnapshot()
 				}
 			}
 
-			// create delta
-			DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData);
-
-			if(DeltaSize)
+			// the stored copy stays valid until the next snapshot of this
+			// client. It's shared by all clients with the same view, so
+			// clients that also acked the same view get the same delta
+			CSnapshot *pStored;
+			m_aClients[i].m_Snapshots.Get(m_CurrentGameTick, 0, &pStored, 0);
+			CSnapDeltaCache::CEntry *pCached = 0;
+			if(Dedup)
 			{
-				// compress it
-				int SnapshotSize;
-				const int MaxSize = MAX_SNAPSHOT_PACKSIZE;
-				int NumPackets;
-
-				SnapshotSize = CVariableInt::Compress(aDeltaData, DeltaSize, aCompData);
-				NumPackets = (SnapshotSize+MaxSize-1)/MaxSize;
-
-				for(int n = 0, Left = SnapshotSize; Left; n++)
+				pCached = m_SnapDeltaCache.Find(pDeltashot, pStored);
+				if(pCached)
 				{
-					int Chunk = Left < MaxSize ? Left : MaxSize;
-					Left -= Chunk;
-
-					if(NumPackets == 1)
-					{
-						CMsgPacker Msg(NETMSG_SNAPSINGLE);
-						Msg.AddInt(m_CurrentGameTick);
-						Msg.AddInt(m_CurrentGameTick-DeltaTick);
-						Msg.AddInt(Crc);
-						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n*MaxSize], Chunk);
-						SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
-					}
-					else
+					m_NumDeltasReused++;
+					if(!Parallel)
 					{
-						CMsgPacker Msg(NETMSG_SNAP);
-						Msg.AddInt(m_CurrentGameTick);
-						Msg.AddInt(m_CurrentGameTick-DeltaTick);
-						Msg.AddInt(NumPackets);
-						Msg.AddInt(n);
-						Msg.AddInt(Crc);
-						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n*MaxSize], Chunk);
-						SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
+						int64 SendStart = time_get();
+						BuildTime += SendStart-Start;
+						SendSnapshot(i, DeltaTick, Crc, m_SnapDeltaCache.Data(pCached), pCached->m_DataSize);
+						SendTime += time_get()-SendStart;
+						continue;
 					}
 				}
+				else
+					pCached = m_SnapDeltaCache.Add(pDeltashot, pStored);
 			}
-			else
+
+			if(Parallel)
 			{
-				CMsgPacker Msg(NETMSG_SNAPEMPTY);
-				Msg.AddInt(m_CurrentGameTick);
-				Msg.AddInt(m_CurrentGameTick-DeltaTick);
-				SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
+				CSnapJob *pJob = &m_pSnapJobs[m_NumSnapJobs];
+				pJob->m_ClientID = i;
+				pJob->m_Crc = Crc;
+				pJob->m_DeltaTick = DeltaTick;
+				pJob->m_pFrom = pDeltashot;
+				pJob->m_pTo = pStored;
+				pJob->m_SourceJob = -1;
+				if(pCached && pCached->m_Job != -1)
+					pJob->m_SourceJob = pCached->m_Job;
+				else if(pCached)
+					pCached->m_Job = m_NumSnapJobs;
+				m_NumSnapJobs++;
+				BuildTime += time_get()-Start;
+				continue;
 			}
+
+			// create delta and compress it
+			char aDeltaData[CSnapshot::MAX_SIZE];
+			char aCompData[CSnapshot::MAX_SIZE];
+			int CompSize = 0;
+			int64 DeltaStart = time_get();
+			BuildTime += DeltaStart-Start;
+			int DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData);
+			int64 CompressStart = time_get();
+			DeltaTime += CompressStart-DeltaStart;
+			if(DeltaSize)
+				CompSize = CVariableInt::Compress(aDeltaData, DeltaSize, aCompData);
+			if(pCached)
+				m_SnapDeltaCache.SetData(pCached, aCompData, CompSize);
+			int64 SendStart = time_get();
+			CompressTime += SendStart-CompressStart;
+
+			SendSnapshot(i, DeltaTick, Crc, aCompData, CompSize);
+			SendTime += time_get()-SendStart;
+		}
+	}
+
+	if(m_NumSnapJobs)
+	{
+		ProcessSnapJobs();
+
+		// send in client order, exactly like the serial path. The delta
+		// and compression times are summed up over all snapshot threads
+		int64 SendStart = time_get();
+		for(int j = 0; j < m_NumSnapJobs; j++)
+		{
+			CSnapJob *pJob = &m_pSnapJobs[j];
+			const CSnapJob *pData = pJob->m_SourceJob != -1 ? &m_pSnapJobs[pJob->m_SourceJob] : pJob;
+			SendSnapshot(pJob->m_ClientID, pJob->m_DeltaTick, pJob->m_Crc, pData->m_aCompData, pData->m_CompSize);
+			DeltaTime += pJob->m_DeltaTime;
+			CompressTime += pJob->m_CompressTime;
 		}
+		SendTime += time_get()-SendStart;
+		m_NumSnapJobs = 0;
 	}
 
-	p = m_pGames;
-	while(p != NULL){
-		p->GameServer()->OnPostSnap();
-		p = p->m_pNext;
+	m_Profiler.Record(CTickProfiler::PHASE_SNAP_BUILD, BuildTime);
+	m_Profiler.Record(CTickProfiler::PHASE_SNAP_DELTA, DeltaTime);
+	m_Profiler.Record(CTickProfiler::PHASE_SNAP_COMPRESS, CompressTime);
+	m_Profiler.Record(CTickProfiler::PHASE_SNAP_SEND, SendTime);
+
+	CTickProfiler::CScope PostsnapScope(&m_Profiler, CTickProfiler::PHASE_SNAP_POSTSNAP);
+	for(int g = 0; g < m_NumGames; g++)
+	{
+		if(IsGameLoading(m_apGames[g]->m_uiGameID))
+			continue;
+		int64 Start = time_get();
+		m_CurrentGameID = m_apGames[g]->m_uiGameID;
+		m_apGames[g]->GameServer()->OnPostSnap();
+		aGameTime[m_apGames[g]->m_uiGameID] += time_get()-Start;
+		m_Profiler.RecordGame(m_apGames[g]->m_uiGameID, CTickProfiler::GAMEPHASE_SNAP, aGameTime[m_apGames[g]->m_uiGameID]);
 	}
+	m_CurrentGameID = GAME_ID_INVALID;
 }
 
 int CServer::NewClientCallbackImpl(int ClientID, void *pUser)
@@ -773,15 +1227,18 @@ int CServer::NewClientCallbackImpl(int ClientID, void *pUser)
 	pThis->m_aClients[ClientID].m_Country = -1;
 	pThis->m_aClients[ClientID].m_Authed = AUTHED_NO;
 	pThis->m_aClients[ClientID].m_AuthTries = 0;
-	pThis->m_aClients[ClientID].m_uiGameID = GAME_ID_INVALID;
+	pThis->SetClientGame(ClientID, GAME_ID_INVALID);
 	pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
 	pThis->m_aClients[ClientID].m_Traffic = 0;
 	pThis->m_aClients[ClientID].m_TrafficSince = 0;
 	pThis->m_aClients[ClientID].m_PreferedTeam = -2;
+	pThis->m_aClients[ClientID].m_ProxyDetected = false;
 	pThis->m_aClients[ClientID].Reset();
 
 	++pThis->m_PlayerCount;
 
+	pThis->CheckProxy(ClientID);
+
 	return 0;
 }
 
@@ -813,8 +1270,11 @@ int CServer::DelClientCallback(int ClientID, const char *pReason, void *pUser, b
 	// notify the mod about the drop, if the mod says, that the connection can't be free'd, we don't drop the connection
 	if(pThis->m_aClients[ClientID].m_State >= CClient::STATE_READY) {
 		sGame* p = pThis->GetGame(pThis->m_aClients[ClientID].m_uiGameID);
-		if(p != NULL) 
+		if(p != NULL)
+		{
+			CGameScope Scope(pThis, p->m_uiGameID);
 			CanDrop = p->GameServer()->OnClientDrop(ClientID, pReason, ForceDisconnect);
+		}
 		
 	}
 
@@ -826,12 +1286,13 @@ int CServer::DelClientCallback(int ClientID, const char *pReason, void *pUser, b
 		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBuf);
 
 		pThis->m_aClients[ClientID].m_State = CClient::STATE_EMPTY;
+		pThis->m_ServerInfoDirty = true;
 		pThis->m_aClients[ClientID].m_aName[0] = 0;
 		pThis->m_aClients[ClientID].m_aClan[0] = 0;
 		pThis->m_aClients[ClientID].m_Country = -1;
 		pThis->m_aClients[ClientID].m_Authed = AUTHED_NO;
 		pThis->m_aClients[ClientID].m_AuthTries = 0;
-		pThis->m_aClients[ClientID].m_uiGameID = GAME_ID_INVALID;
+		pThis->SetClientGame(ClientID, GAME_ID_INVALID);
 		pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
 		pThis->m_aClients[ClientID].m_Traffic = 0;
 		pThis->m_aClients[ClientID].m_TrafficSince = 0;
@@ -842,24 +1303,70 @@ int CServer::DelClientCallback(int ClientID, const char *pReason, void *pUser, b
 	else
 		return -1;
 
-	// Check if connection is from a proxy
-	if(g_Config.m_SvProxyCheck)
+	return 0;
+}
+
+void CServer::CheckProxy(int ClientID)
+{
+	if(!g_Config.m_SvProxyCheck)
+		return;
+
+	// cached proxies get dropped with the next UpdateProxyCheck, the rest
+	// is looked up in the background
+	if(m_ProxyCheck.Check(m_NetServer.ClientAddr(ClientID)) == CProxyCheck::VERDICT_PROXY)
+		m_aClients[ClientID].m_ProxyDetected = true;
+}
+
+void CServer::UpdateProxyCheck()
+{
+	char aAddrStr[NETADDR_MAXSTRSIZE];
+	char aBuf[256];
+	CProxyCheck::CResult Result;
+	while(m_ProxyCheck.PopResult(&Result))
 	{
-		const NETADDR *pAddr = pThis->m_NetServer.ClientAddr(ClientID);
+		net_addr_str(&Result.m_Addr, aAddrStr, sizeof(aAddrStr), false);
+		if(Result.m_Verdict == CProxyCheck::VERDICT_UNKNOWN)
+		{
+			str_format(aBuf, sizeof(aBuf), "Lookup failed: %s", aAddrStr);
+			Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "antiproxy", aBuf);
+			continue;
+		}
+
+		str_format(aBuf, sizeof(aBuf), "%s: %s", Result.m_Verdict == CProxyCheck::VERDICT_PROXY ? "Proxy detected" : "No proxy detected", aAddrStr);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "antiproxy", aBuf);
 
-		if(pAddr)
+		if(Result.m_Verdict != CProxyCheck::VERDICT_PROXY)
+			continue;
+
+		for(int i = 0; i < MAX_CLIENTS; i++)
 		{
-			if(pThis->IsProxy(pAddr))
-			{
-				char aBuf[128];
-				str_format(aBuf, sizeof(aBuf), "Proxy connections are not allowed");
-				pThis->m_NetServer.Drop(ClientID, aBuf);
-				return 0;
-			}
+			if(m_aClients[i].m_State != CClient::STATE_EMPTY && CProxyCheck::SameKey(m_NetServer.ClientAddr(i), &Result.m_Addr))
+				m_aClients[i].m_ProxyDetected = true;
 		}
 	}
 
-	return 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(!m_aClients[i].m_ProxyDetected)
+			continue;
+		m_aClients[i].m_ProxyDetected = false;
+		if(m_aClients[i].m_State == CClient::STATE_EMPTY)
+			continue;
+
+		if(g_Config.m_SvProxyCheckBan)
+		{
+			NETADDR Addr = *m_NetServer.ClientAddr(i);
+			net_addr_str(&Addr, aAddrStr, sizeof(aAddrStr), false);
+			m_NetServer.NetBan()->BanAddr(&Addr, -1, "Proxy/VPN detected");
+
+			str_format(aBuf, sizeof(aBuf), "Banned proxy: %s", aAddrStr);
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "antiproxy", aBuf);
+		}
+
+		// the ban may already have dropped the client
+		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
+			m_NetServer.Drop(i, "Proxy connections are not allowed");
+	}
 }
 
 static int lastsent[MAX_CLIENTS];
@@ -884,11 +1391,7 @@ void CServer::SendMap(int ClientID, unsigned int pGameID)
 		SendMap(ClientID);
 	}
 	else {
-		sMap* map = m_pMaps;
-		while (map) {
-			if (map->m_uiGameID == pGameID) break;
-			map = map->m_pNextMap;
-		}
+		sMap* map = GetGameMap(pGameID);
 		if (!map) return;
 		
 		lastsent[ClientID] = 0;
@@ -1076,13 +1579,7 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 					Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
 				}				
 			} else {
-				sMap* mapToDownload = m_pMaps;
-				while(mapToDownload){
-					if(mapToDownload->m_uiGameID == m_aClients[ClientID].m_uiGameID){
-						break;
-					}
-					mapToDownload = mapToDownload->m_pNextMap;
-				}
+				sMap* mapToDownload = GetGameMap(m_aClients[ClientID].m_uiGameID);
 				
 				if(mapToDownload){
 					int Chunk = Unpacker.GetInt();
@@ -1132,7 +1629,8 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 		}
 		else if(Msg == NETMSG_READY)
 		{
-			if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && m_aClients[ClientID].m_State == CClient::STATE_CONNECTING)
+			if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && m_aClients[ClientID].m_State == CClient::STATE_CONNECTING &&
+				!IsGameLoading(m_aClients[ClientID].m_uiGameID))
 			{
 				char aAddrStr[NETADDR_MAXSTRSIZE];
 				net_addr_str(m_NetServer.ClientAddr(ClientID), aAddrStr, sizeof(aAddrStr), true);
@@ -1141,13 +1639,19 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 				str_format(aBuf, sizeof(aBuf), "player is ready. ClientID=%x addr=%s", ClientID, aAddrStr);
 				Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBuf);
 				m_aClients[ClientID].m_State = CClient::STATE_READY;
+				m_ServerInfoDirty = true;
 				if(m_aClients[ClientID].m_uiGameID == GAME_ID_INVALID) {
+					CGameScope Scope(this, m_apGames[0]->m_uiGameID);
 					GameServer()->OnClientConnected(ClientID, m_aClients[ClientID].m_PreferedTeam);
-					m_aClients[ClientID].m_uiGameID = 0;
+					SetClientGame(ClientID, 0);
 				}
 				else {		
 					sGame* p = GetGame(m_aClients[ClientID].m_uiGameID);
-					if(p != NULL) p->GameServer()->OnClientConnected(ClientID, m_aClients[ClientID].m_PreferedTeam);					
+					if(p != NULL)
+					{
+						CGameScope Scope(this, p->m_uiGameID);
+						p->GameServer()->OnClientConnected(ClientID, m_aClients[ClientID].m_PreferedTeam);
+					}
 				}
 				SendConnectionReady(ClientID);
 			}
@@ -1167,10 +1671,15 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 					char aBuf[256];
 					str_format(aBuf, sizeof(aBuf), "player has entered the game. ClientID=%x addr=%s", ClientID, aAddrStr);
 					Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-					m_aClients[ClientID].m_State = CClient::STATE_INGAME;					
+					m_aClients[ClientID].m_State = CClient::STATE_INGAME;
+					m_ServerInfoDirty = true;
 				
 					sGame* p = GetGame(m_aClients[ClientID].m_uiGameID);
-					if(p != NULL) p->GameServer()->OnClientEnter(ClientID);
+					if(p != NULL)
+					{
+						CGameScope Scope(this, p->m_uiGameID);
+						p->GameServer()->OnClientEnter(ClientID);
+					}
 				}
 			}
 		}
@@ -1207,25 +1716,37 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 
 			m_aClients[ClientID].m_LastInputTick = IntendedTick;
 
-			pInput = &m_aClients[ClientID].m_aInputs[m_aClients[ClientID].m_CurrentInput];
-
-			if(IntendedTick <= Tick())
-				IntendedTick = Tick()+1;
-
-			pInput->m_GameTick = IntendedTick;
-
+			pInput = &m_aClients[ClientID].m_LatestInput;
 			for(int i = 0; i < Size/4; i++)
 				pInput->m_aData[i] = Unpacker.GetInt();
 
-			mem_copy(m_aClients[ClientID].m_LatestInput.m_aData, pInput->m_aData, MAX_INPUT_SIZE*sizeof(int));
+			bool Late = IntendedTick <= Tick();
+			if(Late)
+			{
+				m_aClients[ClientID].m_NumInputsLate++;
+				IntendedTick = Tick()+1;
+			}
+			pInput->m_GameTick = IntendedTick;
 
-			m_aClients[ClientID].m_CurrentInput++;
-			m_aClients[ClientID].m_CurrentInput %= 200;
+			// the slot still belongs to a nearer tick
+			if(IntendedTick > Tick()+CClient::INPUT_RING_SIZE)
+				m_aClients[ClientID].m_NumInputsEarly++;
+			else
+			{
+				CClient::CInput *pSlot = &m_aClients[ClientID].m_aInputs[IntendedTick%CClient::INPUT_RING_SIZE];
+				if(!Late && pSlot->m_GameTick == IntendedTick)
+					m_aClients[ClientID].m_NumInputsDuplicate++;
+				mem_copy(pSlot, pInput, sizeof(*pSlot));
+			}
 
 			// call the mod with the fresh input data
 			if(m_aClients[ClientID].m_State == CClient::STATE_INGAME) {		
 				sGame* p = GetGame(m_aClients[ClientID].m_uiGameID);
-				if(p != NULL) p->GameServer()->OnClientDirectInput(ClientID, m_aClients[ClientID].m_LatestInput.m_aData);
+				if(p != NULL)
+				{
+					CGameScope Scope(this, p->m_uiGameID);
+					p->GameServer()->OnClientDirectInput(ClientID, m_aClients[ClientID].m_LatestInput.m_aData);
+				}
 			}
 		}
 		else if(Msg == NETMSG_RCON_CMD)
@@ -1240,7 +1761,11 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 				m_RconClientID = ClientID;
 				m_RconAuthLevel = m_aClients[ClientID].m_Authed;
 				Console()->SetAccessLevel(m_aClients[ClientID].m_Authed == AUTHED_ADMIN ? IConsole::ACCESS_LEVEL_ADMIN : IConsole::ACCESS_LEVEL_MOD);
-				Console()->ExecuteLineFlag(pCmd, CFGFLAG_SERVER);
+				{
+					// the game commands are the main game's
+					CGameScope Scope(this, m_apGames[0]->m_uiGameID);
+					Console()->ExecuteLineFlag(pCmd, CFGFLAG_SERVER);
+				}
 				Console()->SetAccessLevel(IConsole::ACCESS_LEVEL_ADMIN);
 				m_RconClientID = IServer::RCON_CID_SERV;
 				m_RconAuthLevel = AUTHED_ADMIN;
@@ -1342,15 +1867,19 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 		// game message
 		if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && m_aClients[ClientID].m_State >= CClient::STATE_READY){
 			sGame* p = GetGame(m_aClients[ClientID].m_uiGameID);
-			if(p != NULL) p->GameServer()->OnMessage(Msg, &Unpacker, ClientID);
+			if(p != NULL)
+			{
+				m_CurrentGameID = p->m_uiGameID;
+				p->GameServer()->OnMessage(Msg, &Unpacker, ClientID);
+				m_CurrentGameID = GAME_ID_INVALID;
+			}
 		}
 	}
 }
 
-void CServer::SendServerInfo(const NETADDR *pAddr, int Token, bool Extended)
+int CServer::PackServerInfo(CPacker *pPacker, bool Extended, int Offset)
 {
-	CNetChunk Packet;
-	CPacker p;
+	CPacker &p = *pPacker;
 	char aBuf[128];
 
 	// count the players
@@ -1373,12 +1902,6 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, bool Extended)
 
 	int MaxClients = m_NetServer.MaxClients();
 
-	if(Extended) p.AddRaw(SERVERBROWSE_INFO64, sizeof(SERVERBROWSE_INFO64));
-	else p.AddRaw(SERVERBROWSE_INFO, sizeof(SERVERBROWSE_INFO));
-
-	str_format(aBuf, sizeof(aBuf), "%d", Token);
-	p.AddString(aBuf, 6);
-
 	p.AddString(GameServer()->Version(), 32); 
 	//ddnet code
 	if (Extended)
@@ -1447,7 +1970,7 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, bool Extended)
 
 	//ddnet code
 	if (Extended)
-		p.AddInt(0);
+		p.AddInt(Offset);
 
 	int count = 0;
 	for(i = 0; i < MAX_CLIENTS; i++)
@@ -1457,6 +1980,7 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, bool Extended)
 			if (!Extended && count >= VANILLA_MAX_CLIENTS) break;
 			if (Extended && count >= DDNET_MAX_CLIENTS) break;
 			++count;
+			if (Extended && (count <= Offset || count > Offset+SERVERINFO64_CHUNK_CLIENTS)) continue;
 
 			p.AddString(ClientName(i), MAX_NAME_LENGTH); // client name
 			p.AddString(ClientClan(i), MAX_CLAN_LENGTH); // client clan
@@ -1468,17 +1992,52 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, bool Extended)
 			str_format(aBuf, sizeof(aBuf), "%d", InGame?1:0); p.AddString(aBuf, 2); // is player?
 		}
 	}
-
-	Packet.m_ClientID = -1;
-	Packet.m_Address = *pAddr;
-	Packet.m_Flags = NETSENDFLAG_CONNLESS;
-	Packet.m_DataSize = p.Size();
-	Packet.m_pData = p.Data();
-	m_NetServer.Send(&Packet);
+	return count;
 }
 
-void CServer::UpdateServerInfo()
+void CServer::SendServerInfo(const NETADDR *pAddr, int Token, bool Extended)
 {
+	if(m_ServerInfoDirty)
+	{
+		PackServerInfo(&m_aServerInfoCache[0], false);
+		int NumClients = PackServerInfo(&m_aServerInfoCache[1], true, 0);
+		m_NumServerInfo64Chunks = 1;
+		for(int Offset = SERVERINFO64_CHUNK_CLIENTS; Offset < NumClients; Offset += SERVERINFO64_CHUNK_CLIENTS)
+			PackServerInfo(&m_aServerInfoCache[1+m_NumServerInfo64Chunks++], true, Offset);
+		m_ServerInfoDirty = false;
+	}
+
+	// the 64 slot response is split, the client puts it together by the offsets
+	int First = Extended ? 1 : 0;
+	int Num = Extended ? m_NumServerInfo64Chunks : 1;
+	for(int c = First; c < First+Num; c++)
+	{
+		CNetChunk Packet;
+		CPacker p;
+		char aBuf[128];
+		p.Reset();
+
+		if(Extended) p.AddRaw(SERVERBROWSE_INFO64, sizeof(SERVERBROWSE_INFO64));
+		else p.AddRaw(SERVERBROWSE_INFO, sizeof(SERVERBROWSE_INFO));
+
+		str_format(aBuf, sizeof(aBuf), "%d", Token);
+		p.AddString(aBuf, 6);
+
+		const CPacker *pInfo = &m_aServerInfoCache[c];
+		p.AddRaw(pInfo->Data(), pInfo->Size());
+
+		Packet.m_ClientID = -1;
+		Packet.m_Address = *pAddr;
+		Packet.m_Flags = NETSENDFLAG_CONNLESS;
+		Packet.m_DataSize = p.Size();
+		Packet.m_pData = p.Data();
+		m_NetServer.Send(&Packet);
+	}
+}
+
+void CServer::UpdateServerInfo()
+{
+	m_ServerInfoDirty = true;
 	for(int i = 0; i < MAX_CLIENTS; ++i)
 	{
 		if (m_aClients[i].m_State != CClient::STATE_EMPTY) {
@@ -1575,13 +2134,7 @@ void CServer::PumpNetwork()
 					Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
 				}				
 			} else {
-				sMap* mapToDownload = m_pMaps;
-				while(mapToDownload){
-					if(mapToDownload->m_uiGameID == m_aClients[i].m_uiGameID){
-						break;
-					}
-					mapToDownload = mapToDownload->m_pNextMap;
-				}
+				sMap* mapToDownload = GetGameMap(m_aClients[i].m_uiGameID);
 				
 				if(mapToDownload){
 					int Chunk = lastsent[i]++;
@@ -1622,7 +2175,10 @@ void CServer::PumpNetwork()
 	}
 
 	m_ServerBan.Update();
-	m_Econ.Update();
+	{
+		CGameScope Scope(this, m_apGames[0]->m_uiGameID);
+		m_Econ.Update();
+	}
 }
 
 char *CServer::GetMapName()
@@ -1657,8 +2213,9 @@ int CServer::LoadMap(const char *pMapName)
 	if(!m_pMap->Load(aBuf))
 		return 0;
 
-	// stop recording when we change map
-	m_DemoRecorder.Stop();
+	// stop recording when we change map, the tick of every game starts over with it
+	for(int i = 0; i < CDemoWriter::MAX_GAMES; i++)
+		m_DemoWriter.Stop(i);
 
 	// reinit snapshot ids
 	m_IDPool.TimeoutIDs();
@@ -1672,131 +2229,206 @@ int CServer::LoadMap(const char *pMapName)
 	str_copy(m_aCurrentMap, pMapName, sizeof(m_aCurrentMap));
 	//map_set(df);
 
-	// load complete map into memory for download
-	{
-		IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
-		m_CurrentMapSize = (int)io_length(File);
-		if(m_pCurrentMapData)
-			mem_free(m_pCurrentMapData);
-		m_pCurrentMapData = (unsigned char *)mem_alloc(m_CurrentMapSize, 1);
-		io_read(File, m_pCurrentMapData, m_CurrentMapSize);
-		io_close(File);
-	}
+	// downloads are served from the file the map was loaded from
+	m_pCurrentMapData = m_pMap->FileData();
+	m_CurrentMapSize = m_pMap->FileSize();
 	return 1;
 }
 
-IMap* CServer::LoadAndGetMap(const char *pMapName, unsigned int pGameID)
+bool CServer::MapFileInfo(const char *pMapName, int *pSize, int64 *pTime)
 {
-	IEngineMap *pEngineMap = CreateEngineMap();
-
-	//DATAFILE *df;
 	char aBuf[512];
+	char aPath[512];
 	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
+	IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL, aPath, sizeof(aPath));
+	if(!File)
+		return false;
+	*pSize = (int)io_length(File);
+	io_close(File);
+	return fs_file_time(aPath, pTime) == 0;
+}
 
-	/*df = datafile_load(buf);
-	if(!df)
-	return 0;*/
+sMap *CServer::AcquireMap(const char *pMapName)
+{
+	int FileSize = -1;
+	int64 FileTime = 0;
+	MapFileInfo(pMapName, &FileSize, &FileTime);
 
-	// check for valid standard map
-	if (!m_MapChecker.ReadAndValidateMap(Storage(), aBuf, IStorage::TYPE_ALL))
+	// games running the same map share the loaded map and the download data
+	for(int i = 0; i < m_NumStoredMaps; i++)
 	{
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapchecker", "invalid standard map");
-		return 0;
+		sMap *pMap = m_apStoredMaps[i];
+		if(str_comp(pMap->m_aCurrentMap, pMapName) != 0)
+			continue;
+
+		if(pMap->m_FileSize == FileSize && pMap->m_FileTime == FileTime)
+		{
+			pMap->m_RefCount++;
+			return pMap;
+		}
+
+		// the file was replaced, the games on the old one keep it until
+		// they release it but new games get the new file
+		m_apStoredMaps[i] = m_apStoredMaps[--m_NumStoredMaps];
+		break;
 	}
 
-	if (!pEngineMap->Load(aBuf, Kernel()))
+	if(m_NumStoredMaps >= MAX_GAMES)
 	{
-		delete pEngineMap;
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "too many maps loaded");
 		return 0;
 	}
 
-	sMap* map = m_pMaps;
-	if (map == NULL) {
-		map = new sMap;
-		m_pMaps = map;
+	// the loader holds a reference until UpdateMapLoader picked up the result
+	sMap* map = new sMap;
+	str_copy(map->m_aCurrentMap, pMapName, sizeof(map->m_aCurrentMap));
+	map->m_FileSize = FileSize;
+	map->m_FileTime = FileTime;
+	map->m_RefCount = 2;
+	if(!m_MapLoader.Load(map))
+	{
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "map loader queue is full");
+		delete map;
+		return 0;
 	}
-	else {
-		while (map->m_pNextMap != NULL) {
-			map = map->m_pNextMap;
-		}
-		if (map->m_pNextMap == NULL) {
-			map->m_pNextMap = new sMap;
-			map = map->m_pNextMap;
+
+	m_apStoredMaps[m_NumStoredMaps++] = map;
+	return map;
+}
+
+void CServer::ReleaseMap(sMap *pMap)
+{
+	if(!pMap || --pMap->m_RefCount > 0)
+		return;
+
+	for(int i = 0; i < m_NumStoredMaps; i++)
+	{
+		if(m_apStoredMaps[i] == pMap)
+		{
+			m_apStoredMaps[i] = m_apStoredMaps[--m_NumStoredMaps];
+			break;
 		}
 	}
-	map->m_pMap = pEngineMap;
-	map->m_uiGameID = pGameID;
-	
-	// get the crc of the map
-	map->m_CurrentMapCrc = pEngineMap->Crc();
-	char aBufMsg[256];
-	str_format(aBufMsg, sizeof(aBufMsg), "%s crc is %08x", aBuf, map->m_CurrentMapCrc);
-	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBufMsg);
+	delete pMap;
+}
 
-	str_copy(map->m_aCurrentMap, pMapName, sizeof(map->m_aCurrentMap));
-	//map_set(df);
+void CServer::InitGame(unsigned int GameID, sMap *pMap)
+{
+	sGame* g = GetGame(GameID);
+	m_apGameMaps[GameID] = pMap;
+
+	CGameScope Scope(this, GameID);
+	if(m_apPendingConfigs[GameID]) g->m_pGameServer->OnInit(Kernel(), pMap->m_pMap, m_apPendingConfigs[GameID]);
+	else g->m_pGameServer->OnInit(Kernel(), pMap->m_pMap);
+	m_apPendingConfigs[GameID] = 0;
 
-	// load complete map into memory for download
+	// clients moved here while the map was loading are still waiting for it
+	int aClients[MAX_CLIENTS];
+	int NumClients = GetGameClients(GameID, aClients);
+	for(int i = 0; i < NumClients; i++)
 	{
-		IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
-		map->m_CurrentMapSize = (int)io_length(File);
-		if (map->m_pCurrentMapData)
-			mem_free(map->m_pCurrentMapData);
-		map->m_pCurrentMapData = (unsigned char *)mem_alloc(map->m_CurrentMapSize, 1);
-		io_read(File, map->m_pCurrentMapData, map->m_CurrentMapSize);
-		io_close(File);
+		if(m_aClients[aClients[i]].m_State == CClient::STATE_CONNECTING)
+			SendMap(aClients[i], GameID);
 	}
-
-	return pEngineMap;
 }
 
+void CServer::SwapGameMap(unsigned int GameID, sMap *pMap)
+{
+	sGame* g = GetGame(GameID);
+	sMap* pOldMap = GetGameMap(GameID);
 
-bool CServer::ChangeMap(const char *pMapName, unsigned int pGameID){
-	sMap* pMap = m_pMaps;
-	while(pMap){
-		if(pMap->m_uiGameID == pGameID){
-			char aBuf[512];
-			str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
-			
-			// check for valid standard map
-			if (!m_MapChecker.ReadAndValidateMap(Storage(), aBuf, IStorage::TYPE_ALL))
-			{
+	int aPreferedTeams[MAX_CLIENTS];
+	int aClients[MAX_CLIENTS];
+	int NumClients = GetGameClients(GameID, aClients);
+
+	for(int i = 0; i < NumClients; i++)
+		aPreferedTeams[i] = g->GameServer()->PreferedTeamPlayer(aClients[i]);
+
+	// new map loaded, the old one stays referenced until the game has shut down
+	m_DemoWriter.Stop(GameID);
+	CGameScope Scope(this, GameID);
+	g->GameServer()->OnShutdown();
+	m_apGameMaps[GameID] = pMap;
+	ReleaseMap(pOldMap);
+
+	for(int i = 0; i < NumClients; i++)
+	{
+		int c = aClients[i];
+		if(m_aClients[c].m_State <= CClient::STATE_AUTH)
+			continue;
+
+		SendMap(c, GameID);
+		m_aClients[c].Reset();
+		m_aClients[c].m_State = CClient::STATE_CONNECTING;
+		m_aClients[c].m_PreferedTeam = aPreferedTeams[i];
+	}
+
+	g->GameServer()->OnInit(Kernel(), pMap->m_pMap, g->GameServer()->m_Config);
+}
+
+void CServer::UpdateMapLoader()
+{
+	char aBuf[256];
+	CMapLoader::CResult Result;
+	while(m_MapLoader.PopResult(&Result))
+	{
+		sMap* pMap = Result.m_pMap;
+		if(Result.m_Error == CMapLoader::ERROR_NONE)
+		{
+			pMap->m_Loaded = true;
+			str_format(aBuf, sizeof(aBuf), "maps/%s.map crc is %08x", pMap->m_aCurrentMap, pMap->m_CurrentMapCrc);
+			Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBuf);
+		}
+		else
+		{
+			if(Result.m_Error == CMapLoader::ERROR_INVALID)
 				Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapchecker", "invalid standard map");
-				return false;
-			}
+			str_format(aBuf, sizeof(aBuf), "failed to load map. mapname='%s'", pMap->m_aCurrentMap);
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 
-			IEngineMap* pEngineMap = ((IEngineMap*)pMap->m_pMap);
-			if (!pEngineMap->Load(aBuf, Kernel()))
+			// don't hand the broken entry to later games
+			for(int i = 0; i < m_NumStoredMaps; i++)
 			{
-				delete pEngineMap;
-				return false;
+				if(m_apStoredMaps[i] == pMap)
+				{
+					m_apStoredMaps[i] = m_apStoredMaps[--m_NumStoredMaps];
+					break;
+				}
 			}
+		}
 
-			// get the crc of the map
-			pMap->m_CurrentMapCrc = pEngineMap->Crc();
-			char aBufMsg[256];
-			str_format(aBufMsg, sizeof(aBufMsg), "%s crc is %08x", aBuf, pMap->m_CurrentMapCrc);
-			Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBufMsg);
-
-			str_copy(pMap->m_aCurrentMap, pMapName, sizeof(pMap->m_aCurrentMap));
-			//map_set(df);
+		// finish the games that waited for this map
+		for(int g = 0; g < m_NumGames; g++)
+		{
+			unsigned int GameID = m_apGames[g]->m_uiGameID;
+			if(m_apPendingMaps[GameID] != pMap)
+				continue;
 
-			// load complete map into memory for download
+			m_apPendingMaps[GameID] = 0;
+			if(!pMap->m_Loaded)
 			{
-				IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
-				pMap->m_CurrentMapSize = (int)io_length(File);
-				if (pMap->m_pCurrentMapData)
-					mem_free(pMap->m_pCurrentMapData);
-				pMap->m_pCurrentMapData = (unsigned char *)mem_alloc(pMap->m_CurrentMapSize, 1);
-				io_read(File, pMap->m_pCurrentMapData, pMap->m_CurrentMapSize);
-				io_close(File);
+				pMap->m_RefCount--;
+				if(IsGameLoading(GameID))
+				{
+					StopGameServer(GameID);
+					g--;
+				}
 			}
-			return true;
-			break;
+			else if(IsGameLoading(GameID))
+				InitGame(GameID, pMap);
+			else
+				SwapGameMap(GameID, pMap);
+		}
+
+		// a failed entry is already out of the store, only delete it
+		if(!pMap->m_Loaded)
+		{
+			if(--pMap->m_RefCount <= 0)
+				delete pMap;
 		}
-		pMap = pMap->m_pNextMap;
+		else
+			ReleaseMap(pMap);
 	}
-	return false;
 }
 	
 void CServer::InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, IConsole *pConsole)
@@ -1816,20 +2448,15 @@ int CServer::Run()
 		return -1;
 	}
 
-	if(g_Config.m_SvSqliteFile[0] != '\0')
+	// there is no mysql support, the sqlite file is the database
+	if(g_Config.m_SvUseSql && g_Config.m_SvSqliteFile[0] != '\0')
 	{
 		char aFullPath[IO_MAX_PATH_LENGTH];
 		Storage()->GetCompletePath(IStorage::TYPE_SAVE, g_Config.m_SvSqliteFile, aFullPath, sizeof(aFullPath));
-
-		if(g_Config.m_SvUseSql)
-		{
-			DbPool()->RegisterSqliteDatabase(CDbConnectionPool::Mode::WRITE_BACKUP, aFullPath);
-		}
-		else
-		{
-			DbPool()->RegisterSqliteDatabase(CDbConnectionPool::Mode::READ, aFullPath);
-			DbPool()->RegisterSqliteDatabase(CDbConnectionPool::Mode::WRITE, aFullPath);
-		}
+		m_DbPool.Start(g_Config.m_SvSqlWorkers);
+		m_DbPool.RegisterSqliteDatabase(CDbConnectionPool::Mode::READ, aFullPath);
+		m_DbPool.RegisterSqliteDatabase(CDbConnectionPool::Mode::WRITE, aFullPath);
+		m_DbEnabled = true;
 	}
 
 	// start server
@@ -1856,12 +2483,17 @@ int CServer::Run()
 	m_NetServer.SetCallbacks(NewClientCallback, NewClientNoAuthCallback, DelClientCallback, this);
 
 	m_Econ.Init(Console(), &m_ServerBan);
+	m_ProxyCheck.Init();
+	m_MapLoader.Init(Kernel(), Storage(), &m_MapChecker);
+	m_DemoWriter.Init(Storage());
 
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "server name is '%s'", g_Config.m_SvName);
 	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 
+	m_CurrentGameID = m_apGames[0]->m_uiGameID;
 	GameServer()->OnInit();
+	m_CurrentGameID = GAME_ID_INVALID;
 	str_format(aBuf, sizeof(aBuf), "version %s", GameServer()->NetVersion());
 	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 
@@ -1882,19 +2514,31 @@ int CServer::Run()
 			Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
 		}
 
+		net_stats(&m_ProfilerNetStats);
+		m_ProfilerSnapAllocs = m_SnapshotPool.m_NumAllocs;
+		m_ProfilerSnapsShared = m_SnapshotPool.m_NumShared;
+		m_ProfilerDeltasReused = m_NumDeltasReused;
+		m_pNetWait = net_wait_create(m_NetServer.Socket());
 		while(m_RunServer)
 		{
 			int64 t = time_get();
 			int NewTicks = 0;
 
-			// load new map TODO: don't poll this
-			if(str_comp(g_Config.m_SvMap, m_aCurrentMap) != 0 || m_MapReload)
+			if(m_NetServer.Batching() != (g_Config.m_SvNetBatch != 0))
+				m_NetServer.SetBatching(g_Config.m_SvNetBatch);
+
+			// load new map
+			if(m_MapChange && str_comp(g_Config.m_SvMap, m_aCurrentMap) == 0)
+				m_MapChange = 0;
+			if(m_MapChange || m_MapReload)
 			{
 				m_MapReload = 0;
+				m_MapChange = 0;
 
 				// load map
 				if(LoadMap(g_Config.m_SvMap))
 				{
+					CGameScope Scope(this, m_apGames[0]->m_uiGameID);
 					int aPreferedTeams[MAX_CLIENTS];
 
 					for(int c = 0; c < MAX_CLIENTS; c++)
@@ -1932,32 +2576,62 @@ int CServer::Run()
 
 			while(t > TickStartTime(m_CurrentGameTick+1))
 			{
+				m_Profiler.Record(CTickProfiler::PHASE_TICK_DELAY, t-TickStartTime(m_CurrentGameTick+1));
+				CTickProfiler::CScope TickScope(&m_Profiler, CTickProfiler::PHASE_TICK);
 				m_CurrentGameTick++;
 				NewTicks++;
 
 				if(m_PlayerCount){
+					bool GameThreads = g_Config.m_SvGameThreads;
+
 					// apply new input
+					int64 InputStart = time_get();
 					for(int c = 0; c < MAX_CLIENTS; c++)
 					{
-						if(m_aClients[c].m_State == CClient::STATE_EMPTY)
+						if(m_aClients[c].m_State != CClient::STATE_INGAME)
 							continue;
-						for(int i = 0; i < 200; i++)
+						CClient::CInput *pInput = &m_aClients[c].m_aInputs[Tick()%CClient::INPUT_RING_SIZE];
+						if(pInput->m_GameTick != Tick())
 						{
-							if(m_aClients[c].m_aInputs[i].m_GameTick == Tick())
-							{
-								if(m_aClients[c].m_State == CClient::STATE_INGAME) {
-									sGame* p = GetGame(m_aClients[c].m_uiGameID);
-									if(p != NULL) p->GameServer()->OnClientPredictedInput(c, m_aClients[c].m_aInputs[i].m_aData);				
-								}
-								break;
-							}
+							m_aClients[c].m_NumInputsMissing++;
+							continue;
+						}
+						m_aClients[c].m_NumInputsApplied++;
+						sGame* p = GetGame(m_aClients[c].m_uiGameID);
+						if(p != NULL && GameThreads)
+						{
+							// handed to the game with its next tick
+							CGameThread::CInput Input;
+							Input.m_ClientID = c;
+							mem_copy(Input.m_aData, pInput->m_aData, sizeof(Input.m_aData));
+							GetGameThread(p)->m_lInputs.push_back(Input);
+						}
+						else if(p != NULL)
+						{
+							CGameScope Scope(this, p->m_uiGameID);
+							p->GameServer()->OnClientPredictedInput(c, pInput->m_aData);
 						}
 					}
 
-					sGame* p = m_pGames;
-					while(p != NULL){	
-						p->GameServer()->OnTick();
-						p = p->m_pNext;
+					m_Profiler.Record(CTickProfiler::PHASE_INPUT, time_get()-InputStart);
+
+					CTickProfiler::CScope GameTickScope(&m_Profiler, CTickProfiler::PHASE_GAMETICK);
+					if(GameThreads)
+						RunGameThreads(CGameThread::PHASE_TICK);
+					else
+					{
+						for(int g = 0; g < m_NumGames; g++)
+						{
+							// the tick may stop games and move the others around
+							unsigned int GameID = m_apGames[g]->m_uiGameID;
+							if(IsGameLoading(GameID))
+								continue;
+							int64 Start = time_get();
+							m_CurrentGameID = GameID;
+							m_apGames[g]->GameServer()->OnTick();
+							m_Profiler.RecordGame(GameID, CTickProfiler::GAMEPHASE_TICK, time_get()-Start);
+						}
+						m_CurrentGameID = GAME_ID_INVALID;
 					}
 				} else {
 					if(m_StopServerWhenEmpty) m_RunServer = 0;
@@ -1968,15 +2642,29 @@ int CServer::Run()
 			if(NewTicks)
 			{
 				if(g_Config.m_SvHighBandwidth || (m_CurrentGameTick%2) == 0)
+				{
+					CTickProfiler::CScope SnapScope(&m_Profiler, CTickProfiler::PHASE_SNAP);
 					DoSnapshot();
+				}
 
 				UpdateClientRconCommands();
 			}
 
-			// master server stuff
-			m_Register.RegisterUpdate(m_NetServer.NetType());
+			{
+				CTickProfiler::CScope NetworkScope(&m_Profiler, CTickProfiler::PHASE_NETWORK);
+				PumpNetwork();
+			}
+
+			{
+				CTickProfiler::CScope UpdateScope(&m_Profiler, CTickProfiler::PHASE_UPDATE);
+
+				// master server stuff
+				m_Register.RegisterUpdate(m_NetServer.NetType());
 
-			PumpNetwork();
+				UpdateProxyCheck();
+
+				UpdateMapLoader();
+			}
 
 			if(ReportTime < time_get())
 			{
@@ -2000,11 +2688,39 @@ int CServer::Run()
 					*/
 				}
 
+				if(g_Config.m_SvProfilerFile[0])
+					DumpProfile(g_Config.m_SvProfilerFile);
+
 				ReportTime += time_freq()*ReportInterval;
 			}
 
-			// wait for incomming data
-			net_socket_read_wait(m_NetServer.Socket(), 5);
+			// everything sent during this loop goes out now
+			m_NetServer.FlushSend();
+			if(NewTicks)
+			{
+				NETSTATS Stats;
+				net_stats(&Stats);
+				m_Profiler.RecordCount(CTickProfiler::COUNTER_RECV_SYSCALLS, Stats.recv_syscalls-m_ProfilerNetStats.recv_syscalls);
+				m_Profiler.RecordCount(CTickProfiler::COUNTER_SEND_SYSCALLS, Stats.send_syscalls-m_ProfilerNetStats.send_syscalls);
+				m_Profiler.RecordCount(CTickProfiler::COUNTER_RECV_PACKETS, Stats.recv_packets-m_ProfilerNetStats.recv_packets);
+				m_Profiler.RecordCount(CTickProfiler::COUNTER_SENT_PACKETS, Stats.sent_packets-m_ProfilerNetStats.sent_packets);
+				m_ProfilerNetStats = Stats;
+				m_Profiler.RecordCount(CTickProfiler::COUNTER_SNAP_ALLOCS, m_SnapshotPool.m_NumAllocs-m_ProfilerSnapAllocs);
+				m_Profiler.RecordCount(CTickProfiler::COUNTER_SNAP_KBYTES, (int)(m_SnapshotPool.m_NumBytes/1024));
+				m_Profiler.RecordCount(CTickProfiler::COUNTER_SNAPS_SHARED, m_SnapshotPool.m_NumShared-m_ProfilerSnapsShared);
+				m_Profiler.RecordCount(CTickProfiler::COUNTER_DELTAS_REUSED, m_NumDeltasReused-m_ProfilerDeltasReused);
+				m_ProfilerSnapAllocs = m_SnapshotPool.m_NumAllocs;
+				m_ProfilerSnapsShared = m_SnapshotPool.m_NumShared;
+				m_ProfilerDeltasReused = m_NumDeltasReused;
+			}
+
+			m_Profiler.Record(CTickProfiler::PHASE_LOOP, time_get()-t);
+
+			// wait for incomming data or the next tick
+			if(m_pNetWait && g_Config.m_SvEventLoop)
+				net_wait(m_pNetWait, TickStartTime(m_CurrentGameTick+1));
+			else
+				net_socket_read_wait(m_NetServer.Socket(), 5);
 		}
 	}
 	// disconnect all clients on shutdown
@@ -2015,12 +2731,22 @@ int CServer::Run()
 
 		m_Econ.Shutdown();
 	}
+	m_NetServer.SetBatching(false);
+	net_wait_destroy(m_pNetWait);
+	m_pNetWait = 0;
 
+	// the demos still need the map files
+	m_DemoWriter.Shutdown();
+
+	// stop the other games, then the thread of the main game. they
+	// flush their ratings while the database pool is still there
+	while(m_NumGames > 1)
+		StopGameServer(m_apGames[m_NumGames-1]->m_uiGameID);
+	StopGameThread(m_apGames[0]);
 	GameServer()->OnShutdown();
+	StopSnapWorkers();
 	m_pMap->Unload();
-
-	if(m_pCurrentMapData)
-		mem_free(m_pCurrentMapData);
+	m_pCurrentMapData = 0;
 	return 0;
 }
 
@@ -2078,16 +2804,62 @@ void CServer::ConShutdownEmpty(IConsole::IResult *pResult, void *pUser)
 	((CServer *)pUser)->m_StopServerWhenEmpty = 1;
 }
 
-void CServer::DemoRecorder_HandleAutoStart()
+unsigned int CServer::GameIDOf(IGameServer *pGameServer)
+{
+	for(int g = 0; g < m_NumGames; g++)
+		if(m_apGames[g]->GameServer() == pGameServer)
+			return m_apGames[g]->m_uiGameID;
+	return GAME_ID_INVALID;
+}
+
+void CServer::StartDemo(unsigned int GameID, const char *pFilename)
+{
+	sGame *pGame = GetGame(GameID);
+	if(!pGame || IsGameLoading(GameID))
+		return;
+
+	// the main game has no entry in the map store
+	sMap *pMap = GetGameMap(GameID);
+	if(pMap)
+		m_DemoWriter.Start(GameID, pFilename, pGame->GameServer()->NetVersion(), pMap->m_aCurrentMap, pMap->m_CurrentMapCrc);
+	else
+		m_DemoWriter.Start(GameID, pFilename, pGame->GameServer()->NetVersion(), m_aCurrentMap, m_CurrentMapCrc);
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "Recording game %u to '%s'", GameID, pFilename);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
+}
+
+void CServer::DemoRecorder_HandleAutoStart(IGameServer *pGameServer)
+{
+	if(!g_Config.m_SvAutoDemoRecord)
+		return;
+
+	// the demo writer is only used by the main thread
+	if(s_pCurrentGameThread)
+	{
+		s_pCurrentGameThread->QueueAction(CGameThread::ACTION_AUTODEMO, -1, s_pCurrentGameThread->m_pGame->m_uiGameID, 0, 0);
+		return;
+	}
+
+	unsigned int GameID = GameIDOf(pGameServer);
+	if(GameID != GAME_ID_INVALID)
+		AutoStartDemo(GameID);
+}
+
+void CServer::AutoStartDemo(unsigned int GameID)
 {
 	if(g_Config.m_SvAutoDemoRecord)
 	{
-		m_DemoRecorder.Stop();
 		char aFilename[128];
 		char aDate[20];
 		str_timestamp(aDate, sizeof(aDate));
-		str_format(aFilename, sizeof(aFilename), "demos/%s_%s.demo", "auto/autorecord", aDate);
-		m_DemoRecorder.Start(Storage(), m_pConsole, aFilename, GameServer()->NetVersion(), m_aCurrentMap, m_CurrentMapCrc, "server");
+		// every game records its own demo, they can start in the same second
+		if(GameID == 0)
+			str_format(aFilename, sizeof(aFilename), "demos/%s_%s.demo", "auto/autorecord", aDate);
+		else
+			str_format(aFilename, sizeof(aFilename), "demos/%s_%s_game%u.demo", "auto/autorecord", aDate, GameID);
+		StartDemo(GameID, aFilename);
 		if(g_Config.m_SvAutoDemoMax)
 		{
 			// clean up auto recorded demos
@@ -2097,15 +2869,17 @@ void CServer::DemoRecorder_HandleAutoStart()
 	}
 }
 
-bool CServer::DemoRecorder_IsRecording()
+bool CServer::DemoRecorder_IsRecording(IGameServer *pGameServer)
 {
-	return m_DemoRecorder.IsRecording();
+	unsigned int GameID = GameIDOf(pGameServer);
+	return GameID != GAME_ID_INVALID && m_DemoWriter.IsRecording(GameID);
 }
 
 void CServer::ConRecord(IConsole::IResult *pResult, void *pUser)
 {
 	CServer* pServer = (CServer *)pUser;
 	char aFilename[128];
+	unsigned int GameID = pResult->NumArguments() > 1 ? pResult->GetInteger(1) : 0;
 
 	if(pResult->NumArguments())
 		str_format(aFilename, sizeof(aFilename), "demos/%s.demo", pResult->GetString(0));
@@ -2115,12 +2889,18 @@ void CServer::ConRecord(IConsole::IResult *pResult, void *pUser)
 		str_timestamp(aDate, sizeof(aDate));
 		str_format(aFilename, sizeof(aFilename), "demos/demo_%s.demo", aDate);
 	}
-	pServer->m_DemoRecorder.Start(pServer->Storage(), pServer->Console(), aFilename, pServer->GameServer()->NetVersion(), pServer->m_aCurrentMap, pServer->m_CurrentMapCrc, "server");
+	pServer->StartDemo(GameID, aFilename);
 }
 
 void CServer::ConStopRecord(IConsole::IResult *pResult, void *pUser)
 {
-	((CServer *)pUser)->m_DemoRecorder.Stop();
+	CServer* pServer = (CServer *)pUser;
+	unsigned int GameID = pResult->NumArguments() ? pResult->GetInteger(0) : 0;
+	if(GameID < CDemoWriter::MAX_GAMES && pServer->m_DemoWriter.IsRecording(GameID))
+	{
+		pServer->m_DemoWriter.Stop(GameID);
+		pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", "Stopped recording");
+	}
 }
 
 void CServer::ConMapReload(IConsole::IResult *pResult, void *pUser)
@@ -2150,6 +2930,13 @@ void CServer::ConLogout(IConsole::IResult *pResult, void *pUser)
 	}
 }
 
+void CServer::ConchainMapUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
+{
+	pfnCallback(pResult, pCallbackUserData);
+	if(pResult->NumArguments())
+		((CServer *)pUserData)->m_MapChange = 1;
+}
+
 void CServer::ConchainSpecialInfoupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
 {
 	pfnCallback(pResult, pCallbackUserData);
@@ -2240,25 +3027,97 @@ void CServer::ConServerStatus(IConsole::IResult *pResult, void *pUser){
 	
 	char aBuf[1024];
 
-	sGame* pGame = pThis->m_pGames;
-	while(pGame){
-		sMap* pMap = pThis->m_pMaps;
-		while(pMap){
-			if(pMap->m_uiGameID == pGame->m_uiGameID) break;
-			pMap = pMap->m_pNextMap;
-		}
+	for(int g = 0; g < pThis->m_NumGames; g++){
+		sGame* pGame = pThis->m_apGames[g];
+		sMap* pMap = pThis->GetGameMap(pGame->m_uiGameID);
+		sMap* pPendingMap = pThis->GetPendingMap(pGame->m_uiGameID);
+		int aClients[MAX_CLIENTS];
+		int NumPlayers = pThis->GetGameClients(pGame->m_uiGameID, aClients);
 		
-		str_format(aBuf, sizeof(aBuf), "id=%u map=%s", pGame->m_uiGameID, (pMap) ? pMap->m_aCurrentMap : ((pGame->m_uiGameID == 0) ? pThis->m_aCurrentMap : ""));
+		str_format(aBuf, sizeof(aBuf), "id=%u map=%s players=%d%s%s", pGame->m_uiGameID, (pMap) ? pMap->m_aCurrentMap : ((pGame->m_uiGameID == 0) ? pThis->m_aCurrentMap : ""), NumPlayers,
+			pPendingMap ? " loading=" : "", pPendingMap ? pPendingMap->m_aCurrentMap : "");
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
+	}
+}
+
+void CServer::ConSqlStatus(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	if(!pThis->m_DbEnabled)
+	{
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "the database is disabled (sv_use_sql)");
+		return;
+	}
+	pThis->m_DbPool.PrintStats(pThis->Console());
+}
+
+void CServer::ConInputStatus(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+
+	char aBuf[256];
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		const CClient *pClient = &pThis->m_aClients[i];
+		if(pClient->m_State != CClient::STATE_INGAME)
+			continue;
+		str_format(aBuf, sizeof(aBuf), "id=%d name='%s' applied=%d missing=%d late=%d early=%d duplicate=%d", i, pClient->m_aName,
+			pClient->m_NumInputsApplied, pClient->m_NumInputsMissing, pClient->m_NumInputsLate, pClient->m_NumInputsEarly, pClient->m_NumInputsDuplicate);
 		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
-		pGame = pGame->m_pNext;
 	}
 }
 
+void CServer::ProfilePrintLine(const char *pLine, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "profile", pLine);
+}
+
+void CServer::ProfileWriteLine(const char *pLine, void *pUser)
+{
+	IOHANDLE File = *(IOHANDLE *)pUser;
+	io_write(File, pLine, str_length(pLine));
+	io_write_newline(File);
+}
+
+bool CServer::DumpProfile(const char *pFilename)
+{
+	IOHANDLE File = Storage()->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+
+	char aBuf[64];
+	str_format(aBuf, sizeof(aBuf), "tick=%d", m_CurrentGameTick);
+	ProfileWriteLine(aBuf, &File);
+	m_Profiler.Report(ProfileWriteLine, &File);
+	io_close(File);
+	return true;
+}
+
+void CServer::ConProfile(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	pThis->m_Profiler.Report(ProfilePrintLine, pThis);
+}
+
+void CServer::ConProfileDump(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = static_cast<CServer *>(pUser);
+	const char *pFilename = pResult->NumArguments() ? pResult->GetString(0) : "profile.txt";
+
+	char aBuf[256];
+	if(pThis->DumpProfile(pFilename))
+		str_format(aBuf, sizeof(aBuf), "profile written to '%s'", pFilename);
+	else
+		str_format(aBuf, sizeof(aBuf), "failed to open '%s'", pFilename);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "profile", aBuf);
+}
+
 void CServer::RegisterCommands()
 {
 	m_pConsole = Kernel()->RequestInterface<IConsole>();
-	m_pGames->m_pGameServer = Kernel()->RequestInterface<IGameServer>();
-	m_pGames->m_uiGameID = 0;
+	m_pConsole->SetExecutionLock(&m_EngineLock);
+	m_apGames[0]->m_pGameServer = Kernel()->RequestInterface<IGameServer>();
 	m_pMap = Kernel()->RequestInterface<IEngineMap>();
 	m_pStorage = Kernel()->RequestInterface<IStorage>();
 
@@ -2268,18 +3127,24 @@ void CServer::RegisterCommands()
 	Console()->Register("stopgame", "i", CFGFLAG_SERVER, ConStopGame, this, "Stop a game by it's ID");
 	Console()->Register("moveplayergame", "i?i", CFGFLAG_SERVER, ConMovePlayerToGame, this, "Move a player by id to a game by id");
 	Console()->Register("serverstatus", "", CFGFLAG_SERVER, ConServerStatus, this, "List all game server");
+	Console()->Register("sqlstatus", "", CFGFLAG_SERVER, ConSqlStatus, this, "Show database queue depth and query latency");
+	Console()->Register("inputstatus", "", CFGFLAG_SERVER, ConInputStatus, this, "Show late, early, duplicate and missing inputs of the players");
+	Console()->Register("profile", "", CFGFLAG_SERVER, ConProfile, this, "Show timing percentiles of the server loop and the games");
+	Console()->Register("profile_dump", "?s", CFGFLAG_SERVER, ConProfileDump, this, "Write the timing percentiles to a file");
 	Console()->Register("status", "", CFGFLAG_SERVER, ConStatus, this, "List players");
 	Console()->Register("shutdown", "", CFGFLAG_SERVER, ConShutdown, this, "Shut down");
 	Console()->Register("shutdownwhenempty", "", CFGFLAG_SERVER, ConShutdownEmpty, this, "Shut down, when the server is empty");
 	Console()->Register("logout", "", CFGFLAG_SERVER, ConLogout, this, "Logout of rcon");
 
-	Console()->Register("record", "?s", CFGFLAG_SERVER|CFGFLAG_STORE, ConRecord, this, "Record to a file");
-	Console()->Register("stoprecord", "", CFGFLAG_SERVER, ConStopRecord, this, "Stop recording");
+	Console()->Register("record", "?si", CFGFLAG_SERVER|CFGFLAG_STORE, ConRecord, this, "Record a game to a file (the main game by default)");
+	Console()->Register("stoprecord", "?i", CFGFLAG_SERVER, ConStopRecord, this, "Stop recording a game (the main game by default)");
 
 	Console()->Register("reload", "", CFGFLAG_SERVER, ConMapReload, this, "Reload the map");
 
+	Console()->Chain("sv_map", ConchainMapUpdate, this);
 	Console()->Chain("sv_name", ConchainSpecialInfoupdate, this);
 	Console()->Chain("password", ConchainSpecialInfoupdate, this);
+	Console()->Chain("sv_spectator_slots", ConchainSpecialInfoupdate, this);
 
 	Console()->Chain("sv_max_clients_per_ip", ConchainMaxclientsperipUpdate, this);
 	Console()->Chain("mod_command", ConchainModCommandUpdate, this);
@@ -2287,146 +3152,162 @@ void CServer::RegisterCommands()
 
 	// register console commands in sub parts
 	m_ServerBan.InitServerBan(Console(), Storage(), this);
-	m_pGames->m_pGameServer->OnConsoleInit();
+	m_apGames[0]->m_pGameServer->OnConsoleInit();
 }
 
 
 int CServer::StartGameServer(const char* pMap, CConfiguration* pConfig){
-	unsigned int freeGameID = 1;
-		
-	sGame* g = m_pGames;
-	while(g->m_pNext){
-		if(g->m_pNext->m_uiGameID != freeGameID) break;
-		++freeGameID;
-		g = g->m_pNext;
+	if(s_pCurrentGameThread)
+	{
+		s_pCurrentGameThread->QueueAction(CGameThread::ACTION_STARTGAME, -1, GAME_ID_INVALID, 0, pMap);
+		s_pCurrentGameThread->m_lActions.back().m_pConfig = pConfig;
+		return -1;
 	}
-	
-	IMap* map = LoadAndGetMap(pMap, freeGameID);
-	
-	if(map){
-		if(g->m_pNext){
-			sGame* gtmp = g->m_pNext;
-			
-			g->m_pNext = new sGame;
-			g = g->m_pNext;
-			g->m_pNext = gtmp;
-		} else {			
-			g->m_pNext = new sGame;
-			g = g->m_pNext;			
-		}
-		
-		g->m_pGameServer = CreateGameServer();
-		g->m_uiGameID = freeGameID;
-		
-		/*for(int c = 0; c < MAX_CLIENTS; c++)
-		{
-			if(pThis->m_aClients[c].m_State <= CClient::STATE_AUTH)
-				continue;
-			pThis->GameServer()->OnClientDrop(c, "", true);
-			pThis->m_aClients[c].m_uiGameID = freeGameID;
-			pThis->SendMap(c, freeGameID);
-			pThis->m_aClients[c].Reset();
-			pThis->m_aClients[c].m_State = CClient::STATE_CONNECTING;
-		}*/
-
-		if(pConfig) g->m_pGameServer->OnInit(Kernel(), map, pConfig);
-		else g->m_pGameServer->OnInit(Kernel(), map);
-	} else return -1;
-	
+
+	std::lock_guard<std::recursive_mutex> Lock(m_EngineLock);
+	if(!m_NumFreeGameIDs)
+	{
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "too many games running");
+		return -1;
+	}
+
+	sMap* map = AcquireMap(pMap);
+	if(!map)
+		return -1;
+
+	unsigned int freeGameID = m_aFreeGameIDs[--m_NumFreeGameIDs];
+	m_Profiler.ClearGame(freeGameID);
+
+	sGame* g = new sGame;
+	g->m_pGameServer = CreateGameServer();
+	g->m_uiGameID = freeGameID;
+	m_aGameSlots[freeGameID] = m_NumGames;
+	m_apGames[m_NumGames++] = g;
+
+	// a map that isn't loaded yet initializes the game in UpdateMapLoader
+	m_apPendingConfigs[freeGameID] = pConfig;
+	if(map->m_Loaded)
+		InitGame(freeGameID, map);
+	else
+		m_apPendingMaps[freeGameID] = map;
 	
 	return freeGameID;	
 }
 
 void CServer::StopGameServer(unsigned int GameID, int MoveToGameID){
-	sMap* pMap = m_pMaps;
-	if(pMap){
-		sGame* pGame = m_pGames;
-		while (pGame->m_pNext) {
-			if (pGame->m_pNext->m_uiGameID == GameID) break;
-			pGame = pGame->m_pNext;
-		}
+	if(s_pCurrentGameThread)
+	{
+		s_pCurrentGameThread->QueueAction(CGameThread::ACTION_STOPGAME, -1, GameID, MoveToGameID, 0);
+		return;
+	}
 
-		if (pMap->m_uiGameID == GameID) {
-			m_pMaps = pMap->m_pNextMap;
-			delete pMap;
-		}
-		else {
-			while (pMap->m_pNextMap) {
-				if (pMap->m_pNextMap->m_uiGameID == GameID) break;
-				pMap = pMap->m_pNextMap;
-			}
-			if (!pMap->m_pNextMap) {
-				delete m_pMaps;
-				m_pMaps = 0;
-			}
-			else {
-				sMap* mtmp = pMap->m_pNextMap->m_pNextMap;
-				delete pMap->m_pNextMap;
-				pMap->m_pNextMap = mtmp;
-			}
-		}
-		
-		if(pGame->m_pNext){	
-			for(int c = 0; c < MAX_CLIENTS; c++)
-			{
-				if(m_aClients[c].m_State <= CClient::STATE_AUTH || m_aClients[c].m_uiGameID != pGame->m_pNext->m_uiGameID)
-					continue;
+	// the main game can't be stopped
+	sGame* pGame = GetGame(GameID);
+	if(!pGame || GameID == 0)
+		return;
 
-				pGame->m_pNext->GameServer()->OnClientDrop(c, "", true);
-				m_aClients[c].m_uiGameID = MoveToGameID == -1 ? 0 : MoveToGameID;
-				SendMap(c, MoveToGameID == -1 ? 0 : MoveToGameID);
-				m_aClients[c].Reset();
-				m_aClients[c].m_State = CClient::STATE_CONNECTING;
-			}
+	unsigned int MoveTo = MoveToGameID == -1 || !GetGame(MoveToGameID) ? 0 : MoveToGameID;
 
-			delete pGame->m_pNext->m_pGameServer;
-			sGame* pDeleteGame = pGame->m_pNext;
-			pGame->m_pNext = pGame->m_pNext->m_pNext;
-			delete pDeleteGame;
+	int aClients[MAX_CLIENTS];
+	int NumClients = GetGameClients(GameID, aClients);
+	for(int i = 0; i < NumClients; i++)
+	{
+		int c = aClients[i];
+		if(m_aClients[c].m_State <= CClient::STATE_AUTH)
+			continue;
+
+		if(m_aClients[c].m_State >= CClient::STATE_READY)
+		{
+			CGameScope Scope(this, pGame->m_uiGameID);
+			pGame->GameServer()->OnClientDrop(c, "", true);
 		}
+		SetClientGame(c, MoveTo);
+		SendMap(c, MoveTo);
+		m_aClients[c].Reset();
+		m_aClients[c].m_State = CClient::STATE_CONNECTING;
+	}
+
+	// clients that didn't get moved are only authing, they join the main game later
+	NumClients = GetGameClients(GameID, aClients);
+	for(int i = 0; i < NumClients; i++)
+		SetClientGame(aClients[i], GAME_ID_INVALID);
+
+	// keep the slots dense
+	int Slot = m_aGameSlots[GameID];
+	m_apGames[Slot] = m_apGames[--m_NumGames];
+	m_aGameSlots[m_apGames[Slot]->m_uiGameID] = Slot;
+	m_aGameSlots[GameID] = -1;
+	m_aFreeGameIDs[m_NumFreeGameIDs++] = GameID;
+
+	m_DemoWriter.Stop(GameID);
+	StopGameThread(pGame);
+	// a game that is still loading never got initialized
+	if(m_apGameMaps[GameID])
+	{
+		CGameScope Scope(this, GameID);
+		pGame->GameServer()->OnShutdown();
 	}
+	delete pGame->m_pGameServer;
+	delete pGame;
+
+	ReleaseMap(m_apGameMaps[GameID]);
+	m_apGameMaps[GameID] = 0;
+	ReleaseMap(m_apPendingMaps[GameID]);
+	m_apPendingMaps[GameID] = 0;
+	m_apPendingConfigs[GameID] = 0;
 }
 
 void CServer::MovePlayerToGameServer(int PlayerID, unsigned int GameID){
-	if(PlayerID < MAX_CLIENTS){
+	if(s_pCurrentGameThread)
+	{
+		s_pCurrentGameThread->QueueAction(CGameThread::ACTION_MOVEPLAYER, PlayerID, GameID, 0, 0);
+		return;
+	}
+
+	if(PlayerID >= 0 && PlayerID < MAX_CLIENTS){
 		if(m_aClients[PlayerID].m_State <= CClient::STATE_AUTH || m_aClients[PlayerID].m_uiGameID == GameID)
 			return;
 		
-		sGame* pGameLeave = m_pGames;
-		while(pGameLeave){
-			if(pGameLeave->m_uiGameID == m_aClients[PlayerID].m_uiGameID) break;
-			pGameLeave = pGameLeave->m_pNext;
-		}			
-		
-		
+		sGame* pGameLeave = GetGame(m_aClients[PlayerID].m_uiGameID);
 		sGame* pGame = GetGame(GameID);
-		if (pGame) {
-			if (pGame->m_uiGameID == GameID) {
+		if (pGame && pGameLeave) {
+			if(m_aClients[PlayerID].m_State >= CClient::STATE_READY)
+			{
+				CGameScope Scope(this, pGameLeave->m_uiGameID);
 				pGameLeave->GameServer()->OnClientDrop(PlayerID, "", true);
-
-				m_aClients[PlayerID].m_uiGameID = GameID;
-				SendMap(PlayerID, GameID);
-				m_aClients[PlayerID].Reset();
-				m_aClients[PlayerID].m_State = CClient::STATE_CONNECTING;
 			}
+
+			SetClientGame(PlayerID, GameID);
+			SendMap(PlayerID, GameID);
+			m_aClients[PlayerID].Reset();
+			m_aClients[PlayerID].m_State = CClient::STATE_CONNECTING;
 		}
 	}
 }
 
 void CServer::KickConnectingPlayers(unsigned int GameID, const char* pReason){
-	for(int c = 0; c < MAX_CLIENTS; c++)
+	if(s_pCurrentGameThread)
 	{
-		if(m_aClients[c].m_State != CClient::STATE_CONNECTING || m_aClients[c].m_uiGameID != GameID)
-			continue;
-		
-		KickForce(c, pReason);
+		s_pCurrentGameThread->QueueAction(CGameThread::ACTION_KICKCONNECTING, -1, GameID, 0, pReason);
+		return;
+	}
+
+	int aClients[MAX_CLIENTS];
+	int NumClients = GetGameClients(GameID, aClients);
+	for(int i = 0; i < NumClients; i++)
+	{
+		if(m_aClients[aClients[i]].m_State == CClient::STATE_CONNECTING)
+			KickForce(aClients[i], pReason);
 	}
 }
 
 bool CServer::CheckForConnectingPlayers(unsigned int GameID){	
-	for(int c = 0; c < MAX_CLIENTS; c++)
+	if(GameID >= MAX_GAMES)
+		return false;
+
+	for(int i = 0; i < m_aNumGameClients[GameID]; i++)
 	{
-		if(m_aClients[c].m_State == CClient::STATE_CONNECTING && m_aClients[c].m_uiGameID == GameID)
+		if(m_aClients[m_aaGameClients[GameID][i]].m_State == CClient::STATE_CONNECTING)
 			return true;
 	}
 	
@@ -2434,63 +3315,109 @@ bool CServer::CheckForConnectingPlayers(unsigned int GameID){
 }
 
 bool CServer::ChangeGameServerMap(unsigned int GameID, const char* pMapName){
+	// only a map that exists is queued, loading it can still fail later
+	int FileSize;
+	int64 FileTime;
+	if(!MapFileInfo(pMapName, &FileSize, &FileTime))
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "map '%s' not found", pMapName);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+		return false;
+	}
+
+	if(s_pCurrentGameThread)
+	{
+		s_pCurrentGameThread->QueueAction(CGameThread::ACTION_CHANGEMAP, -1, GameID, 0, pMapName);
+		return true;
+	}
+
+	// the main game loads its map in the server loop
+	if(GameID == 0)
+	{
+		if(pMapName != g_Config.m_SvMap)
+			str_copy(g_Config.m_SvMap, pMapName, sizeof(g_Config.m_SvMap));
+		m_MapChange = 1;
+		return true;
+	}
+
 	sGame* g = GetGame(GameID);
-	if(g){
-		if(ChangeMap(pMapName, GameID)){	
-			int aPreferedTeams[MAX_CLIENTS];
+	if(!g)
+		return false;
+
+	sMap* pMap = AcquireMap(pMapName);
+	if(!pMap)
+		return false;
+
+	// the latest change wins over one that is still loading
+	ReleaseMap(m_apPendingMaps[GameID]);
+	m_apPendingMaps[GameID] = 0;
+
+	// the game keeps running on its old map until the new one is loaded
+	if(!pMap->m_Loaded)
+		m_apPendingMaps[GameID] = pMap;
+	else if(IsGameLoading(GameID))
+		InitGame(GameID, pMap);
+	else
+		SwapGameMap(GameID, pMap);
+	return true;
+}
 
-			for(int c = 0; c < MAX_CLIENTS; c++)
-			{
-				aPreferedTeams[c] = GameServer()->PreferedTeamPlayer(c);
-			}
 
-			// new map loaded
-			g->GameServer()->OnShutdown();
+sGame* CServer::GetGame(unsigned int GameID){
+	if(GameID >= MAX_GAMES || m_aGameSlots[GameID] < 0)
+		return NULL;
+	return m_apGames[m_aGameSlots[GameID]];
+}
 
-			for(int c = 0; c < MAX_CLIENTS; c++)
-			{
-				if(m_aClients[c].m_State <= CClient::STATE_AUTH || m_aClients[c].m_uiGameID != GameID)
-					continue;
+sMap* CServer::GetGameMap(unsigned int GameID){
+	return GameID < MAX_GAMES ? m_apGameMaps[GameID] : NULL;
+}
 
-				m_aClients[c].m_uiGameID = GameID;
-				SendMap(c, GameID);
-				m_aClients[c].Reset();
-				m_aClients[c].m_State = CClient::STATE_CONNECTING;
-				m_aClients[c].m_PreferedTeam = aPreferedTeams[c];
-			}
-			
-			sMap* pMap = m_pMaps;
-			while(pMap){
-				if(pMap->m_uiGameID == GameID) break;
-				pMap = pMap->m_pNextMap;
-			}
-			
-			if(pMap) g->GameServer()->OnInit(Kernel(), pMap->m_pMap, g->GameServer()->m_Config);
-			
-			return true;
-		} else return false;
-	} else return false;
+sMap* CServer::GetPendingMap(unsigned int GameID){
+	return GameID < MAX_GAMES ? m_apPendingMaps[GameID] : NULL;
 }
 
+void CServer::SetClientGame(int ClientID, unsigned int GameID)
+{
+	CClient *pClient = &m_aClients[ClientID];
 
-sGame* CServer::GetGame(unsigned int GameID){
-	sGame* p = m_pGames;
-	while(p != NULL){
-		if(p->m_uiGameID == GameID){
-			return p;
-		}
-		p = p->m_pNext;
+	// leave the old game, the last client takes over the free spot
+	if(pClient->m_GameClientSlot >= 0)
+	{
+		unsigned int OldGameID = pClient->m_uiGameID;
+		int Last = m_aaGameClients[OldGameID][--m_aNumGameClients[OldGameID]];
+		m_aaGameClients[OldGameID][pClient->m_GameClientSlot] = Last;
+		m_aClients[Last].m_GameClientSlot = pClient->m_GameClientSlot;
+		pClient->m_GameClientSlot = -1;
+	}
+
+	pClient->m_uiGameID = GameID;
+	m_ServerInfoDirty = true;
+	if(GameID < MAX_GAMES)
+	{
+		pClient->m_GameClientSlot = m_aNumGameClients[GameID];
+		m_aaGameClients[GameID][m_aNumGameClients[GameID]++] = ClientID;
 	}
-	return NULL;
+}
+
+int CServer::GetGameClients(unsigned int GameID, int *pClients)
+{
+	if(GameID >= MAX_GAMES)
+		return 0;
+	mem_copy(pClients, m_aaGameClients[GameID], m_aNumGameClients[GameID]*sizeof(int));
+	return m_aNumGameClients[GameID];
 }
 
 int CServer::SnapNewID()
 {
+	std::lock_guard<std::recursive_mutex> Lock(m_EngineLock);
 	return m_IDPool.NewID();
 }
 
 void CServer::SnapFreeID(int ID)
 {
+	std::lock_guard<std::recursive_mutex> Lock(m_EngineLock);
 	m_IDPool.FreeID(ID);
 }
 
@@ -2505,6 +3432,7 @@ void *CServer::SnapNewItem(int Type, int ID, int Size)
 void CServer::SnapSetStaticsize(int ItemType, int Size)
 {
 	m_SnapshotDelta.SetStaticsize(ItemType, Size);
+	m_DemoWriter.SetStaticsize(ItemType, Size);
 }
 
 static CServer *CreateServer() { return new CServer(); }
@@ -2593,65 +3521,8 @@ int main(int argc, const char **argv) // ignore_convention
 	delete pEngineMasterServer;
 	delete pStorage;
 	delete pConfig;
+
+	// write what is still queued, the threads that print are gone now
+	dbg_logger_async_stop();
 	return 0;
 }
-
-static size_t WriteCallback(char *contents, size_t size, size_t nmemb, void *userp)
-{
-    strcat((char*)userp, contents);
-    return size * nmemb;
-}
-
-bool CServer::IsProxy(const NETADDR *pAddr)
-{
-    char aAddrStr[NETADDR_MAXSTRSIZE];
-    net_addr_str(pAddr, aAddrStr, sizeof(aAddrStr), false);
-
-    char aUrl[256];
-    str_format(aUrl, sizeof(aUrl), "https://proxycheck.io/v2/%s", aAddrStr);
-
-    CURL *curl = curl_easy_init();
-    if(!curl)
-        return false;
-
-    char aResponse[4096] = {0};
-    curl_easy_setopt(curl, CURLOPT_URL, aUrl);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, aResponse);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 15);
-
-    CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-
-    if(res != CURLE_OK)
-        return false;
-
-    // Check for both status:ok and proxy:yes
-    bool IsProxy = str_find_nocase(aResponse, "\"status\":\"ok\"") && 
-                  str_find_nocase(aResponse, "\"proxy\":\"yes\"");
-
-    if(IsProxy)
-    {
-        char aBuf[256];
-        str_format(aBuf, sizeof(aBuf), "Proxy detected: %s", aAddrStr);
-        Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "antiproxy", aBuf);
-        
-        if(g_Config.m_SvProxyCheckBan)
-        {
-            char aReason[128];
-            str_format(aReason, sizeof(aReason), "Proxy/VPN detected");
-            m_NetServer.NetBan()->BanAddr(pAddr, -1, aReason);
-            
-            str_format(aBuf, sizeof(aBuf), "Banned proxy: %s", aAddrStr);
-            Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "antiproxy", aBuf);
-        }
-    }
-    else
-    {
-        char aBuf[256];
-        str_format(aBuf, sizeof(aBuf), "No proxy detected: %s", aAddrStr);
-        Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "antiproxy", aBuf);
-    }
-
-    return IsProxy;
-}
\ No newline at end of file
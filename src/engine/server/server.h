@@ -5,6 +5,15 @@
 
 #include <engine/server.h>
 #include <engine/server/databases/connection_pool.h>
+#include <engine/server/demowriter.h>
+#include <engine/server/maploader.h>
+#include <engine/server/profiler.h>
+#include <engine/server/proxycheck.h>
+#include <engine/server/snapcache.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 
 class CSnapIDPool
@@ -60,19 +69,121 @@ public:
 	static void ConBanExt(class IConsole::IResult *pResult, void *pUser);
 };
 
+/*
+	Class: Game thread
+		Runs the ticks of one game instance when sv_game_threads is
+		set. Messages the game sends and engine actions it triggers
+		are queued here and handed to the main thread after the tick.
+*/
+class CGameThread
+{
+public:
+	enum
+	{
+		PHASE_TICK=0,
+		PHASE_PRESNAP,
+
+		ACTION_KICK=0,
+		ACTION_BAN,
+		ACTION_STOPGAME,
+		ACTION_MOVEPLAYER,
+		ACTION_CHANGEMAP,
+		ACTION_KICKCONNECTING,
+		ACTION_AUTODEMO,
+		ACTION_STARTGAME,
+	};
+
+	class CInput
+	{
+	public:
+		int m_ClientID;
+		int m_aData[MAX_INPUT_SIZE];
+	};
+
+	class CQueuedMsg
+	{
+	public:
+		int m_ClientID;
+		int m_Flags;
+		bool m_System;
+		int m_Offset;
+		int m_Size;
+	};
+
+	class CAction
+	{
+	public:
+		int m_Type;
+		int m_ClientID;
+		unsigned int m_GameID;
+		int m_Param;
+		NETADDR m_Addr;
+		char m_aStr[128];
+		struct CConfiguration *m_pConfig;
+	};
+
+	class CServer *m_pServer;
+	sGame *m_pGame;
+	void *m_pThread;
+	int m_Phase;
+	std::atomic_bool m_Shutdown;
+	CSemaphore m_Start;
+	// duration of the last phase, for the profiler
+	int64 m_PhaseTime;
+
+	std::vector<CInput> m_lInputs;
+	std::vector<CQueuedMsg> m_lMsgs;
+	std::vector<unsigned char> m_MsgData;
+	std::vector<CAction> m_lActions;
+
+	CGameThread(class CServer *pServer, sGame *pGame);
+
+	void QueueMsg(CMsgPacker *pMsg, int Flags, int ClientID, bool System);
+	void QueueAction(int Type, int ClientID, unsigned int GameID, int Param, const char *pStr, const NETADDR *pAddr = 0);
+};
+
 class CServer : public IServer
 {
-	sGame *m_pGames;
-	sMap *m_pMaps;
+	friend class CGameThread;
+
+	enum
+	{
+		MAX_GAMES=64,
+	};
+
+	// game registry, game ids index m_aGameSlots and the slots in
+	// m_apGames are kept dense. game 0 is the main game and always slot 0
+	sGame *m_apGames[MAX_GAMES];
+	int m_NumGames;
+	int m_aGameSlots[MAX_GAMES];
+	int m_aFreeGameIDs[MAX_GAMES];
+	int m_NumFreeGameIDs;
+
+	// maps of the additional games, game 0 uses m_aCurrentMap.
+	// games on the same map share one refcounted entry of the map store
+	sMap *m_apGameMaps[MAX_GAMES];
+	sMap *m_apStoredMaps[MAX_GAMES];
+	int m_NumStoredMaps;
+
+	// maps still in the loader. a game without a map isn't initialized
+	// yet, its clients wait in STATE_CONNECTING until the map is ready
+	sMap *m_apPendingMaps[MAX_GAMES];
+	struct CConfiguration *m_apPendingConfigs[MAX_GAMES];
+
+	// clients of every game, see SetClientGame()
+	int m_aaGameClients[MAX_GAMES][MAX_CLIENTS];
+	int m_aNumGameClients[MAX_GAMES];
+
 	class IConsole *m_pConsole;
 	class IStorage *m_pStorage;
 
 	int m_PlayerCount;
 private:
 	CDbConnectionPool m_DbPool;
+	bool m_DbEnabled;
 
 public:
-	class IGameServer *GameServer() { return m_pGames->m_pGameServer; }
+	class IGameServer *GameServer() { return m_apGames[0]->m_pGameServer; }
 	class IConsole *Console() { return m_pConsole; }
 	class IStorage *Storage() { return m_pStorage; }
 
@@ -88,6 +199,9 @@ public:
 	enum {
 		VANILLA_MAX_CLIENTS = 16,
 		DDNET_MAX_CLIENTS = 64,
+		// clients per 64 slot response, more don't fit into one packet
+		SERVERINFO64_CHUNK_CLIENTS = 24,
+		NUM_SERVERINFO64_CHUNKS = (DDNET_MAX_CLIENTS+SERVERINFO64_CHUNK_CLIENTS-1)/SERVERINFO64_CHUNK_CLIENTS,
 	};
 
 	class CClient
@@ -105,7 +219,10 @@ public:
 
 			SNAPRATE_INIT=0,
 			SNAPRATE_FULL,
-			SNAPRATE_RECOVER
+			SNAPRATE_RECOVER,
+
+			// inputs are kept at the index of their tick, up to this many ticks ahead
+			INPUT_RING_SIZE=200,
 		};
 
 		class CInput
@@ -131,8 +248,13 @@ public:
 		CSnapshotStorage m_Snapshots;
 
 		CInput m_LatestInput;
-		CInput m_aInputs[200]; // TODO: handle input better
-		int m_CurrentInput;
+		CInput m_aInputs[INPUT_RING_SIZE];
+		// input timing since the client (re)joined, see the inputstatus command
+		int m_NumInputsApplied;
+		int m_NumInputsMissing; // ingame ticks without an input
+		int m_NumInputsLate; // arrived after their tick, used for the next one
+		int m_NumInputsEarly; // too far ahead for the ring, dropped
+		int m_NumInputsDuplicate; // replaced an input for the same tick
 
 		char m_aName[MAX_NAME_LENGTH];
 		char m_aClan[MAX_CLAN_LENGTH];
@@ -142,6 +264,8 @@ public:
 		int m_UnknownFlags;
 		int m_Authed;
 		int m_AuthTries;
+		bool m_ProxyDetected;
+		int m_GameClientSlot;
 
 		const IConsole::CCommandInfo *m_pRconCmdToSend;
 
@@ -164,6 +288,9 @@ public:
 	int m_RunServer;
 	int m_StopServerWhenEmpty;
 	int m_MapReload;
+	// set when sv_map was changed, the map is loaded if it's a new one
+	int m_MapChange;
+	NETWAIT *m_pNetWait;
 	int m_RconClientID;
 	int m_RconAuthLevel;
 	int m_PrintCBIndex;
@@ -173,16 +300,91 @@ public:
 
 	char m_aCurrentMap[64];
 	unsigned m_CurrentMapCrc;
-	unsigned char *m_pCurrentMapData;
+	// points into the loaded map
+	const unsigned char *m_pCurrentMapData;
 	int m_CurrentMapSize;
 
-	CDemoRecorder m_DemoRecorder;
+	// the server info of the vanilla response and the chunks of the 64
+	// slot response without the token, only packed again after something
+	// in it changed, game threads mark it too
+	CPacker m_aServerInfoCache[1+NUM_SERVERINFO64_CHUNKS];
+	int m_NumServerInfo64Chunks;
+	std::atomic_bool m_ServerInfoDirty;
+
+	CDemoWriter m_DemoWriter;
+	// game whose code runs on the main thread, messages to all clients
+	// go to its demo, GAME_ID_INVALID drops them
+	unsigned int m_CurrentGameID;
+	// sets m_CurrentGameID for the lifetime of the scope
+	class CGameScope
+	{
+		CServer *m_pServer;
+		unsigned int m_OldGameID;
+	public:
+		CGameScope(CServer *pServer, unsigned int GameID) : m_pServer(pServer), m_OldGameID(pServer->m_CurrentGameID) { pServer->m_CurrentGameID = GameID; }
+		~CGameScope() { m_pServer->m_CurrentGameID = m_OldGameID; }
+	};
 	CRegister m_Register;
 	CMapChecker m_MapChecker;
+	CProxyCheck m_ProxyCheck;
+	CMapLoader m_MapLoader;
+	CTickProfiler m_Profiler;
+	// network counters at the last tick, for the per tick counts of the profiler
+	NETSTATS m_ProfilerNetStats;
+	int m_ProfilerSnapAllocs;
+	int m_ProfilerSnapsShared;
+	int m_ProfilerDeltasReused;
+
+	// snapshot delta and compression of one client, see DoSnapshot()
+	class CSnapJob
+	{
+	public:
+		int m_ClientID;
+		int m_Crc;
+		int m_DeltaTick;
+		CSnapshot *m_pFrom;
+		CSnapshot *m_pTo;
+		// job with the same snapshots whose data is sent instead, -1 if none
+		int m_SourceJob;
+		int m_CompSize;
+		int64 m_DeltaTime;
+		int64 m_CompressTime;
+		char m_aDeltaData[CSnapshot::MAX_SIZE];
+		char m_aCompData[CSnapshot::MAX_SIZE];
+	};
+
+	CSnapJob *m_pSnapJobs;
+	int m_NumSnapJobs;
+	// snapshot data shared by content between the clients
+	CSnapshotPool m_SnapshotPool;
+	CSnapDeltaCache m_SnapDeltaCache;
+	int m_NumDeltasReused;
+	std::atomic_int m_NextSnapJob;
+	std::vector<void *> m_lSnapWorkers;
+	std::atomic_bool m_SnapWorkShutdown;
+	CSemaphore m_SnapWorkStart;
+	CSemaphore m_SnapWorkDone;
+
+	static void SnapWorkerThread(void *pUser);
+	void RunSnapJob(CSnapJob *pJob);
+	void ProcessSnapJobs();
+	// joins the workers and frees the jobs
+	void StopSnapWorkers();
+
+	// game instances ticking on their own threads, see RunGameThreads()
+	std::recursive_mutex m_EngineLock;
+	CSemaphore m_GameThreadsDone;
+
+	static void GameThread(void *pUser);
+	CGameThread *GetGameThread(sGame *pGame);
+	void StopGameThread(sGame *pGame);
+	void RunGameThreads(int Phase);
+	void RunGameAction(const CGameThread::CAction *pAction);
 
 	CServer();
+	~CServer();
 
-	virtual int BanAddr(const NETADDR *pAddr, int Seconds, const char *pReason, bool Force = true) { return m_ServerBan.BanAddr(pAddr, Seconds, pReason, Force); }
+	virtual int BanAddr(const NETADDR *pAddr, int Seconds, const char *pReason, bool Force = true);
 	virtual void GetNetAddr(NETADDR *pAddr, int ClientID){ *pAddr = *m_NetServer.ClientAddr(ClientID); }
 
 	int TrySetClientName(int ClientID, const char *pName);
@@ -193,12 +395,17 @@ public:
 	virtual void SetClientScore(int ClientID, int Score);
 	virtual void SetClientVersion(int ClientID, int Version);
 	virtual void SetClientUnknownFlags(int ClientID, int UnknownFlags);
+	virtual void ExpireServerInfo() { m_ServerInfoDirty = true; }
 
 	void Kick(int ClientID, const char *pReason);
 	void KickForce(int ClientID, const char *pReason);
 
-	void DemoRecorder_HandleAutoStart();
-	bool DemoRecorder_IsRecording();
+	// id of the game of a game server, GAME_ID_INVALID if it isn't running
+	unsigned int GameIDOf(IGameServer *pGameServer);
+	void StartDemo(unsigned int GameID, const char *pFilename);
+	void AutoStartDemo(unsigned int GameID);
+	void DemoRecorder_HandleAutoStart(IGameServer *pGameServer);
+	bool DemoRecorder_IsRecording(IGameServer *pGameServer);
 
 	//int Tick()
 	int64 TickStartTime(int Tick);
@@ -220,6 +427,7 @@ public:
 	int SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System);
 
 	void DoSnapshot();
+	void SendSnapshot(int ClientID, int DeltaTick, int Crc, const char *pCompData, int CompSize);
 
 	static int NewClientCallbackImpl(int ClientID, void *pUser);
 	static int NewClientCallback(int ClientID, void *pUser);
@@ -238,6 +446,10 @@ public:
 
 	void ProcessClientPacket(CNetChunk *pPacket);
 
+	// packs the server info that follows the token of the response
+	// the 64 slot response lists the clients from Offset on, returns the
+	// number of clients the response can list in total
+	int PackServerInfo(CPacker *pPacker, bool Extended, int Offset = 0);
 	void SendServerInfo(const NETADDR *pAddr, int Token, bool Extended);
 	void UpdateServerInfo();
 
@@ -245,8 +457,13 @@ public:
 
 	char *GetMapName();
 	int LoadMap(const char *pMapName);
-	class IMap* LoadAndGetMap(const char *pMapName, unsigned int pGameID);
-	bool ChangeMap(const char *pMapName, unsigned int pGameID);
+	// size and modification time of the file of a map
+	bool MapFileInfo(const char *pMapName, int *pSize, int64 *pTime);
+	sMap *AcquireMap(const char *pMapName);
+	void ReleaseMap(sMap *pMap);
+	void InitGame(unsigned int GameID, sMap *pMap);
+	void SwapGameMap(unsigned int GameID, sMap *pMap);
+	void UpdateMapLoader();
 
 	void InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, IConsole *pConsole);
 	int Run();
@@ -256,6 +473,13 @@ public:
 	static void ConStopGame(IConsole::IResult *pResult, void *pUser);
 	static void ConMovePlayerToGame(IConsole::IResult *pResult, void *pUser);
 	static void ConServerStatus(IConsole::IResult *pResult, void *pUser);
+	static void ConSqlStatus(IConsole::IResult *pResult, void *pUser);
+	static void ConInputStatus(IConsole::IResult *pResult, void *pUser);
+	static void ConProfile(IConsole::IResult *pResult, void *pUser);
+	static void ConProfileDump(IConsole::IResult *pResult, void *pUser);
+	static void ProfilePrintLine(const char *pLine, void *pUser);
+	static void ProfileWriteLine(const char *pLine, void *pUser);
+	bool DumpProfile(const char *pFilename);
 	static void ConStatus(IConsole::IResult *pResult, void *pUser);
 	static void ConShutdown(IConsole::IResult *pResult, void *pUser);
 	static void ConShutdownEmpty(IConsole::IResult *pResult, void *pUser);
@@ -263,6 +487,7 @@ public:
 	static void ConStopRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConMapReload(IConsole::IResult *pResult, void *pUser);
 	static void ConLogout(IConsole::IResult *pResult, void *pUser);
+	static void ConchainMapUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainSpecialInfoupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainMaxclientsperipUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainModCommandUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
@@ -278,15 +503,21 @@ public:
 	virtual bool CheckForConnectingPlayers(unsigned int GameID);
 
 	virtual struct sGame* GetGame(unsigned int GameID);
+	sMap *GetGameMap(unsigned int GameID);
+	sMap *GetPendingMap(unsigned int GameID);
+	bool IsGameLoading(unsigned int GameID) { return GameID != 0 && GameID < MAX_GAMES && !m_apGameMaps[GameID]; }
+	void SetClientGame(int ClientID, unsigned int GameID);
+	int GetGameClients(unsigned int GameID, int *pClients);
 
 	virtual int SnapNewID();
 	virtual void SnapFreeID(int ID);
 	virtual void *SnapNewItem(int Type, int ID, int Size);
 	void SnapSetStaticsize(int ItemType, int Size);
 
-	bool IsProxy(const NETADDR *pAddr);
+	void CheckProxy(int ClientID);
+	void UpdateProxyCheck();
 
-	CDbConnectionPool *DbPool() { return &m_DbPool; }
+	virtual CDbConnectionPool *DbPool() { return m_DbEnabled ? &m_DbPool : 0; }
 };
 
 #endif
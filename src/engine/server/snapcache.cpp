@@ -0,0 +1,81 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include "snapcache.h"
+
+CSnapDeltaCache::CSnapDeltaCache()
+{
+	m_pData = 0;
+	m_DataCapacity = 0;
+	Clear();
+}
+
+CSnapDeltaCache::~CSnapDeltaCache()
+{
+	if(m_pData)
+		mem_free(m_pData);
+}
+
+void CSnapDeltaCache::Clear()
+{
+	for(int i = 0; i < NUM_BUCKETS; i++)
+		m_aBuckets[i] = -1;
+	m_NumEntries = 0;
+	m_DataSize = 0;
+}
+
+unsigned CSnapDeltaCache::Hash(const CSnapshot *pFrom, const CSnapshot *pTo)
+{
+	unsigned long long Key = ((unsigned long long)(size_t)pFrom*31)^(unsigned long long)(size_t)pTo;
+	Key *= 0x9e3779b97f4a7c15ull;
+	return (unsigned)(Key>>40)&(NUM_BUCKETS-1);
+}
+
+CSnapDeltaCache::CEntry *CSnapDeltaCache::Find(const CSnapshot *pFrom, const CSnapshot *pTo)
+{
+	for(int i = m_aBuckets[Hash(pFrom, pTo)]; i != -1; i = m_aEntries[i].m_Next)
+		if(m_aEntries[i].m_pFrom == pFrom && m_aEntries[i].m_pTo == pTo)
+			return &m_aEntries[i];
+	return 0;
+}
+
+CSnapDeltaCache::CEntry *CSnapDeltaCache::Add(const CSnapshot *pFrom, const CSnapshot *pTo)
+{
+	if(m_NumEntries == MAX_CLIENTS)
+		return 0;
+
+	unsigned Bucket = Hash(pFrom, pTo);
+	CEntry *pEntry = &m_aEntries[m_NumEntries];
+	pEntry->m_pFrom = pFrom;
+	pEntry->m_pTo = pTo;
+	pEntry->m_Job = -1;
+	pEntry->m_DataOffset = 0;
+	pEntry->m_DataSize = 0;
+	pEntry->m_Next = m_aBuckets[Bucket];
+	m_aBuckets[Bucket] = m_NumEntries++;
+	return pEntry;
+}
+
+void CSnapDeltaCache::SetData(CEntry *pEntry, const void *pData, int Size)
+{
+	if(m_DataSize+Size > m_DataCapacity)
+	{
+		int Capacity = max(m_DataCapacity*2, 16*1024);
+		while(Capacity < m_DataSize+Size)
+			Capacity *= 2;
+		char *pNewData = (char *)mem_alloc(Capacity, 1);
+		if(m_pData)
+		{
+			mem_copy(pNewData, m_pData, m_DataSize);
+			mem_free(m_pData);
+		}
+		m_pData = pNewData;
+		m_DataCapacity = Capacity;
+	}
+
+	mem_copy(m_pData+m_DataSize, pData, Size);
+	pEntry->m_DataOffset = m_DataSize;
+	pEntry->m_DataSize = Size;
+	m_DataSize += Size;
+}
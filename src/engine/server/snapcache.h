@@ -0,0 +1,67 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SERVER_SNAPCACHE_H
+#define ENGINE_SERVER_SNAPCACHE_H
+
+#include <base/system.h>
+#include <engine/shared/protocol.h>
+
+class CSnapshot;
+
+/*
+	Class: Snapshot delta cache
+		Remembers the compressed deltas made during one snapshot tick
+		by the snapshots they go from and to. Stored snapshots with
+		the same content share their address in the snapshot pool, so
+		clients with the same view and the same acked view find the
+		delta of the first one and don't make their own. Cleared at
+		the start of every snapshot tick.
+*/
+class CSnapDeltaCache
+{
+public:
+	class CEntry
+	{
+	public:
+		const CSnapshot *m_pFrom;
+		const CSnapshot *m_pTo;
+		// the snapshot job making the delta, -1 if it's made in place
+		int m_Job;
+		int m_DataOffset;
+		int m_DataSize;
+		int m_Next;
+	};
+
+	enum
+	{
+		NUM_BUCKETS=512,
+	};
+
+private:
+	int m_aBuckets[NUM_BUCKETS];
+	CEntry m_aEntries[MAX_CLIENTS];
+	int m_NumEntries;
+
+	// compressed data of the entries, reused every tick
+	char *m_pData;
+	int m_DataSize;
+	int m_DataCapacity;
+
+	static unsigned Hash(const CSnapshot *pFrom, const CSnapshot *pTo);
+
+public:
+	CSnapDeltaCache();
+	~CSnapDeltaCache();
+
+	void Clear();
+
+	// 0 if no delta between the two snapshots was made this tick
+	CEntry *Find(const CSnapshot *pFrom, const CSnapshot *pTo);
+	// 0 if the cache is full
+	CEntry *Add(const CSnapshot *pFrom, const CSnapshot *pTo);
+
+	void SetData(CEntry *pEntry, const void *pData, int Size);
+	const char *Data(const CEntry *pEntry) const { return m_pData+pEntry->m_DataOffset; }
+};
+
+#endif
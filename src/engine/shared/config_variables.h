@@ -13,6 +13,9 @@ MACRO_CONFIG_STR(PlayerClan, player_clan, 12, "", CFGFLAG_SAVE|CFGFLAG_CLIENT, "
 MACRO_CONFIG_INT(PlayerCountry, player_country, -1, -1, 1000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Country of the player")
 MACRO_CONFIG_STR(Password, password, 32, "", CFGFLAG_CLIENT|CFGFLAG_SERVER, "Password to the server")
 MACRO_CONFIG_STR(Logfile, logfile, 128, "", CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Filename to log all output to")
+MACRO_CONFIG_INT(LogfileMaxSize, logfile_max_size, 0, 0, 1024*1024, CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Start a new logfile once it has this many KiB (0 for no limit)")
+MACRO_CONFIG_INT(LogfileMaxAge, logfile_max_age, 0, 0, 7*24*60, CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Start a new logfile once it is this many minutes old (0 for no limit)")
+MACRO_CONFIG_INT(LogAsync, log_async, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT|CFGFLAG_SERVER, "Write the log on a separate thread (lines are dropped while its queue is full)")
 MACRO_CONFIG_INT(ConsoleOutputLevel, console_output_level, 0, 0, 2, CFGFLAG_CLIENT|CFGFLAG_SERVER, "Adjusts the amount of information in the console")
 
 MACRO_CONFIG_INT(ClCpuThrottle, cl_cpu_throttle, 0, 0, 100, CFGFLAG_SAVE|CFGFLAG_CLIENT, "")
@@ -86,6 +89,8 @@ MACRO_CONFIG_INT(SvExternalPort, sv_external_port, 0, 0, 0, CFGFLAG_SERVER, "Ext
 MACRO_CONFIG_STR(SvMap, sv_map, 128, "AliveFNG", CFGFLAG_SERVER, "Map to use on the server")
 MACRO_CONFIG_INT(SvMaxClients, sv_max_clients, 8, 1, MAX_CLIENTS, CFGFLAG_SERVER, "Maximum number of clients that are allowed on a server")
 MACRO_CONFIG_INT(SvMaxClientsPerIP, sv_max_clients_per_ip, 4, 1, MAX_CLIENTS, CFGFLAG_SERVER, "Maximum number of clients with the same IP that can connect to the server")
+MACRO_CONFIG_INT(SvConnlessRate, sv_connless_rate, 20, 0, 1000, CFGFLAG_SERVER, "Connectionless packets (like server info requests) per second accepted from one IP (0 for no limit)")
+MACRO_CONFIG_INT(SvConnlessBurst, sv_connless_burst, 40, 1, 1000, CFGFLAG_SERVER, "Connectionless packets one IP can send at once before sv_connless_rate applies")
 MACRO_CONFIG_INT(SvHighBandwidth, sv_high_bandwidth, 0, 0, 1, CFGFLAG_SERVER, "Use high bandwidth mode. Doubles the bandwidth required for the server. LAN use only")
 MACRO_CONFIG_INT(SvRegister, sv_register, 1, 0, 1, CFGFLAG_SERVER, "Register server with master server for public listing")
 MACRO_CONFIG_STR(SvRconPassword, sv_rcon_password, 32, "", CFGFLAG_SERVER, "Remote console password (full access)")
@@ -130,7 +135,20 @@ MACRO_CONFIG_INT(SvLaserBounceDelay, sv_laser_bounce_delay, 150, 0, 150, CFGFLAG
 MACRO_CONFIG_STR(SvApiKey, sv_api_key, 32, "your_api_key_here", CFGFLAG_SERVER, "API key for the website")
 MACRO_CONFIG_INT(SvProxyCheck, sv_proxy_check, 0, 0, 1, CFGFLAG_SERVER, "Check if connecting clients are using a proxy/VPN")
 MACRO_CONFIG_INT(SvProxyCheckBan, sv_proxy_check_ban, 0, 0, 1, CFGFLAG_SERVER, "Ban proxies permanently when detected")
+MACRO_CONFIG_STR(SvProxyCheckUrl, sv_proxy_check_url, 128, "https://proxycheck.io/v2/", CFGFLAG_SERVER, "Proxy check endpoint, the address gets appended")
+MACRO_CONFIG_STR(SvProxyCheckKey, sv_proxy_check_key, 64, "", CFGFLAG_SERVER, "Key for the proxy check endpoint, sent as key parameter if set")
+MACRO_CONFIG_INT(SvProxyCheckTimeout, sv_proxy_check_timeout, 15, 1, 60, CFGFLAG_SERVER, "Timeout in seconds for a proxy lookup")
+MACRO_CONFIG_INT(SvProxyCheckTTL, sv_proxy_check_ttl, 3600, 60, 604800, CFGFLAG_SERVER, "Time in seconds proxy check verdicts are cached")
 
 // Database
 MACRO_CONFIG_INT(SvUseSql, sv_use_sql, 0, 0, 1, CFGFLAG_SERVER, "Use SQLite database")
-MACRO_CONFIG_STR(SvSqliteFile, sv_sqlite_file, 128, "fng-server.sqlite", CFGFLAG_SERVER, "Path to the SQLite database file")
\ No newline at end of file
+MACRO_CONFIG_STR(SvSqliteFile, sv_sqlite_file, 128, "fng-server.sqlite", CFGFLAG_SERVER, "Path to the SQLite database file")
+MACRO_CONFIG_INT(SvSqlWorkers, sv_sql_workers, 2, 1, 16, CFGFLAG_SERVER, "Number of database worker threads, each with its own connection")
+MACRO_CONFIG_INT(SvRatingFlushInterval, sv_rating_flush_interval, 30, 1, 3600, CFGFLAG_SERVER, "Seconds between writes of collected ratings and stats to the database")
+// Performance
+MACRO_CONFIG_INT(SvGameThreads, sv_game_threads, 0, 0, 1, CFGFLAG_SERVER, "Tick every game instance on its own thread")
+MACRO_CONFIG_INT(SvSnapDedup, sv_snap_dedup, 1, 0, 1, CFGFLAG_SERVER, "Make one snapshot delta for all clients with the same view and the same acked view")
+MACRO_CONFIG_INT(SvSnapThreads, sv_snap_threads, 0, 0, 16, CFGFLAG_SERVER, "Number of worker threads for snapshot delta and compression (0 = main thread only)")
+MACRO_CONFIG_INT(SvEventLoop, sv_event_loop, 1, 0, 1, CFGFLAG_SERVER, "Sleep until the next tick or network data instead of polling every 5 ms")
+MACRO_CONFIG_INT(SvNetBatch, sv_net_batch, 1, 0, 1, CFGFLAG_SERVER, "Receive and send UDP packets in batches, one system call for many packets on Linux")
+MACRO_CONFIG_STR(SvProfilerFile, sv_profiler_file, 128, "", CFGFLAG_SERVER, "File the tick profile is written to every few seconds, empty to disable")
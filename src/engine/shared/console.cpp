@@ -192,18 +192,61 @@ void CConsole::SetPrintOutputLevel(int Index, int OutputLevel)
 		m_aPrintCB[Index].m_OutputLevel = clamp(OutputLevel, (int)(OUTPUT_LEVEL_STANDARD), (int)(OUTPUT_LEVEL_DEBUG));
 }
 
-void CConsole::Print(int Level, const char *pFrom, const char *pStr)
+void CConsole::RunPrintCallbacks(int Level, const char *pLine)
 {
-	dbg_msg(pFrom ,"%s", pStr);
 	for(int i = 0; i < m_NumPrintCB; ++i)
 	{
 		if(Level <= m_aPrintCB[i].m_OutputLevel && m_aPrintCB[i].m_pfnPrintCallback)
+			m_aPrintCB[i].m_pfnPrintCallback(pLine, m_aPrintCB[i].m_pPrintCallbackUserdata);
+	}
+}
+
+void CConsole::FlushPrintQueue()
+{
+	std::vector<CQueuedPrint> lQueue;
+	{
+		std::lock_guard<std::mutex> QueueLock(m_PrintQueueLock);
+		if(m_lPrintQueue.empty())
+			return;
+		lQueue.swap(m_lPrintQueue);
+	}
+	for(unsigned i = 0; i < lQueue.size(); i++)
+		RunPrintCallbacks(lQueue[i].m_Level, lQueue[i].m_aLine);
+}
+
+void CConsole::Print(int Level, const char *pFrom, const char *pStr)
+{
+	// the log doesn't need the lock
+	dbg_msg(pFrom ,"%s", pStr);
+
+	char aBuf[1024];
+	str_format(aBuf, sizeof(aBuf), "[%s]: %s", pFrom, pStr);
+	if(!m_pExecutionLock)
+	{
+		RunPrintCallbacks(Level, aBuf);
+		return;
+	}
+
+	// don't wait for a command that runs on another thread, whoever
+	// holds the lock runs the callbacks before releasing it
+	std::unique_lock<std::recursive_mutex> Lock(*m_pExecutionLock, std::try_to_lock);
+	if(!Lock.owns_lock())
+	{
 		{
-			char aBuf[1024];
-			str_format(aBuf, sizeof(aBuf), "[%s]: %s", pFrom, pStr);
-			m_aPrintCB[i].m_pfnPrintCallback(aBuf, m_aPrintCB[i].m_pPrintCallbackUserdata);
+			std::lock_guard<std::mutex> QueueLock(m_PrintQueueLock);
+			CQueuedPrint Queued;
+			Queued.m_Level = Level;
+			str_copy(Queued.m_aLine, aBuf, sizeof(Queued.m_aLine));
+			m_lPrintQueue.push_back(Queued);
 		}
+		// the holder may have flushed before the line got queued
+		if(Lock.try_lock())
+			FlushPrintQueue();
+		return;
 	}
+
+	FlushPrintQueue();
+	RunPrintCallbacks(Level, aBuf);
 }
 
 bool CConsole::LineIsValid(const char *pStr)
@@ -257,6 +300,7 @@ bool CConsole::LineIsValid(const char *pStr)
 
 void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
 {
+	CExecutionLock Lock(this);
 	while(pStr && *pStr)
 	{
 		CResult Result;
@@ -378,6 +422,7 @@ void CConsole::ExecuteLine(const char *pStr)
 
 void CConsole::ExecuteLineFlag(const char *pStr, int FlagMask)
 {
+	CExecutionLock Lock(this);
 	int Temp = m_FlagMask;
 	m_FlagMask = FlagMask;
 	ExecuteLine(pStr);
@@ -659,6 +704,7 @@ CConsole::CConsole(int FlagMask)
 	m_NumPrintCB = 0;
 
 	m_pStorage = 0;
+	m_pExecutionLock = 0;
 
 	// register some basic commands
 	Register("echo", "r", CFGFLAG_SERVER|CFGFLAG_CLIENT, Con_Echo, this, "Echo the text");
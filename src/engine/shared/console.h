@@ -6,6 +6,8 @@
 #include <engine/console.h>
 #include "memheap.h"
 
+#include <vector>
+
 class CConsole : public IConsole
 {
 	class CCommand : public CCommandInfo
@@ -48,6 +50,34 @@ class CConsole : public IConsole
 	class IStorage *m_pStorage;
 	int m_AccessLevel;
 
+	std::recursive_mutex *m_pExecutionLock;
+	// holds the execution lock, the queued prints run before it's released
+	class CExecutionLock
+	{
+		CConsole *m_pConsole;
+		std::unique_lock<std::recursive_mutex> m_Lock;
+	public:
+		CExecutionLock(CConsole *pConsole) : m_pConsole(pConsole)
+		{
+			if(pConsole->m_pExecutionLock)
+				m_Lock = std::unique_lock<std::recursive_mutex>(*pConsole->m_pExecutionLock);
+		}
+		~CExecutionLock() { if(m_Lock.owns_lock()) m_pConsole->FlushPrintQueue(); }
+	};
+
+	// lines whose print callbacks couldn't get the execution lock right away
+	class CQueuedPrint
+	{
+	public:
+		int m_Level;
+		char m_aLine[1024];
+	};
+	std::mutex m_PrintQueueLock;
+	std::vector<CQueuedPrint> m_lPrintQueue;
+	void RunPrintCallbacks(int Level, const char *pLine);
+	// runs the callbacks of the queued lines, needs the execution lock
+	void FlushPrintQueue();
+
 	CCommand *m_pRecycleList;
 	CHeap m_TempCommands;
 
@@ -179,6 +209,7 @@ public:
 	virtual void Print(int Level, const char *pFrom, const char *pStr);
 
 	void SetAccessLevel(int AccessLevel) { m_AccessLevel = clamp(AccessLevel, (int)(ACCESS_LEVEL_ADMIN), (int)(ACCESS_LEVEL_MOD)); }
+	void SetExecutionLock(std::recursive_mutex *pLock) { m_pExecutionLock = pLock; }
 };
 
 #endif
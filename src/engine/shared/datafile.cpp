@@ -57,13 +57,16 @@ struct CDatafileInfo
 
 struct CDatafile
 {
-	IOHANDLE m_File;
 	unsigned m_Crc;
 	CDatafileInfo m_Info;
 	CDatafileHeader m_Header;
 	int m_DataStartOffset;
 	char **m_ppDataPtrs;
 	char *m_pData;
+
+	// the whole file, read in one go
+	const char *m_pFile;
+	unsigned m_FileSize;
 };
 
 bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType)
@@ -77,36 +80,38 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 		return false;
 	}
 
-
-	// take the CRC of the file and store it
-	unsigned Crc = 0;
+	// get the whole file into memory once, the crc, the parsing, the
+	// data and the map download all work on that. it's a copy and not
+	// a mapping of the file, the file can be replaced while it's loaded
+	long Length = io_length(File);
+	unsigned FileSize = Length > 0 ? (unsigned)Length : 0;
+	char *pFile = (char *)mem_alloc(max(FileSize, 1u), 1);
+	if(io_read(File, pFile, FileSize) != FileSize)
 	{
-		enum
-		{
-			BUFFER_SIZE = 64*1024
-		};
-
-		unsigned char aBuffer[BUFFER_SIZE];
-
-		while(1)
-		{
-			unsigned Bytes = io_read(File, aBuffer, BUFFER_SIZE);
-			if(Bytes <= 0)
-				break;
-			Crc = crc32(Crc, aBuffer, Bytes); // ignore_convention
-		}
-
-		io_seek(File, 0, IOSEEK_START);
+		io_close(File);
+		mem_free(pFile);
+		dbg_msg("datafile", "couldn't read '%s'", pFilename);
+		return false;
 	}
+	io_close(File);
 
+	// take the CRC of the file and store it
+	unsigned Crc = crc32(0, (const Bytef *)pFile, FileSize); // ignore_convention
 
 	// TODO: change this header
 	CDatafileHeader Header;
-	io_read(File, &Header, sizeof(Header));
+	if(FileSize < sizeof(Header))
+	{
+		mem_free(pFile);
+		dbg_msg("datafile", "file too small. size=%d", FileSize);
+		return false;
+	}
+	mem_copy(&Header, pFile, sizeof(Header));
 	if(Header.m_aID[0] != 'A' || Header.m_aID[1] != 'T' || Header.m_aID[2] != 'A' || Header.m_aID[3] != 'D')
 	{
 		if(Header.m_aID[0] != 'D' || Header.m_aID[1] != 'A' || Header.m_aID[2] != 'T' || Header.m_aID[3] != 'A')
 		{
+			mem_free(pFile);
 			dbg_msg("datafile", "wrong signature. %x %x %x %x", Header.m_aID[0], Header.m_aID[1], Header.m_aID[2], Header.m_aID[3]);
 			return 0;
 		}
@@ -117,17 +122,33 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 #endif
 	if(Header.m_Version != 3 && Header.m_Version != 4)
 	{
+		mem_free(pFile);
 		dbg_msg("datafile", "wrong version. version=%x", Header.m_Version);
 		return 0;
 	}
 
 	// read in the rest except the data
-	unsigned Size = 0;
-	Size += Header.m_NumItemTypes*sizeof(CDatafileItemType);
-	Size += (Header.m_NumItems+Header.m_NumRawData)*sizeof(int);
+	if(Header.m_NumItemTypes < 0 || Header.m_NumItems < 0 || Header.m_NumRawData < 0 || Header.m_ItemSize < 0 || Header.m_DataSize < 0)
+	{
+		mem_free(pFile);
+		dbg_msg("datafile", "invalid header");
+		return false;
+	}
+	unsigned long long WantedSize = 0;
+	WantedSize += (unsigned long long)Header.m_NumItemTypes*sizeof(CDatafileItemType);
+	WantedSize += (unsigned long long)(Header.m_NumItems+(long long)Header.m_NumRawData)*sizeof(int);
 	if(Header.m_Version == 4)
-		Size += Header.m_NumRawData*sizeof(int); // v4 has uncompressed data sizes aswell
-	Size += Header.m_ItemSize;
+		WantedSize += (unsigned long long)Header.m_NumRawData*sizeof(int); // v4 has uncompressed data sizes aswell
+	WantedSize += Header.m_ItemSize;
+
+	// the data is only read on demand, it has to be in the file as well
+	if(sizeof(Header)+WantedSize+Header.m_DataSize > FileSize)
+	{
+		mem_free(pFile);
+		dbg_msg("datafile", "couldn't load the whole thing, wanted=%llu got=%d", WantedSize+Header.m_DataSize, FileSize-(int)sizeof(Header));
+		return false;
+	}
+	unsigned Size = (unsigned)WantedSize;
 
 	unsigned AllocSize = Size;
 	AllocSize += sizeof(CDatafile); // add space for info structure
@@ -138,22 +159,16 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	pTmpDataFile->m_DataStartOffset = sizeof(CDatafileHeader) + Size;
 	pTmpDataFile->m_ppDataPtrs = (char**)(pTmpDataFile+1);
 	pTmpDataFile->m_pData = (char *)(pTmpDataFile+1)+Header.m_NumRawData*sizeof(char *);
-	pTmpDataFile->m_File = File;
+	pTmpDataFile->m_pFile = pFile;
+	pTmpDataFile->m_FileSize = FileSize;
 	pTmpDataFile->m_Crc = Crc;
 
 	// clear the data pointers
 	mem_zero(pTmpDataFile->m_ppDataPtrs, Header.m_NumRawData*sizeof(void*));
 
-	// read types, offsets, sizes and item data
-	unsigned ReadSize = io_read(File, pTmpDataFile->m_pData, Size);
-	if(ReadSize != Size)
-	{
-		io_close(pTmpDataFile->m_File);
-		mem_free(pTmpDataFile);
-		pTmpDataFile = 0;
-		dbg_msg("datafile", "couldn't load the whole thing, wanted=%d got=%d", Size, ReadSize);
-		return false;
-	}
+	// copy types, offsets, sizes and item data, the items get changed
+	// by the game and have to stay apart from the file
+	mem_copy(pTmpDataFile->m_pData, pFile+sizeof(CDatafileHeader), Size);
 
 	Close();
 	m_pDataFile = pTmpDataFile;
@@ -165,7 +180,7 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	//if(DEBUG)
 	{
 		dbg_msg("datafile", "allocsize=%d", AllocSize);
-		dbg_msg("datafile", "readsize=%d", ReadSize);
+		dbg_msg("datafile", "readsize=%d", Size);
 		dbg_msg("datafile", "swaplen=%d", Header.m_Swaplen);
 		dbg_msg("datafile", "item_size=%d", m_pDataFile->m_Header.m_ItemSize);
 	}
@@ -277,37 +292,36 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 		int SwapSize = DataSize;
 #endif
 
+		int Offset = m_pDataFile->m_Info.m_pDataOffsets[Index];
+		if(Offset < 0 || DataSize < 0 || Offset+DataSize > m_pDataFile->m_Header.m_DataSize)
+		{
+			dbg_msg("datafile", "data out of range index=%d offset=%d size=%d", Index, Offset, DataSize);
+			return 0;
+		}
+		const char *pSrc = m_pDataFile->m_pFile+m_pDataFile->m_DataStartOffset+Offset;
+
 		if(m_pDataFile->m_Header.m_Version == 4)
 		{
 			// v4 has compressed data
-			void *pTemp = (char *)mem_alloc(DataSize, 1);
 			unsigned long UncompressedSize = m_pDataFile->m_Info.m_pDataSizes[Index];
 			unsigned long s;
 
 			dbg_msg("datafile", "loading data index=%d size=%d uncompressed=%d", Index, DataSize, UncompressedSize);
 			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(UncompressedSize, 1);
 
-			// read the compressed data
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, pTemp, DataSize);
-
-			// decompress the data, TODO: check for errors
+			// decompress the data straight from the file, TODO: check for errors
 			s = UncompressedSize;
-			uncompress((Bytef*)m_pDataFile->m_ppDataPtrs[Index], &s, (Bytef*)pTemp, DataSize); // ignore_convention
+			uncompress((Bytef*)m_pDataFile->m_ppDataPtrs[Index], &s, (const Bytef*)pSrc, DataSize); // ignore_convention
 #if defined(CONF_ARCH_ENDIAN_BIG)
 			SwapSize = s;
 #endif
-
-			// clean up the temporary buffers
-			mem_free(pTemp);
 		}
 		else
 		{
 			// load the data
 			dbg_msg("datafile", "loading data index=%d size=%d", Index, DataSize);
 			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(DataSize, 1);
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, m_pDataFile->m_ppDataPtrs[Index], DataSize);
+			mem_copy(m_pDataFile->m_ppDataPtrs[Index], pSrc, DataSize);
 		}
 
 #if defined(CONF_ARCH_ENDIAN_BIG)
@@ -410,7 +424,7 @@ bool CDataFileReader::Close()
 	for(i = 0; i < m_pDataFile->m_Header.m_NumRawData; i++)
 		mem_free(m_pDataFile->m_ppDataPtrs[i]);
 
-	io_close(m_pDataFile->m_File);
+	mem_free((void *)m_pDataFile->m_pFile);
 	mem_free(m_pDataFile);
 	m_pDataFile = 0;
 	return true;
@@ -422,6 +436,18 @@ unsigned CDataFileReader::Crc()
 	return m_pDataFile->m_Crc;
 }
 
+const void *CDataFileReader::FileData() const
+{
+	if(!m_pDataFile) return 0;
+	return m_pDataFile->m_pFile;
+}
+
+unsigned CDataFileReader::FileSize() const
+{
+	if(!m_pDataFile) return 0;
+	return m_pDataFile->m_FileSize;
+}
+
 
 CDataFileWriter::CDataFileWriter()
 {
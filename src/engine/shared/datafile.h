@@ -32,6 +32,10 @@ public:
 	void Unload();
 
 	unsigned Crc();
+
+	// the whole file as it was on disk when it was loaded
+	const void *FileData() const;
+	unsigned FileSize() const;
 };
 
 // write access
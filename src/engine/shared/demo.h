@@ -22,9 +22,11 @@ class CDemoRecorder : public IDemoRecorder
 
 	void WriteTickMarker(int Tick, int Keyframe);
 	void Write(int Type, const void *pData, int Size);
+	void Print(const char *pLine);
 public:
 	CDemoRecorder(class CSnapshotDelta *pSnapshotDelta);
 
+	// pConsole can be 0, messages go to dbg_msg then
 	int Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetversion, const char *pMap, unsigned MapCrc, const char *pType);
 	int Stop();
 	void AddDemoMarker();
@@ -97,7 +97,14 @@ public:
 	{
 		// open logfile if needed
 		if(g_Config.m_Logfile[0])
+		{
 			dbg_logger_file(g_Config.m_Logfile);
+			dbg_logger_file_rotation(g_Config.m_LogfileMaxSize*1024, g_Config.m_LogfileMaxAge*60);
+		}
+
+		// after all loggers were added
+		if(g_Config.m_LogAsync)
+			dbg_logger_async();
 	}
 
 	void HostLookup(CHostLookup *pLookup, const char *pHostname, int Nettype)
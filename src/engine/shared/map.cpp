@@ -49,6 +49,16 @@ public:
 	{
 		return m_DataFile.Crc();
 	}
+
+	virtual const unsigned char *FileData()
+	{
+		return (const unsigned char *)m_DataFile.FileData();
+	}
+
+	virtual int FileSize()
+	{
+		return (int)m_DataFile.FileSize();
+	}
 };
 
 extern IEngineMap *CreateEngineMap() { return new CMap; }
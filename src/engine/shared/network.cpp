@@ -7,6 +7,18 @@
 #include "network.h"
 #include "huffman.h"
 
+unsigned NetAddrHash(const NETADDR *pAddr)
+{
+	// fnv-1a over the fields, the padding of the struct isn't initialized everywhere
+	unsigned Hash = 2166136261u;
+	Hash = (Hash^pAddr->type)*16777619u;
+	for(int i = 0; i < 16; i++)
+		Hash = (Hash^pAddr->ip[i])*16777619u;
+	Hash = (Hash^(pAddr->port&0xff))*16777619u;
+	Hash = (Hash^(pAddr->port>>8))*16777619u;
+	return Hash;
+}
+
 void CNetRecvUnpacker::Clear()
 {
 	m_Valid = false;
@@ -90,6 +102,45 @@ int CNetRecvUnpacker::FetchChunk(CNetChunk *pChunk)
 	}
 }
 
+void CNetSendBatch::Queue(NETSOCKET Socket, const NETADDR *pAddr, const void *pData, int DataSize)
+{
+	if(m_NumPackets && (m_NumPackets == MAX_PACKETS || mem_comp(&Socket, &m_Socket, sizeof(Socket)) != 0))
+		Flush();
+
+	m_Socket = Socket;
+	m_aAddrs[m_NumPackets] = *pAddr;
+	mem_copy(m_aaData[m_NumPackets], pData, DataSize);
+	m_aSizes[m_NumPackets] = DataSize;
+	m_NumPackets++;
+}
+
+void CNetSendBatch::Flush()
+{
+	if(!m_NumPackets)
+		return;
+
+	const void *apData[MAX_PACKETS];
+	for(int i = 0; i < m_NumPackets; i++)
+		apData[i] = m_aaData[i];
+	net_udp_send_batch(m_Socket, m_aAddrs, apData, m_aSizes, m_NumPackets);
+	m_NumPackets = 0;
+}
+
+void CNetBase::SetSendBatch(CNetSendBatch *pBatch)
+{
+	if(ms_pSendBatch && ms_pSendBatch != pBatch)
+		ms_pSendBatch->Flush();
+	ms_pSendBatch = pBatch;
+}
+
+void CNetBase::SendRaw(NETSOCKET Socket, const NETADDR *pAddr, const void *pData, int DataSize)
+{
+	if(ms_pSendBatch)
+		ms_pSendBatch->Queue(Socket, pAddr, pData, DataSize);
+	else
+		net_udp_send(Socket, pAddr, pData, DataSize);
+}
+
 // packs the data tight and sends it
 void CNetBase::SendPacketConnless(NETSOCKET Socket, NETADDR *pAddr, const void *pData, int DataSize)
 {
@@ -101,7 +152,7 @@ void CNetBase::SendPacketConnless(NETSOCKET Socket, NETADDR *pAddr, const void *
 	aBuffer[4] = 0xff;
 	aBuffer[5] = 0xff;
 	mem_copy(&aBuffer[6], pData, DataSize);
-	net_udp_send(Socket, pAddr, aBuffer, 6+DataSize);
+	SendRaw(Socket, pAddr, aBuffer, 6+DataSize);
 }
 
 void CNetBase::SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct *pPacket, SECURITY_TOKEN SecurityToken)
@@ -152,7 +203,7 @@ void CNetBase::SendPacket(NETSOCKET Socket, NETADDR *pAddr, CNetPacketConstruct
 		aBuffer[0] = ((pPacket->m_Flags<<4)&0xf0)|((pPacket->m_Ack>>8)&0xf);
 		aBuffer[1] = pPacket->m_Ack&0xff;
 		aBuffer[2] = pPacket->m_NumChunks;
-		net_udp_send(Socket, pAddr, aBuffer, FinalSize);
+		SendRaw(Socket, pAddr, aBuffer, FinalSize);
 
 		// log raw socket data
 		if(ms_DataLogSent)
@@ -311,6 +362,7 @@ int CNetBase::IsSeqInBackroom(int Seq, int Ack)
 IOHANDLE CNetBase::ms_DataLogSent = 0;
 IOHANDLE CNetBase::ms_DataLogRecv = 0;
 CHuffman CNetBase::ms_Huffman;
+CNetSendBatch *CNetBase::ms_pSendBatch = 0;
 
 
 void CNetBase::OpenLog(IOHANDLE DataLogSent, IOHANDLE DataLogRecv)
@@ -54,7 +54,7 @@ enum
 	NET_MAX_PAYLOAD = NET_MAX_PACKETSIZE-6,
 	NET_MAX_CHUNKHEADERSIZE = 5,
 	NET_PACKETHEADERSIZE = 3,
-	NET_MAX_CLIENTS = 16,
+	NET_MAX_CLIENTS = 256,
 	NET_MAX_CONSOLE_CLIENTS = 4,
 	NET_MAX_SEQUENCE = 1<<10,
 	NET_SEQUENCE_MASK = NET_MAX_SEQUENCE-1,
@@ -81,7 +81,10 @@ enum
 
 	NET_CONN_BUFFERSIZE=1024*32,
 
-	NET_CONNLIMIT_IPS=16,
+	NET_CONNLIMIT_IPS=1024,
+	NET_CONNLESS_IPS=1024,
+
+	NET_RECV_BATCH=32,
 
 	NET_ENUM_TERMINATOR
 };
@@ -274,6 +277,121 @@ public:
 	int FetchChunk(CNetChunk *pChunk);
 };
 
+/*
+	Class: Send batch
+		Collects outgoing packets to send them with one system call,
+		see net_udp_send_batch. Flushed when it's full, when a packet
+		for another socket is queued and by Flush.
+*/
+class CNetSendBatch
+{
+	enum
+	{
+		MAX_PACKETS=64,
+	};
+
+	NETSOCKET m_Socket;
+	NETADDR m_aAddrs[MAX_PACKETS];
+	unsigned char m_aaData[MAX_PACKETS][NET_MAX_PACKETSIZE];
+	int m_aSizes[MAX_PACKETS];
+	int m_NumPackets;
+
+public:
+	CNetSendBatch() : m_NumPackets(0) {}
+
+	void Queue(NETSOCKET Socket, const NETADDR *pAddr, const void *pData, int DataSize);
+	void Flush();
+};
+
+unsigned NetAddrHash(const NETADDR *pAddr);
+
+/*
+	Class: Address table
+		Open addressing hash table from addresses to ints, for the
+		lookups the server does for every packet. Holds up to SIZE/2
+		entries to keep the probe sequences short. A zeroed table is
+		empty, so it survives the mem_zero of its owner.
+*/
+template<int SIZE>
+class CNetAddrTable
+{
+	struct CEntry
+	{
+		NETADDR m_Addr;
+		unsigned m_Hash;
+		int m_Value;
+		bool m_Used;
+	};
+
+	CEntry m_aEntries[SIZE];
+	int m_Num;
+
+	// the entry of the address or the free one ending its probe sequence
+	int Lookup(const NETADDR *pAddr, unsigned Hash) const
+	{
+		int i = Hash&(SIZE-1);
+		while(m_aEntries[i].m_Used && (m_aEntries[i].m_Hash != Hash || net_addr_comp(&m_aEntries[i].m_Addr, pAddr) != 0))
+			i = (i+1)&(SIZE-1);
+		return i;
+	}
+
+public:
+	void Clear() { mem_zero(this, sizeof(*this)); }
+	int Num() const { return m_Num; }
+
+	// -1 if the address isn't in the table
+	int Find(const NETADDR *pAddr) const
+	{
+		int i = Lookup(pAddr, NetAddrHash(pAddr));
+		return m_aEntries[i].m_Used ? m_aEntries[i].m_Value : -1;
+	}
+
+	// adds the address or replaces its value, false if the table is full
+	bool Set(const NETADDR *pAddr, int Value)
+	{
+		unsigned Hash = NetAddrHash(pAddr);
+		int i = Lookup(pAddr, Hash);
+		if(!m_aEntries[i].m_Used)
+		{
+			if(m_Num >= SIZE/2)
+				return false;
+			m_aEntries[i].m_Addr = *pAddr;
+			m_aEntries[i].m_Hash = Hash;
+			m_aEntries[i].m_Used = true;
+			m_Num++;
+		}
+		m_aEntries[i].m_Value = Value;
+		return true;
+	}
+
+	void Remove(const NETADDR *pAddr)
+	{
+		int i = Lookup(pAddr, NetAddrHash(pAddr));
+		if(!m_aEntries[i].m_Used)
+			return;
+		m_Num--;
+
+		// move the later entries of the probe sequence into the gap, so
+		// the lookups don't need tombstones
+		int j = i;
+		while(1)
+		{
+			m_aEntries[i].m_Used = false;
+			int Home;
+			do
+			{
+				j = (j+1)&(SIZE-1);
+				if(!m_aEntries[j].m_Used)
+					return;
+				Home = m_aEntries[j].m_Hash&(SIZE-1);
+			}
+			while(i <= j ? (i < Home && Home <= j) : (i < Home || Home <= j));
+			m_aEntries[i] = m_aEntries[j];
+			i = j;
+		}
+	}
+};
+
 // server side
 class CNetServer
 {
@@ -281,18 +399,26 @@ class CNetServer
 	{
 	public:
 		CNetConnection m_Connection;
+		// the address the slot is found by, while it's connected
+		NETADDR m_IndexedAddr;
+		bool m_Indexed;
 	};
 
+	// connection attempts of one address, kept in a list from the most
+	// to the least recently seen one
 	struct CSpamConn
 	{
 		NETADDR m_Addr;
 		int64 m_Time;
 		int m_Conns;
+		int m_Prev;
+		int m_Next;
 	};
 
 	NETSOCKET m_Socket;
 	class CNetBan *m_pNetBan;
-	CSlot m_aSlots[NET_MAX_CLIENTS];
+	// only as many as sv_max_clients, allocated by Open()
+	CSlot *m_pSlots;
 	int m_MaxClients;
 	int m_MaxClientsPerIP;
 
@@ -311,20 +437,58 @@ class CNetServer
 	int64 m_VConnFirst;
 	int m_VConnNum;
 
+	// connected slots by address and their number by ip
+	CNetAddrTable<NET_MAX_CLIENTS*2> m_SlotIndex;
+	CNetAddrTable<NET_MAX_CLIENTS*2> m_IPCounts;
+
 	CSpamConn m_aSpamConns[NET_CONNLIMIT_IPS];
+	CNetAddrTable<NET_CONNLIMIT_IPS*2> m_SpamConnIndex;
+	int m_NumSpamConns;
+	int m_FirstSpamConn;
+	int m_LastSpamConn;
+
+	// token bucket of the connectionless packets of one ip, in the same
+	// kind of list
+	struct CConnlessBucket
+	{
+		NETADDR m_Addr;
+		// when the bucket is full again, every packet moves it by its cost
+		int64 m_FullTime;
+		int m_Prev;
+		int m_Next;
+	};
+
+	CConnlessBucket m_aConnlessBuckets[NET_CONNLESS_IPS];
+	CNetAddrTable<NET_CONNLESS_IPS*2> m_ConnlessIndex;
+	int m_NumConnlessBuckets;
+	int m_FirstConnlessBucket;
+	int m_LastConnlessBucket;
 
 	CNetRecvUnpacker m_RecvUnpacker;
 
+	// packets read by the last batch receive, handed out one by one
+	bool m_Batching;
+	NETADDR m_aRecvAddrs[NET_RECV_BATCH];
+	unsigned char m_aaRecvData[NET_RECV_BATCH][NET_MAX_PACKETSIZE];
+	int m_aRecvSizes[NET_RECV_BATCH];
+	int m_NumRecv;
+	int m_RecvIndex;
+	CNetSendBatch m_SendBatch;
+
 	void OnTokenCtrlMsg(NETADDR &Addr, int ControlMsg, const CNetPacketConstruct &Packet);
 	void OnPreConnMsg(NETADDR &Addr, CNetPacketConstruct &Packet);
 	void OnConnCtrlMsg(NETADDR &Addr, int ClientID, int ControlMsg, const CNetPacketConstruct &Packet);
 	bool ClientExists(const NETADDR &Addr) { return GetClientSlot(Addr) != -1; };
 	int GetClientSlot(const NETADDR &Addr);
+	// adds or removes the slot from the address tables after its state changed
+	void UpdateSlotIndex(int Slot);
 	void SendControl(NETADDR &Addr, int ControlMsg, const void *pExtra, int ExtraSize, SECURITY_TOKEN SecurityToken);
 
 	int TryAcceptClient(NETADDR &Addr, SECURITY_TOKEN SecurityToken, bool VanillaAuth=false);
 	int NumClientsWithAddr(NETADDR Addr);
 	bool Connlimit(NETADDR Addr);
+	// true if the ip sent more connectionless packets than its bucket allows
+	bool ConnlessLimit(const NETADDR &Addr);
 	void SendMsgs(NETADDR &Addr, const CMsgPacker *Msgs[], int num);
 
 public:
@@ -340,12 +504,22 @@ public:
 	int Send(CNetChunk *pChunk);
 	int Update();
 
+	/*
+		Function: SetBatching
+			Reads waiting packets in batches and queues the sent
+			packets until FlushSend, so a server loop needs a few
+			system calls instead of one per packet.
+	*/
+	void SetBatching(bool Batching);
+	bool Batching() const { return m_Batching; }
+	void FlushSend() { m_SendBatch.Flush(); }
+
 	//
 	int Drop(int ClientID, const char *pReason, bool ForceDisconnect = true);
 
 	// status requests
-	const NETADDR *ClientAddr(int ClientID) const { return m_aSlots[ClientID].m_Connection.PeerAddress(); }
-	bool HasSecurityToken(int ClientID) const { return m_aSlots[ClientID].m_Connection.SecurityToken() != NET_SECURITY_TOKEN_UNSUPPORTED; }
+	const NETADDR *ClientAddr(int ClientID) const { return m_pSlots[ClientID].m_Connection.PeerAddress(); }
+	bool HasSecurityToken(int ClientID) const { return m_pSlots[ClientID].m_Connection.SecurityToken() != NET_SECURITY_TOKEN_UNSUPPORTED; }
 	NETSOCKET Socket() const { return m_Socket; }
 	class CNetBan *NetBan() const { return m_pNetBan; }
 	int NetType() const { return m_Socket.type; }
@@ -447,6 +621,9 @@ class CNetBase
 	static IOHANDLE ms_DataLogSent;
 	static IOHANDLE ms_DataLogRecv;
 	static CHuffman ms_Huffman;
+	static CNetSendBatch *ms_pSendBatch;
+
+	static void SendRaw(NETSOCKET Socket, const NETADDR *pAddr, const void *pData, int DataSize);
 public:
 	static void OpenLog(IOHANDLE DataLogSent, IOHANDLE DataLogRecv);
 	static void CloseLog();
@@ -460,6 +637,9 @@ public:
 
 	static int UnpackPacket(unsigned char *pBuffer, int Size, CNetPacketConstruct *pPacket);
 
+	// queues all following packets in pBatch until it's set to 0 again
+	static void SetSendBatch(CNetSendBatch *pBatch);
+
 	// The backroom is ack-NET_MAX_SEQUENCE/2. Used for knowing if we acked a packet or not
 	static int IsSeqInBackroom(int Seq, int Ack);
 };
@@ -75,10 +75,22 @@ bool CNetServer::Open(NETADDR BindAddr, CNetBan *pNetBan, int MaxClients, int Ma
 	m_VConnNum = 0;
 	m_VConnFirst = 0;
 
+	m_NumSpamConns = 0;
+	m_FirstSpamConn = -1;
+	m_LastSpamConn = -1;
+
+	m_NumConnlessBuckets = 0;
+	m_FirstConnlessBucket = -1;
+	m_LastConnlessBucket = -1;
+
 	secure_random_fill(m_SecurityTokenSeed, sizeof(m_SecurityTokenSeed));
 
-	for(int i = 0; i < NET_MAX_CLIENTS; i++)
-		m_aSlots[i].m_Connection.Init(m_Socket, true);
+	m_pSlots = new CSlot[m_MaxClients];
+	for(int i = 0; i < m_MaxClients; i++)
+	{
+		m_pSlots[i].m_Connection.Init(m_Socket, true);
+		m_pSlots[i].m_Indexed = false;
+	}
 
 	return true;
 }
@@ -105,6 +117,9 @@ int CNetServer::SetCallbacks(NETFUNC_NEWCLIENT pfnNewClient, NETFUNC_NEWCLIENT_N
 int CNetServer::Close()
 {
 	// TODO: implement me
+	SetBatching(false);
+	delete[] m_pSlots;
+	m_pSlots = 0;
 	return 0;
 }
 
@@ -123,7 +138,8 @@ int CNetServer::Drop(int ClientID, const char *pReason, bool ForceDisconnect)
 	if(m_pfnDelClient)
 		error = m_pfnDelClient(ClientID, pReason, m_UserPtr, ForceDisconnect);
 
-	if(error == 0) m_aSlots[ClientID].m_Connection.Disconnect(pReason);
+	if(error == 0) m_pSlots[ClientID].m_Connection.Disconnect(pReason);
+	UpdateSlotIndex(ClientID);
 
 	return error;
 }
@@ -132,11 +148,12 @@ int CNetServer::Update()
 {
 	for(int i = 0; i < MaxClients(); i++)
 	{
-		m_aSlots[i].m_Connection.Update();
-		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_ERROR)
+		m_pSlots[i].m_Connection.Update();
+		if(m_pSlots[i].m_Connection.State() == NET_CONNSTATE_ERROR)
 		{
-			Drop(i, m_aSlots[i].m_Connection.ErrorString(), false);
+			Drop(i, m_pSlots[i].m_Connection.ErrorString(), false);
 		}
+		UpdateSlotIndex(i);
 	}
 
 	return 0;
@@ -169,56 +186,118 @@ void CNetServer::SendControl(NETADDR &Addr, int ControlMsg, const void *pExtra,
 
 int CNetServer::NumClientsWithAddr(NETADDR Addr)
 {
-	NETADDR ThisAddr = Addr, OtherAddr;
+	Addr.port = 0;
+	int Num = m_IPCounts.Find(&Addr);
+	return Num == -1 ? 0 : Num;
+}
 
-	int FoundAddr = 0;
-	ThisAddr.port = 0;
+// the lists of addresses below are ordered from the most to the least
+// recently seen one, the entries link each other by index
+template<typename T>
+static void UnlinkAddrEntry(T *paEntries, int Index, int *pFirst, int *pLast)
+{
+	T *pEntry = &paEntries[Index];
+	if(pEntry->m_Prev != -1)
+		paEntries[pEntry->m_Prev].m_Next = pEntry->m_Next;
+	else
+		*pFirst = pEntry->m_Next;
+	if(pEntry->m_Next != -1)
+		paEntries[pEntry->m_Next].m_Prev = pEntry->m_Prev;
+	else
+		*pLast = pEntry->m_Prev;
+}
 
-	for(int i = 0; i < MaxClients(); ++i)
-	{
-		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_OFFLINE ||
-			m_aSlots[i].m_Connection.State() == NET_CONNSTATE_ERROR)
-			continue;
+template<typename T>
+static void PushAddrEntry(T *paEntries, int Index, int *pFirst, int *pLast)
+{
+	T *pEntry = &paEntries[Index];
+	pEntry->m_Prev = -1;
+	pEntry->m_Next = *pFirst;
+	if(*pFirst != -1)
+		paEntries[*pFirst].m_Prev = Index;
+	else
+		*pLast = Index;
+	*pFirst = Index;
+}
 
-		OtherAddr = *m_aSlots[i].m_Connection.PeerAddress();
-		OtherAddr.port = 0;
-		if(!net_addr_comp(&ThisAddr, &OtherAddr))
-			FoundAddr++;
+// finds the entry of the address and moves it to the front, or takes a
+// new one. forgets the address that was seen least recently when the
+// table is full. returns true for a new entry
+template<typename T, int SIZE>
+static bool TouchAddrEntry(T *paEntries, int MaxEntries, CNetAddrTable<SIZE> *pTable, int *pNum, int *pFirst, int *pLast, const NETADDR &Addr, int *pIndex)
+{
+	int Index = pTable->Find(&Addr);
+	bool New = Index == -1;
+	if(New)
+	{
+		if(*pNum < MaxEntries)
+			Index = (*pNum)++;
+		else
+		{
+			Index = *pLast;
+			pTable->Remove(&paEntries[Index].m_Addr);
+			UnlinkAddrEntry(paEntries, Index, pFirst, pLast);
+		}
+		paEntries[Index].m_Addr = Addr;
+		pTable->Set(&Addr, Index);
 	}
-
-	return FoundAddr;
+	else
+		UnlinkAddrEntry(paEntries, Index, pFirst, pLast);
+	PushAddrEntry(paEntries, Index, pFirst, pLast);
+	*pIndex = Index;
+	return New;
 }
 
 bool CNetServer::Connlimit(NETADDR Addr)
 {
+	// by ip, a flood could rotate its source port otherwise
+	Addr.port = 0;
 	int64 Now = time_get();
-	int Oldest = 0;
 
-	for(int i = 0; i < NET_CONNLIMIT_IPS; ++i)
+	int Index;
+	if(TouchAddrEntry(m_aSpamConns, NET_CONNLIMIT_IPS, &m_SpamConnIndex, &m_NumSpamConns, &m_FirstSpamConn, &m_LastSpamConn, Addr, &Index))
 	{
-		if(!net_addr_comp(&m_aSpamConns[i].m_Addr, &Addr))
-		{
-			if(m_aSpamConns[i].m_Time > Now - time_freq() * g_Config.m_SvConnlimitTime)
-			{
-				if(m_aSpamConns[i].m_Conns >= g_Config.m_SvConnlimit)
-					return true;
-			}
-			else
-			{
-				m_aSpamConns[i].m_Time = Now;
-				m_aSpamConns[i].m_Conns = 0;
-			}
-			m_aSpamConns[i].m_Conns++;
-			return false;
-		}
+		m_aSpamConns[Index].m_Time = Now;
+		m_aSpamConns[Index].m_Conns = 1;
+		return false;
+	}
 
-		if(m_aSpamConns[i].m_Time < m_aSpamConns[Oldest].m_Time)
-			Oldest = i;
+	CSpamConn *pConn = &m_aSpamConns[Index];
+	if(pConn->m_Time > Now - time_freq() * g_Config.m_SvConnlimitTime)
+	{
+		if(pConn->m_Conns >= g_Config.m_SvConnlimit)
+			return true;
 	}
+	else
+	{
+		pConn->m_Time = Now;
+		pConn->m_Conns = 0;
+	}
+	pConn->m_Conns++;
+	return false;
+}
 
-	m_aSpamConns[Oldest].m_Addr = Addr;
-	m_aSpamConns[Oldest].m_Time = Now;
-	m_aSpamConns[Oldest].m_Conns = 1;
+bool CNetServer::ConnlessLimit(const NETADDR &Addr)
+{
+	if(!g_Config.m_SvConnlessRate)
+		return false;
+
+	// by ip, a source can pick any port
+	NETADDR IP = Addr;
+	IP.port = 0;
+	int64 Now = time_get();
+	int64 Cost = time_freq()/g_Config.m_SvConnlessRate;
+
+	int Index;
+	if(TouchAddrEntry(m_aConnlessBuckets, NET_CONNLESS_IPS, &m_ConnlessIndex, &m_NumConnlessBuckets, &m_FirstConnlessBucket, &m_LastConnlessBucket, IP, &Index))
+		m_aConnlessBuckets[Index].m_FullTime = Now;
+
+	// the bucket is empty once it is Burst packets away from being full
+	CConnlessBucket *pBucket = &m_aConnlessBuckets[Index];
+	int64 FullTime = max(pBucket->m_FullTime, Now);
+	if(FullTime+Cost-Now > Cost*g_Config.m_SvConnlessBurst)
+		return true;
+	pBucket->m_FullTime = FullTime+Cost;
 	return false;
 }
 
@@ -243,7 +322,7 @@ int CNetServer::TryAcceptClient(NETADDR &Addr, SECURITY_TOKEN SecurityToken, boo
 	int Slot = -1;
 	for(int i = 0; i < MaxClients(); i++)
 	{
-		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_OFFLINE)
+		if(m_pSlots[i].m_Connection.State() == NET_CONNSTATE_OFFLINE)
 		{
 			Slot = i;
 			break;
@@ -259,15 +338,16 @@ int CNetServer::TryAcceptClient(NETADDR &Addr, SECURITY_TOKEN SecurityToken, boo
 	}
 
 	// init connection slot
-	m_aSlots[Slot].m_Connection.DirectInit(Addr, SecurityToken);
+	m_pSlots[Slot].m_Connection.DirectInit(Addr, SecurityToken);
+	UpdateSlotIndex(Slot);
 
 	if (VanillaAuth)
 	{
 		// client sequence is unknown if the auth was done
 		// connection-less
-		m_aSlots[Slot].m_Connection.SetUnknownSeq();
+		m_pSlots[Slot].m_Connection.SetUnknownSeq();
 		// correct sequence
-		m_aSlots[Slot].m_Connection.SetSequence(6);
+		m_pSlots[Slot].m_Connection.SetSequence(6);
 	}
 
 	if (g_Config.m_Debug)
@@ -515,20 +595,63 @@ void CNetServer::OnTokenCtrlMsg(NETADDR &Addr, int ControlMsg, const CNetPacketC
 
 int CNetServer::GetClientSlot(const NETADDR &Addr)
 {
-	int Slot = -1;
+	int Slot = m_SlotIndex.Find(&Addr);
+	if(Slot == -1)
+		return -1;
 
-	for(int i = 0; i < MaxClients(); i++)
+	int State = m_pSlots[Slot].m_Connection.State();
+	if(State == NET_CONNSTATE_OFFLINE || State == NET_CONNSTATE_ERROR)
 	{
-		if(m_aSlots[i].m_Connection.State() != NET_CONNSTATE_OFFLINE &&
-			m_aSlots[i].m_Connection.State() != NET_CONNSTATE_ERROR &&
-			net_addr_comp(m_aSlots[i].m_Connection.PeerAddress(), &Addr) == 0)
+		// the state changed without the tables knowing
+		UpdateSlotIndex(Slot);
+		return -1;
+	}
+	return Slot;
+}
 
-		{
-			Slot = i;
-		}
+void CNetServer::UpdateSlotIndex(int Slot)
+{
+	CSlot *pSlot = &m_pSlots[Slot];
+	int State = pSlot->m_Connection.State();
+	bool Connected = State != NET_CONNSTATE_OFFLINE && State != NET_CONNSTATE_ERROR;
+	if(pSlot->m_Indexed && (!Connected || net_addr_comp(&pSlot->m_IndexedAddr, pSlot->m_Connection.PeerAddress()) != 0))
+	{
+		if(m_SlotIndex.Find(&pSlot->m_IndexedAddr) == Slot)
+			m_SlotIndex.Remove(&pSlot->m_IndexedAddr);
+
+		NETADDR IP = pSlot->m_IndexedAddr;
+		IP.port = 0;
+		int Num = m_IPCounts.Find(&IP);
+		if(Num > 1)
+			m_IPCounts.Set(&IP, Num-1);
+		else
+			m_IPCounts.Remove(&IP);
+		pSlot->m_Indexed = false;
 	}
 
-	return Slot;
+	if(!pSlot->m_Indexed && Connected)
+	{
+		pSlot->m_IndexedAddr = *pSlot->m_Connection.PeerAddress();
+		pSlot->m_Indexed = true;
+		m_SlotIndex.Set(&pSlot->m_IndexedAddr, Slot);
+
+		NETADDR IP = pSlot->m_IndexedAddr;
+		IP.port = 0;
+		int Num = m_IPCounts.Find(&IP);
+		m_IPCounts.Set(&IP, Num == -1 ? 1 : Num+1);
+	}
+}
+
+void CNetServer::SetBatching(bool Batching)
+{
+	if(m_Batching && !Batching)
+	{
+		m_SendBatch.Flush();
+		CNetBase::SetSendBatch(0);
+	}
+	else if(Batching)
+		CNetBase::SetSendBatch(&m_SendBatch);
+	m_Batching = Batching;
 }
 
 /*
@@ -539,17 +662,40 @@ int CNetServer::Recv(CNetChunk *pChunk)
 	while(1)
 	{
 		NETADDR Addr;
+		unsigned char *pData;
+		int Bytes;
 
 		// check for a chunk
 		if(m_RecvUnpacker.FetchChunk(pChunk))
 			return 1;
 
-		// TODO: empty the recvinfo
-		int Bytes = net_udp_recv(m_Socket, &Addr, m_RecvUnpacker.m_aBuffer, NET_MAX_PACKETSIZE);
+		if(m_Batching || m_RecvIndex < m_NumRecv)
+		{
+			if(m_RecvIndex == m_NumRecv)
+			{
+				m_NumRecv = net_udp_recv_batch(m_Socket, m_aRecvAddrs, m_aaRecvData[0], m_aRecvSizes, NET_MAX_PACKETSIZE, NET_RECV_BATCH);
+				m_RecvIndex = 0;
+			}
+
+			// no more packets for now
+			if(m_RecvIndex == m_NumRecv)
+				break;
 
-		// no more packets for now
-		if(Bytes <= 0)
-			break;
+			Addr = m_aRecvAddrs[m_RecvIndex];
+			pData = m_aaRecvData[m_RecvIndex];
+			Bytes = m_aRecvSizes[m_RecvIndex];
+			m_RecvIndex++;
+		}
+		else
+		{
+			// TODO: empty the recvinfo
+			pData = m_RecvUnpacker.m_aBuffer;
+			Bytes = net_udp_recv(m_Socket, &Addr, pData, NET_MAX_PACKETSIZE);
+
+			// no more packets for now
+			if(Bytes <= 0)
+				break;
+		}
 
 		// check if we just should drop the packet
 		char aBuf[128];
@@ -560,10 +706,12 @@ int CNetServer::Recv(CNetChunk *pChunk)
 			continue;
 		}
 
-		if(CNetBase::UnpackPacket(m_RecvUnpacker.m_aBuffer, Bytes, &m_RecvUnpacker.m_Data) == 0)
+		if(CNetBase::UnpackPacket(pData, Bytes, &m_RecvUnpacker.m_Data) == 0)
 		{
 			if(m_RecvUnpacker.m_Data.m_Flags&NET_PACKETFLAG_CONNLESS)
 			{
+				if(ConnlessLimit(Addr))
+					continue;
 				pChunk->m_Flags = NETSENDFLAG_CONNLESS;
 				pChunk->m_ClientID = -1;
 				pChunk->m_Address = Addr;
@@ -585,11 +733,13 @@ int CNetServer::Recv(CNetChunk *pChunk)
 				{
 					// found
 
-					if(m_aSlots[Slot].m_Connection.Feed(&m_RecvUnpacker.m_Data, &Addr))
+					if(m_pSlots[Slot].m_Connection.Feed(&m_RecvUnpacker.m_Data, &Addr))
 					{
 						if(m_RecvUnpacker.m_Data.m_DataSize)
-							m_RecvUnpacker.Start(&Addr, &m_aSlots[Slot].m_Connection, Slot);
+							m_RecvUnpacker.Start(&Addr, &m_pSlots[Slot].m_Connection, Slot);
 					}
+					else
+						UpdateSlotIndex(Slot);
 				}
 				else
 				{
@@ -630,10 +780,10 @@ int CNetServer::Send(CNetChunk *pChunk)
 		if(pChunk->m_Flags&NETSENDFLAG_VITAL)
 			Flags = NET_CHUNKFLAG_VITAL;
 
-		if(m_aSlots[pChunk->m_ClientID].m_Connection.QueueChunk(Flags, pChunk->m_DataSize, pChunk->m_pData) == 0)
+		if(m_pSlots[pChunk->m_ClientID].m_Connection.QueueChunk(Flags, pChunk->m_DataSize, pChunk->m_pData) == 0)
 		{
 			if(pChunk->m_Flags&NETSENDFLAG_FLUSH)
-				m_aSlots[pChunk->m_ClientID].m_Connection.Flush();
+				m_pSlots[pChunk->m_ClientID].m_Connection.Flush();
 		}
 		else
 		{
@@ -1,5 +1,13 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "snapshot.h"
 #include "compression.h"
 
@@ -28,6 +36,34 @@ int CSnapshot::GetItemIndex(int Key)
 	return -1;
 }
 
+bool CSnapshot::IsSorted()
+{
+	for(int i = 1; i < m_NumItems; i++)
+	{
+		if(GetItem(i-1)->Key() > GetItem(i)->Key())
+			return false;
+	}
+	return true;
+}
+
+// the first item with the key, only for sorted snapshots
+static int GetItemIndexSorted(CSnapshot *pSnapshot, int Key)
+{
+	int Low = 0;
+	int High = pSnapshot->NumItems();
+	while(Low < High)
+	{
+		int Mid = (Low+High)/2;
+		if(pSnapshot->GetItem(Mid)->Key() < Key)
+			Low = Mid+1;
+		else
+			High = Mid;
+	}
+	if(Low < pSnapshot->NumItems() && pSnapshot->GetItem(Low)->Key() == Key)
+		return Low;
+	return -1;
+}
+
 unsigned int CSnapshot::Crc()
 {
 	unsigned int Crc = 0;
@@ -101,17 +137,25 @@ static int GetItemIndexHashed(int Key, const CItemList *pHashlist)
 	return -1;
 }
 
-static int DiffItem(int *pPast, int *pCurrent, int *pOut, int Size)
+static int DiffItem(const int *pPast, const int *pCurrent, int *pOut, int Size)
 {
+	int i = 0;
 	int Needed = 0;
-	while(Size)
+#if defined(__SSE2__)
+	// four ints at a time, items are only aligned to ints
+	__m128i Changed = _mm_setzero_si128();
+	for(; i+4 <= Size; i += 4)
 	{
-		*pOut = *pCurrent-*pPast;
-		Needed |= *pOut;
-		pOut++;
-		pPast++;
-		pCurrent++;
-		Size--;
+		__m128i Diff = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(pCurrent+i)), _mm_loadu_si128((const __m128i *)(pPast+i)));
+		_mm_storeu_si128((__m128i *)(pOut+i), Diff);
+		Changed = _mm_or_si128(Changed, Diff);
+	}
+	Needed = _mm_movemask_epi8(_mm_cmpeq_epi32(Changed, _mm_setzero_si128())) != 0xffff;
+#endif
+	for(; i < Size; i++)
+	{
+		pOut[i] = pCurrent[i]-pPast[i];
+		Needed |= pOut[i];
 	}
 
 	return Needed;
@@ -158,17 +202,56 @@ CSnapshotDelta::CData *CSnapshotDelta::EmptyDelta()
 	return &m_Empty;
 }
 
-// TODO: OPT: this should be made much faster
 int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData)
 {
+	if(!pFrom->IsSorted() || !pTo->IsSorted())
+		return CreateDeltaHashed(pFrom, pTo, pDstData);
+
 	CData *pDelta = (CData *)pDstData;
 	int *pData = (int *)pDelta->m_pData;
-	int i, ItemSize, PastIndex;
+
+	pDelta->m_NumDeletedItems = 0;
+	pDelta->m_NumUpdateItems = 0;
+	pDelta->m_NumTempItems = 0;
+
+	// both snapshots are sorted by key, so one walk over both finds the
+	// deleted items and another the previous indices. equal keys match
+	// their first item, like the hash lists do
+	const int NumFrom = pFrom->NumItems();
+	const int NumItems = pTo->NumItems();
+	for(int i = 0, t = 0; i < NumFrom; i++)
+	{
+		int Key = pFrom->GetItem(i)->Key();
+		while(t < NumItems && pTo->GetItem(t)->Key() < Key)
+			t++;
+		if(t == NumItems || pTo->GetItem(t)->Key() != Key)
+		{
+			// deleted
+			pDelta->m_NumDeletedItems++;
+			*pData = Key;
+			pData++;
+		}
+	}
+
+	int aPastIndecies[1024];
+	for(int i = 0, f = 0; i < NumItems; i++)
+	{
+		int Key = pTo->GetItem(i)->Key();
+		while(f < NumFrom && pFrom->GetItem(f)->Key() < Key)
+			f++;
+		aPastIndecies[i] = f < NumFrom && pFrom->GetItem(f)->Key() == Key ? f : -1;
+	}
+
+	return PackUpdates(pFrom, pTo, aPastIndecies, pData, pDelta);
+}
+
+int CSnapshotDelta::CreateDeltaHashed(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData)
+{
+	CData *pDelta = (CData *)pDstData;
+	int *pData = (int *)pDelta->m_pData;
+	int i;
 	CSnapshotItem *pFromItem;
 	CSnapshotItem *pCurItem;
-	CSnapshotItem *pPastItem;
-	int Count = 0;
-	int SizeCount = 0;
 
 	pDelta->m_NumDeletedItems = 0;
 	pDelta->m_NumUpdateItems = 0;
@@ -202,12 +285,22 @@ int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData
 		aPastIndecies[i] = GetItemIndexHashed(pCurItem->Key(), Hashlist); // O(n) .. O(n^n)
 	}
 
+	return PackUpdates(pFrom, pTo, aPastIndecies, pData, pDelta);
+}
+
+int CSnapshotDelta::PackUpdates(CSnapshot *pFrom, CSnapshot *pTo, const int *pPastIndecies, int *pData, CData *pDelta)
+{
+	int i, ItemSize, PastIndex;
+	CSnapshotItem *pCurItem;
+	CSnapshotItem *pPastItem;
+	const int NumItems = pTo->NumItems();
+
 	for(i = 0; i < NumItems; i++)
 	{
 		// do delta
 		ItemSize = pTo->GetItemSize(i); // O(1) .. O(n)
 		pCurItem = pTo->GetItem(i); // O(1) .. O(n)
-		PastIndex = aPastIndecies[i];
+		PastIndex = pPastIndecies[i];
 
 		if(PastIndex != -1)
 		{
@@ -237,36 +330,15 @@ int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData
 				*pData++ = ItemSize/4;
 
 			mem_copy(pData, pCurItem->Data(), ItemSize);
-			SizeCount += ItemSize;
 			pData += ItemSize/4;
 			pDelta->m_NumUpdateItems++;
-			Count++;
 		}
 	}
 
-	if(0)
-	{
-		dbg_msg("snapshot", "%d %d %d",
-			pDelta->m_NumDeletedItems,
-			pDelta->m_NumUpdateItems,
-			pDelta->m_NumTempItems);
-	}
-
-	/*
-	// TODO: pack temp stuff
-
-	// finish
-	//mem_copy(pDelta->offsets, deleted, pDelta->num_deleted_items*sizeof(int));
-	//mem_copy(&(pDelta->offsets[pDelta->num_deleted_items]), update, pDelta->num_update_items*sizeof(int));
-	//mem_copy(&(pDelta->offsets[pDelta->num_deleted_items+pDelta->num_update_items]), temp, pDelta->num_temp_items*sizeof(int));
-	//mem_copy(pDelta->data_start(), data, data_size);
-	//pDelta->data_size = data_size;
-	* */
-
 	if(!pDelta->m_NumDeletedItems && !pDelta->m_NumUpdateItems && !pDelta->m_NumTempItems)
 		return 0;
 
-	return (int)((char*)pData-(char*)pDstData);
+	return (int)((char*)pData-(char*)pDelta);
 }
 
 static int RangeCheck(void *pEnd, void *pPtr, int Size)
@@ -292,6 +364,14 @@ int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData
 
 	Builder.Init();
 
+	// with a sorted snapshot the previous items are found by bisection,
+	// and the builder index of the kept ones is remembered
+	const bool Sorted = pFrom->IsSorted();
+	int aKeptIndex[1024];
+	int NumKept = 0;
+	if(pFrom->NumItems() > 1024)
+		return -1;
+
 	// unpack deleted stuff
 	pDeleted = pData;
 	pData += pDelta->m_NumDeletedItems;
@@ -314,12 +394,14 @@ int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData
 			}
 		}
 
+		aKeptIndex[i] = -1;
 		if(Keep)
 		{
 			// keep it
 			mem_copy(
 				Builder.NewItem(pFromItem->Type(), pFromItem->ID(), ItemSize),
 				pFromItem->Data(), ItemSize);
+			aKeptIndex[i] = NumKept++;
 		}
 	}
 
@@ -347,14 +429,18 @@ int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData
 
 		Key = (Type<<16)|ID;
 
+		FromIndex = Sorted ? GetItemIndexSorted(pFrom, Key) : pFrom->GetItemIndex(Key);
+
 		// create the item if needed
-		pNewData = Builder.GetItemData(Key);
+		if(FromIndex != -1 && aKeptIndex[FromIndex] != -1)
+			pNewData = Builder.GetItem(aKeptIndex[FromIndex])->Data();
+		else
+			pNewData = Builder.GetItemData(Key);
 		if(!pNewData)
 			pNewData = (int *)Builder.NewItem(Key>>16, Key&0xffff, ItemSize);
 
 		//if(range_check(pEnd, pNewData, ItemSize)) return -4;
 
-		FromIndex = pFrom->GetItemIndex(Key);
 		if(FromIndex != -1)
 		{
 			// we got an update so we need to apply the diff
@@ -378,113 +464,222 @@ int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData
 
 // CSnapshotStorage
 
-void CSnapshotStorage::Init()
+// CSnapshotPool
+
+static unsigned HashSnapshotData(const void *pData, int Size)
+{
+	// snapshots are made of ints
+	const unsigned char *pBytes = (const unsigned char *)pData;
+	unsigned long long Hash = 0xcbf29ce484222325ull^(unsigned)Size;
+	int i = 0;
+	for(; i+4 <= Size; i += 4)
+	{
+		unsigned Word;
+		mem_copy(&Word, pBytes+i, sizeof(Word));
+		Hash = (Hash^Word)*0x100000001b3ull;
+	}
+	for(; i < Size; i++)
+		Hash = (Hash^pBytes[i])*0x100000001b3ull;
+	return (unsigned)(Hash^(Hash>>32));
+}
+
+CSnapshotPool::CSnapshotPool()
 {
-	m_pFirst = 0;
-	m_pLast = 0;
+	for(int i = 0; i < NUM_BUCKETS; i++)
+		m_apBuckets[i] = 0;
+	for(int i = 0; i < NUM_SIZE_CLASSES; i++)
+		m_apFree[i] = 0;
+	m_NumAllocs = 0;
+	m_NumBytes = 0;
+	m_NumShared = 0;
 }
 
-void CSnapshotStorage::PurgeAll()
+CSnapshotPool::~CSnapshotPool()
 {
-	CHolder *pHolder = m_pFirst;
-	CHolder *pNext;
+	// private blobs still in use aren't known here
+	for(int i = 0; i < NUM_BUCKETS; i++)
+		for(CBlob *pBlob = m_apBuckets[i], *pNext; pBlob; pBlob = pNext)
+		{
+			pNext = pBlob->m_pNext;
+			mem_free(pBlob);
+		}
+	for(int i = 0; i < NUM_SIZE_CLASSES; i++)
+		for(CBlob *pBlob = m_apFree[i], *pNext; pBlob; pBlob = pNext)
+		{
+			pNext = pBlob->m_pNext;
+			mem_free(pBlob);
+		}
+}
 
-	while(pHolder)
+CSnapshotPool::CBlob *CSnapshotPool::Alloc(int Size)
+{
+	dbg_assert(Size > 0 && Size <= CSnapshot::MAX_SIZE, "invalid snapshot size");
+	// snapshot sizes drift, so also take free blocks up to twice as big
+	int SizeClass = (Size-1)/SIZE_STEP;
+	int MaxClass = min(SizeClass*2+1, (int)NUM_SIZE_CLASSES-1);
+	CBlob *pBlob = 0;
+	for(int i = SizeClass; i <= MaxClass && !pBlob; i++)
+	{
+		pBlob = m_apFree[i];
+		if(pBlob)
+		{
+			m_apFree[i] = pBlob->m_pNext;
+			SizeClass = i;
+		}
+	}
+	if(!pBlob)
 	{
-		pNext = pHolder->m_pNext;
-		mem_free(pHolder);
-		pHolder = pNext;
+		int AllocSize = sizeof(CBlob)+(SizeClass+1)*SIZE_STEP;
+		pBlob = (CBlob *)mem_alloc(AllocSize, 8);
+		m_NumAllocs++;
+		m_NumBytes += AllocSize;
 	}
 
-	// no more snapshots in storage
-	m_pFirst = 0;
-	m_pLast = 0;
+	pBlob->m_pNext = 0;
+	pBlob->m_Size = Size;
+	pBlob->m_SizeClass = SizeClass;
+	pBlob->m_Refs = 1;
+	pBlob->m_Shared = false;
+	return pBlob;
 }
 
-void CSnapshotStorage::PurgeUntil(int Tick)
+CSnapshotPool::CBlob *CSnapshotPool::Add(const void *pData, int Size)
 {
-	CHolder *pHolder = m_pFirst;
-	CHolder *pNext;
-
-	while(pHolder)
+	unsigned Hash = HashSnapshotData(pData, Size);
+	CBlob **ppBucket = &m_apBuckets[Hash&(NUM_BUCKETS-1)];
+	for(CBlob *pBlob = *ppBucket; pBlob; pBlob = pBlob->m_pNext)
 	{
-		pNext = pHolder->m_pNext;
-		if(pHolder->m_Tick >= Tick)
-			return; // no more to remove
-		mem_free(pHolder);
+		if(pBlob->m_Hash == Hash && pBlob->m_Size == Size && mem_comp(pBlob->Snap(), pData, Size) == 0)
+		{
+			pBlob->m_Refs++;
+			m_NumShared++;
+			return pBlob;
+		}
+	}
 
-		// did we come to the end of the list?
-		if (!pNext)
-			break;
+	CBlob *pBlob = Alloc(Size);
+	mem_copy(pBlob->Snap(), pData, Size);
+	pBlob->m_Hash = Hash;
+	pBlob->m_Shared = true;
+	pBlob->m_pNext = *ppBucket;
+	*ppBucket = pBlob;
+	return pBlob;
+}
 
-		m_pFirst = pNext;
-		pNext->m_pPrev = 0x0;
+CSnapshotPool::CBlob *CSnapshotPool::AddPrivate(const void *pData, int Size)
+{
+	CBlob *pBlob = Alloc(Size);
+	mem_copy(pBlob->Snap(), pData, Size);
+	return pBlob;
+}
+
+void CSnapshotPool::Release(CBlob *pBlob)
+{
+	if(--pBlob->m_Refs > 0)
+		return;
 
-		pHolder = pNext;
+	if(pBlob->m_Shared)
+	{
+		CBlob **ppBlob = &m_apBuckets[pBlob->m_Hash&(NUM_BUCKETS-1)];
+		while(*ppBlob != pBlob)
+			ppBlob = &(*ppBlob)->m_pNext;
+		*ppBlob = pBlob->m_pNext;
 	}
 
-	// no more snapshots in storage
-	m_pFirst = 0;
-	m_pLast = 0;
+	pBlob->m_pNext = m_apFree[pBlob->m_SizeClass];
+	m_apFree[pBlob->m_SizeClass] = pBlob;
 }
 
-void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, int CreateAlt)
+// CSnapshotStorage
+
+CSnapshotStorage::CSnapshotStorage()
 {
-	// allocate memory for holder + snapshot_data
-	int TotalSize = sizeof(CHolder)+DataSize;
+	m_pPool = 0;
+	m_FirstHolder = 0;
+	m_NumHolders = 0;
+	for(int i = 0; i < MAX_HOLDERS; i++)
+		m_aTickHolders[i] = -1;
+}
 
-	if(CreateAlt)
-		TotalSize += DataSize;
+void CSnapshotStorage::Init(CSnapshotPool *pPool)
+{
+	PurgeAll();
+	m_pPool = pPool;
+}
 
-	CHolder *pHolder = (CHolder *)mem_alloc(TotalSize, 1);
+void CSnapshotStorage::PurgeAll()
+{
+	while(m_NumHolders)
+		PurgeFirst();
+	m_FirstHolder = 0;
+}
+
+void CSnapshotStorage::PurgeFirst()
+{
+	CHolder *pHolder = &m_aHolders[m_FirstHolder];
+	if(m_aTickHolders[pHolder->m_Tick&(MAX_HOLDERS-1)] == m_FirstHolder)
+		m_aTickHolders[pHolder->m_Tick&(MAX_HOLDERS-1)] = -1;
+	m_pPool->Release(pHolder->m_pBlob);
+	if(pHolder->m_pAltBlob)
+		m_pPool->Release(pHolder->m_pAltBlob);
+	m_FirstHolder = (m_FirstHolder+1)%MAX_HOLDERS;
+	m_NumHolders--;
+}
+
+void CSnapshotStorage::PurgeUntil(int Tick)
+{
+	while(m_NumHolders && m_aHolders[m_FirstHolder].m_Tick < Tick)
+		PurgeFirst();
+}
+
+void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, int CreateAlt)
+{
+	// drop the snapshots that would share the holder or the tick
+	// index with the new one, the server purges them way before
+	if(m_NumHolders == MAX_HOLDERS)
+		PurgeFirst();
+	int TickHolder = m_aTickHolders[Tick&(MAX_HOLDERS-1)];
+	if(TickHolder != -1)
+		PurgeUntil(m_aHolders[TickHolder].m_Tick+1);
+
+	int Index = (m_FirstHolder+m_NumHolders)%MAX_HOLDERS;
+	CHolder *pHolder = &m_aHolders[Index];
+	m_NumHolders++;
+	m_aTickHolders[Tick&(MAX_HOLDERS-1)] = Index;
 
 	// set data
 	pHolder->m_Tick = Tick;
 	pHolder->m_Tagtime = Tagtime;
 	pHolder->m_SnapSize = DataSize;
-	pHolder->m_pSnap = (CSnapshot*)(pHolder+1);
-	mem_copy(pHolder->m_pSnap, pData, DataSize);
+	pHolder->m_pBlob = m_pPool->Add(pData, DataSize);
+	pHolder->m_pSnap = pHolder->m_pBlob->Snap();
 
 	if(CreateAlt) // create alternative if wanted
 	{
-		pHolder->m_pAltSnap = (CSnapshot*)(((char *)pHolder->m_pSnap) + DataSize);
-		mem_copy(pHolder->m_pAltSnap, pData, DataSize);
+		pHolder->m_pAltBlob = m_pPool->AddPrivate(pData, DataSize);
+		pHolder->m_pAltSnap = pHolder->m_pAltBlob->Snap();
 	}
 	else
+	{
+		pHolder->m_pAltBlob = 0;
 		pHolder->m_pAltSnap = 0;
-
-
-	// link
-	pHolder->m_pNext = 0;
-	pHolder->m_pPrev = m_pLast;
-	if(m_pLast)
-		m_pLast->m_pNext = pHolder;
-	else
-		m_pFirst = pHolder;
-	m_pLast = pHolder;
+	}
 }
 
 int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData)
 {
-	CHolder *pHolder = m_pFirst;
-
-	while(pHolder)
-	{
-		if(pHolder->m_Tick == Tick)
-		{
-			if(pTagtime)
-				*pTagtime = pHolder->m_Tagtime;
-			if(ppData)
-				*ppData = pHolder->m_pSnap;
-			if(ppAltData)
-				*ppAltData = pHolder->m_pAltSnap;
-			return pHolder->m_SnapSize;
-		}
-
-		pHolder = pHolder->m_pNext;
-	}
+	int Index = m_aTickHolders[Tick&(MAX_HOLDERS-1)];
+	if(Index == -1 || m_aHolders[Index].m_Tick != Tick)
+		return -1;
 
-	return -1;
+	CHolder *pHolder = &m_aHolders[Index];
+	if(pTagtime)
+		*pTagtime = pHolder->m_Tagtime;
+	if(ppData)
+		*ppData = pHolder->m_pSnap;
+	if(ppAltData)
+		*ppAltData = pHolder->m_pAltSnap;
+	return pHolder->m_SnapSize;
 }
 
 // CSnapshotBuilder
@@ -518,8 +713,35 @@ int CSnapshotBuilder::Finish(void *pSpnapData)
 	int OffsetSize = sizeof(int)*m_NumItems;
 	pSnap->m_DataSize = m_DataSize;
 	pSnap->m_NumItems = m_NumItems;
-	mem_copy(pSnap->Offsets(), m_aOffsets, OffsetSize);
-	mem_copy(pSnap->DataStart(), m_aData, m_DataSize);
+
+	bool Sorted = true;
+	for(int i = 1; i < m_NumItems && Sorted; i++)
+		Sorted = GetItem(i-1)->Key() <= GetItem(i)->Key();
+	if(Sorted)
+	{
+		mem_copy(pSnap->Offsets(), m_aOffsets, OffsetSize);
+		mem_copy(pSnap->DataStart(), m_aData, m_DataSize);
+		return sizeof(CSnapshot) + OffsetSize + m_DataSize;
+	}
+
+	// sort the items by key, so deltas can match them in one pass.
+	// equal keys keep the order they were added in
+	int aOrder[MAX_ITEMS];
+	for(int i = 0; i < m_NumItems; i++)
+		aOrder[i] = i;
+	std::stable_sort(aOrder, aOrder+m_NumItems, CKeyLess(this));
+
+	int *pOffsets = pSnap->Offsets();
+	char *pData = pSnap->DataStart();
+	int Offset = 0;
+	for(int i = 0; i < m_NumItems; i++)
+	{
+		int Index = aOrder[i];
+		int Size = (Index == m_NumItems-1 ? m_DataSize : m_aOffsets[Index+1]) - m_aOffsets[Index];
+		pOffsets[i] = Offset;
+		mem_copy(pData+Offset, &m_aData[m_aOffsets[Index]], Size);
+		Offset += Size;
+	}
 	return sizeof(CSnapshot) + OffsetSize + m_DataSize;
 }
 
@@ -39,6 +39,8 @@ public:
 	CSnapshotItem *GetItem(int Index);
 	int GetItemSize(int Index);
 	int GetItemIndex(int Key);
+	// snapshots made by CSnapshotBuilder have their items sorted by key
+	bool IsSorted();
 
 	unsigned int Crc();
 	void DebugDump();
@@ -68,6 +70,8 @@ private:
 	CData m_Empty;
 
 	void UndiffItem(int *pPast, int *pDiff, int *pOut, int Size);
+	// writes the changed and new items of pTo after the deleted keys
+	int PackUpdates(class CSnapshot *pFrom, class CSnapshot *pTo, const int *pPastIndecies, int *pData, CData *pDelta);
 
 public:
 	CSnapshotDelta();
@@ -75,35 +79,136 @@ public:
 	int GetDataUpdates(int Index) { return m_aSnapshotDataUpdates[Index]; }
 	void SetStaticsize(int ItemType, int Size);
 	CData *EmptyDelta();
+
+	/*
+		Function: CreateDelta
+			Writes the changes from pFrom to pTo to pData. Matches the
+			items of sorted snapshots by walking both at once, falls
+			back to CreateDeltaHashed otherwise. Both give the same
+			bytes.
+
+		Returns:
+			The size of the delta, 0 if nothing changed.
+	*/
 	int CreateDelta(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData);
+	// matches the items through hash lists, works for any item order
+	int CreateDeltaHashed(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData);
 	int UnpackDelta(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData, int DataSize);
 };
 
 
+// CSnapshotPool
+
+/*
+	Class: Snapshot pool
+		Stores snapshot data by content. Adding a snapshot that is
+		already in the pool only takes another reference, so clients
+		with the same view share one copy, and the same data is always
+		at the same address. Released blocks are kept in lists by size
+		for reuse, so after a while the pool doesn't touch the heap.
+		Not thread safe.
+*/
+class CSnapshotPool
+{
+public:
+	class CBlob
+	{
+	public:
+		// next in the hash chain or in the free list
+		CBlob *m_pNext;
+		unsigned m_Hash;
+		int m_Size;
+		int m_SizeClass;
+		int m_Refs;
+		// private blobs aren't in the hash table
+		bool m_Shared;
+
+		CSnapshot *Snap() { return (CSnapshot *)(this+1); }
+	};
+
+	enum
+	{
+		NUM_BUCKETS=1<<14,
+		SIZE_STEP=1024,
+		NUM_SIZE_CLASSES=CSnapshot::MAX_SIZE/SIZE_STEP,
+	};
+
+private:
+	CBlob *m_apBuckets[NUM_BUCKETS];
+	CBlob *m_apFree[NUM_SIZE_CLASSES];
+
+	CBlob *Alloc(int Size);
+
+public:
+	// heap allocations, reserved bytes and adds that found their data
+	int m_NumAllocs;
+	int64 m_NumBytes;
+	int m_NumShared;
+
+	CSnapshotPool();
+	~CSnapshotPool();
+
+	/*
+		Function: Add
+			Returns the blob with the same data, or a new one with a
+			copy of pData, with one more reference.
+	*/
+	CBlob *Add(const void *pData, int Size);
+
+	// a copy that isn't shared, for data that gets modified
+	CBlob *AddPrivate(const void *pData, int Size);
+
+	void Release(CBlob *pBlob);
+};
+
 // CSnapshotStorage
 
+/*
+	Class: Snapshot storage
+		Keeps the recent snapshots of one client in a ring of holders,
+		the data is in a shared snapshot pool. Snapshots are added in
+		tick order and purged oldest first. A holder is found by its
+		tick modulo MAX_HOLDERS.
+*/
 class CSnapshotStorage
 {
 public:
+	enum
+	{
+		// more than the 3 seconds of ticks the server keeps
+		MAX_HOLDERS=256,
+	};
+
 	class CHolder
 	{
 	public:
-		CHolder *m_pPrev;
-		CHolder *m_pNext;
-
 		int64 m_Tagtime;
 		int m_Tick;
 
 		int m_SnapSize;
 		CSnapshot *m_pSnap;
 		CSnapshot *m_pAltSnap;
+
+		CSnapshotPool::CBlob *m_pBlob;
+		CSnapshotPool::CBlob *m_pAltBlob;
 	};
 
+private:
+	CSnapshotPool *m_pPool;
 
-	CHolder *m_pFirst;
-	CHolder *m_pLast;
+	// oldest first, starting at m_FirstHolder
+	CHolder m_aHolders[MAX_HOLDERS];
+	int m_FirstHolder;
+	int m_NumHolders;
+	// holder of every tick modulo MAX_HOLDERS, -1 if none
+	short m_aTickHolders[MAX_HOLDERS];
 
-	void Init();
+	void PurgeFirst();
+
+public:
+	CSnapshotStorage();
+
+	void Init(CSnapshotPool *pPool);
 	void PurgeAll();
 	void PurgeUntil(int Tick);
 	void Add(int Tick, int64 Tagtime, int DataSize, void *pData, int CreateAlt);
@@ -123,6 +228,14 @@ class CSnapshotBuilder
 	int m_aOffsets[MAX_ITEMS];
 	int m_NumItems;
 
+	class CKeyLess
+	{
+		CSnapshotBuilder *m_pBuilder;
+	public:
+		CKeyLess(CSnapshotBuilder *pBuilder) : m_pBuilder(pBuilder) {}
+		bool operator()(int a, int b) const { return m_pBuilder->GetItem(a)->Key() < m_pBuilder->GetItem(b)->Key(); }
+	};
+
 public:
 	void Init();
 
@@ -131,6 +244,7 @@ public:
 	CSnapshotItem *GetItem(int Index);
 	int *GetItemData(int Key);
 
+	// copies the items sorted by key to pSnapdata, returns its size
 	int Finish(void *pSnapdata);
 };
 
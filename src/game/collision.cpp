@@ -3,6 +3,7 @@
 #include <base/system.h>
 #include <base/math.h>
 #include <base/vmath.h>
+#include <base/tl/threading.h>
 
 #include <math.h>
 #include <engine/map.h>
@@ -12,68 +13,108 @@
 #include <game/layers.h>
 #include <game/collision.h>
 
+// one packed layer per map, shared by every game instance playing it
+class CCollisionLayer
+{
+public:
+	const void *m_pKey;
+	int m_RefCount;
+	CCollisionLayer *m_pNext;
+	unsigned char *m_pFlags;
+};
+
+static lock s_LayersLock;
+static CCollisionLayer *s_pFirstLayer = 0;
+
+// the flags of one game layer tile packed into a byte, see GetTileFlags
+static unsigned char PackTile(const CTile *pTile)
+{
+	int Index = pTile->m_Index;
+	int Flags = 0;
+	switch(Index)
+	{
+	case TILE_DEATH: Flags = CCollision::COLFLAG_DEATH; break;
+	case TILE_SOLID: Flags = CCollision::COLFLAG_SOLID; break;
+	case TILE_NOHOOK: Flags = CCollision::COLFLAG_SOLID|CCollision::COLFLAG_NOHOOK; break;
+	//FNG Spikes
+	case CCollision::TILE_SPIKE_NORMAL: return 0x80|CCollision::FLAG_SPIKE_NORMAL<<1;
+	case CCollision::TILE_SPIKE_RED: return 0x80|CCollision::FLAG_SPIKE_RED<<1;
+	case CCollision::TILE_SPIKE_BLUE: return 0x80|CCollision::FLAG_SPIKE_BLUE<<1;
+	case CCollision::TILE_SPIKE_GOLD: return 0x80|CCollision::FLAG_SPIKE_GOLD<<1;
+	case CCollision::TILE_SPIKE_GREEN: return 0x80|CCollision::FLAG_SPIKE_GREEN<<1;
+	case CCollision::TILE_SPIKE_PURPLE: return 0x80|CCollision::FLAG_SPIKE_PURPLE<<1;
+	}
+	return Flags;
+}
+
 CCollision::CCollision()
 {
-	m_pTiles = 0;
+	m_pFlags = 0;
+	m_pLayer = 0;
 	m_Width = 0;
 	m_Height = 0;
 	m_pLayers = 0;
 }
 
+CCollision::~CCollision()
+{
+	ReleaseLayer();
+}
+
+void CCollision::ReleaseLayer()
+{
+	if(!m_pLayer)
+		return;
+
+	scope_lock Lock(&s_LayersLock);
+	if(--m_pLayer->m_RefCount == 0)
+	{
+		CCollisionLayer **ppLayer = &s_pFirstLayer;
+		while(*ppLayer != m_pLayer)
+			ppLayer = &(*ppLayer)->m_pNext;
+		*ppLayer = m_pLayer->m_pNext;
+		mem_free(m_pLayer->m_pFlags);
+		delete m_pLayer;
+	}
+	m_pLayer = 0;
+	m_pFlags = 0;
+}
+
 void CCollision::Init(class CLayers *pLayers)
 {
+	ReleaseLayer();
+
 	m_pLayers = pLayers;
 	m_Width = m_pLayers->GameLayer()->m_Width;
 	m_Height = m_pLayers->GameLayer()->m_Height;
-	m_pTiles = static_cast<CTile *>(m_pLayers->Map()->GetData(m_pLayers->GameLayer()->m_Data));
-
-	for(int i = 0; i < m_Width*m_Height; i++)
-	{
-		int Index = m_pTiles[i].m_Index;
 
-		if(Index > 128)
-			continue;
+	// the tile data of a map is shared by the games playing it, so it
+	// identifies the map as long as one of them is using it
+	const CTile *pTiles = static_cast<CTile *>(m_pLayers->Map()->GetData(m_pLayers->GameLayer()->m_Data));
 
-		switch(Index)
+	scope_lock Lock(&s_LayersLock);
+	for(CCollisionLayer *pLayer = s_pFirstLayer; pLayer; pLayer = pLayer->m_pNext)
+	{
+		if(pLayer->m_pKey == pTiles)
 		{
-		case TILE_DEATH:
-			m_pTiles[i].m_Index = COLFLAG_DEATH;
-			break;
-		case TILE_SOLID:
-			m_pTiles[i].m_Index = COLFLAG_SOLID;
-			break;
-		case TILE_NOHOOK:
-			m_pTiles[i].m_Index = COLFLAG_SOLID|COLFLAG_NOHOOK;
-			break;
-		//FNG Spikes
-		case TILE_SPIKE_NORMAL:
-			m_pTiles[i].m_Index = FLAG_SPIKE_NORMAL;
-			m_pTiles[i].m_Reserved = 1;
-			break;
-		case TILE_SPIKE_RED:
-			m_pTiles[i].m_Index = FLAG_SPIKE_RED;
-			m_pTiles[i].m_Reserved = 1;
+			m_pLayer = pLayer;
 			break;
-		case TILE_SPIKE_BLUE:
-			m_pTiles[i].m_Index = FLAG_SPIKE_BLUE;
-			m_pTiles[i].m_Reserved = 1;
-			break;
-		case TILE_SPIKE_GOLD:
-			m_pTiles[i].m_Index = FLAG_SPIKE_GOLD;
-			m_pTiles[i].m_Reserved = 1;
-			break;
-		case TILE_SPIKE_GREEN:
-			m_pTiles[i].m_Index = FLAG_SPIKE_GREEN;
-			m_pTiles[i].m_Reserved = 1;
-			break;
-		case TILE_SPIKE_PURPLE:
-			m_pTiles[i].m_Index = FLAG_SPIKE_PURPLE;
-			m_pTiles[i].m_Reserved = 1;
-			break;
-		default:
-			m_pTiles[i].m_Index = 0;
 		}
 	}
+
+	if(!m_pLayer)
+	{
+		m_pLayer = new CCollisionLayer;
+		m_pLayer->m_pKey = pTiles;
+		m_pLayer->m_RefCount = 0;
+		m_pLayer->m_pFlags = static_cast<unsigned char *>(mem_alloc(m_Width*m_Height, 1));
+		for(int i = 0; i < m_Width*m_Height; i++)
+			m_pLayer->m_pFlags[i] = PackTile(&pTiles[i]);
+		m_pLayer->m_pNext = s_pFirstLayer;
+		s_pFirstLayer = m_pLayer;
+	}
+	m_pLayer->m_RefCount++;
+	m_pFlags = m_pLayer->m_pFlags;
 }
 
 int CCollision::GetTile(int x, int y)
@@ -81,16 +122,23 @@ int CCollision::GetTile(int x, int y)
 	int Nx = clamp(x/32, 0, m_Width-1);
 	int Ny = clamp(y/32, 0, m_Height-1);
 
-	return (m_pTiles[Ny*m_Width + Nx].m_Reserved ? (m_pTiles[Ny*m_Width + Nx].m_Index << COLFLAG_SPIKE_SHIFT) : (m_pTiles[Ny*m_Width + Nx].m_Index > 128 ? 0 : m_pTiles[Ny*m_Width + Nx].m_Index));
+	return GetTileFlags(Nx, Ny);
+}
+
+int CCollision::GetTileFlags(int Nx, int Ny)
+{
+	int Flags = m_pFlags[Ny*m_Width + Nx];
+	return Flags&0x80 ? ((Flags>>1)&0x3f) << COLFLAG_SPIKE_SHIFT : Flags;
 }
 
 bool CCollision::IsTileSolid(int x, int y)
 {
-	return GetTile(x, y)&COLFLAG_SOLID;
+	// spike tiles don't use the low bit
+	return m_pFlags[clamp(y/32, 0, m_Height-1)*m_Width + clamp(x/32, 0, m_Width-1)]&COLFLAG_SOLID;
 }
 
 // TODO: rewrite this smarter!
-int CCollision::IntersectLine(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision)
+int CCollision::IntersectLineSampled(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision)
 {
 	float Distance = distance(Pos0, Pos1);
 	int End(Distance+1);
@@ -117,6 +165,140 @@ int CCollision::IntersectLine(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *p
 	return 0;
 }
 
+// the same step positions IntersectLineSampled computes
+static inline vec2 LineStep(vec2 Pos0, vec2 Pos1, float Distance, int i)
+{
+	float a = i/Distance;
+	return mix(Pos0, Pos1, a);
+}
+
+// narrows From and To to the part of the line inside Min to Max on one axis
+static inline bool ClipSlab(float Min, float Max, float Pos, float Dir, float *pFrom, float *pTo)
+{
+	if(Dir == 0)
+		return Pos >= Min && Pos <= Max;
+	float A = (Min-Pos)/Dir;
+	float B = (Max-Pos)/Dir;
+	*pFrom = max(*pFrom, min(A, B));
+	*pTo = min(*pTo, max(A, B));
+	return *pFrom <= *pTo;
+}
+
+int CCollision::IntersectLine(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision)
+{
+	float Distance = distance(Pos0, Pos1);
+	float Extent = max(max(absolute(Pos0.x), absolute(Pos0.y)), max(absolute(Pos1.x), absolute(Pos1.y)));
+	// nothing to skip on short lines, also keeps nan and huge positions
+	// away from the tile math
+	if(!(Distance > 2.0f) || !(Extent < 1000000.0f))
+		return IntersectLineSampled(Pos0, Pos1, pOutCollision, pOutBeforeCollision);
+
+	// walk the tiles the line crosses (Amanatides-Woo). A step at x is in
+	// tile floor((x+0.5)/32), clamped to the map, so the borders are at
+	// n*32-0.5. Only the steps near solid tiles are tested the way
+	// IntersectLineSampled does, the others can't hit. Near means within
+	// Slack of the piece of the line in the tile, which covers the
+	// rounding of the step positions, and within Margin steps of the
+	// range the piece covers, which covers the rounding of the walk
+	const int Margin = 2;
+	const float Slack = 0.01f + Extent*0.000001f;
+	int End(Distance+1);
+	vec2 Dir = Pos1-Pos0;
+
+	int Tx = (int)floorf((Pos0.x+0.5f)/32);
+	int Ty = (int)floorf((Pos0.y+0.5f)/32);
+	int StepX = Dir.x > 0 ? 1 : -1;
+	int StepY = Dir.y > 0 ? 1 : -1;
+	float InvX = Dir.x != 0 ? 1.0f/Dir.x : 0.0f;
+	float InvY = Dir.y != 0 ? 1.0f/Dir.y : 0.0f;
+	// the pieces on both sides of a crossed border cover the steps near
+	// it, unless the line runs along it for more than a step
+	bool AlongX = Slack*Distance*2 >= absolute(Dir.x);
+	bool AlongY = Slack*Distance*2 >= absolute(Dir.y);
+	bool EnteredX = false, EnteredY = false;
+	float Enter = 0.0f;
+	vec2 EnterPos = Pos0;
+	int Hit = End;
+	while(1)
+	{
+		float Left = Tx*32-0.5f, Top = Ty*32-0.5f;
+		float MaxX = Dir.x != 0 ? (Left+(Dir.x > 0)*32-Pos0.x)*InvX : 2.0f;
+		float MaxY = Dir.y != 0 ? (Top+(Dir.y > 0)*32-Pos0.y)*InvY : 2.0f;
+		bool ExitX = MaxX < MaxY;
+		float Exit = min(MaxX, MaxY);
+		vec2 ExitPos = Pos0 + Dir*min(Exit, 1.0f);
+		bool ExitedX = ExitX && Exit < 1.0f, ExitedY = !ExitX && Exit < 1.0f;
+
+		// the tiles near the piece, mostly just the one it's in
+		int MinX = Tx, MaxTx = Tx, MinY = Ty, MaxTy = Ty;
+		if(min(EnterPos.x, ExitPos.x)-Slack < Left && (AlongX || !(StepX > 0 ? EnteredX : ExitedX)))
+			MinX--;
+		if(max(EnterPos.x, ExitPos.x)+Slack >= Left+32 && (AlongX || !(StepX > 0 ? ExitedX : EnteredX)))
+			MaxTx++;
+		if(min(EnterPos.y, ExitPos.y)-Slack < Top && (AlongY || !(StepY > 0 ? EnteredY : ExitedY)))
+			MinY--;
+		if(max(EnterPos.y, ExitPos.y)+Slack >= Top+32 && (AlongY || !(StepY > 0 ? ExitedY : EnteredY)))
+			MaxTy++;
+		MinX = clamp(MinX, 0, m_Width-1);
+		MaxTx = clamp(MaxTx, 0, m_Width-1);
+		MinY = clamp(MinY, 0, m_Height-1);
+		MaxTy = clamp(MaxTy, 0, m_Height-1);
+		for(int y = MinY; y <= MaxTy; y++)
+			for(int x = MinX; x <= MaxTx; x++)
+			{
+				if(!(m_pFlags[y*m_Width + x]&COLFLAG_SOLID))
+					continue;
+
+				// the part of the piece near the tile, a border tile
+				// reaches on outside the map
+				float From = Enter, To = min(Exit, 1.0f);
+				if(!ClipSlab(x > 0 ? x*32-0.5f-Slack : -Extent*2, x < m_Width-1 ? x*32+31.5f+Slack : Extent*2, Pos0.x, Dir.x, &From, &To) ||
+					!ClipSlab(y > 0 ? y*32-0.5f-Slack : -Extent*2, y < m_Height-1 ? y*32+31.5f+Slack : Extent*2, Pos0.y, Dir.y, &From, &To))
+					continue;
+
+				// the ranges of the tiles overlap, keep the first hit
+				int First = max(0, (int)(From*Distance)-Margin);
+				int Last = min(Hit-1, (int)(To*Distance)+Margin);
+				for(int i = First; i <= Last; i++)
+				{
+					vec2 Pos = LineStep(Pos0, Pos1, Distance, i);
+					if(CheckPoint(Pos.x, Pos.y))
+					{
+						Hit = i;
+						break;
+					}
+				}
+			}
+
+		// later pieces only reach back Margin steps
+		if(Exit >= 1.0f || (int)(Exit*Distance)-Margin >= Hit)
+			break;
+		Enter = Exit;
+		EnterPos = ExitPos;
+		EnteredX = ExitX;
+		EnteredY = !ExitX;
+		if(ExitX)
+			Tx += StepX;
+		else
+			Ty += StepY;
+	}
+
+	if(Hit < End)
+	{
+		vec2 Pos = LineStep(Pos0, Pos1, Distance, Hit);
+		if(pOutCollision)
+			*pOutCollision = Pos;
+		if(pOutBeforeCollision)
+			*pOutBeforeCollision = Hit > 0 ? LineStep(Pos0, Pos1, Distance, Hit-1) : Pos0;
+		return GetCollisionAt(Pos.x, Pos.y);
+	}
+	if(pOutCollision)
+		*pOutCollision = Pos1;
+	if(pOutBeforeCollision)
+		*pOutBeforeCollision = Pos1;
+	return 0;
+}
+
 // TODO: OPT: rewrite this smarter!
 void CCollision::MovePoint(vec2 *pInoutPos, vec2 *pInoutVel, float Elasticity, int *pBounces)
 {
@@ -170,7 +352,36 @@ bool CCollision::TestBox(vec2 Pos, vec2 Size)
 	return false;
 }
 
-void CCollision::MoveBox(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity)
+bool CCollision::TestBoxCached(vec2 Pos, vec2 Size, CBoxCache *pCache)
+{
+	if(Pos.x > pCache->m_Min.x && Pos.x < pCache->m_Max.x && Pos.y > pCache->m_Min.y && Pos.y < pCache->m_Max.y)
+		return pCache->m_Result;
+
+	pCache->m_Result = TestBox(Pos, Size);
+
+	// the range of positions whose corners stay in the same tiles. A
+	// coordinate c is in tile n for n*32-0.5 <= c < n*32+31.5, the border
+	// tiles reach to infinity because of the clamping. The margin covers
+	// the rounding of the corner coordinates
+	const float Margin = 0.05f;
+	const float Infinity = 1e9f;
+	Size *= 0.5f;
+	int aTiles[4] = {TileX(Pos.x-Size.x), TileX(Pos.x+Size.x), TileY(Pos.y-Size.y), TileY(Pos.y+Size.y)};
+	int aLast[4] = {m_Width-1, m_Width-1, m_Height-1, m_Height-1};
+	float aMin[4], aMax[4];
+	for(int i = 0; i < 4; i++)
+	{
+		aMin[i] = aTiles[i] == 0 ? -Infinity : aTiles[i]*32-0.5f;
+		aMax[i] = aTiles[i] == aLast[i] ? Infinity : aTiles[i]*32+31.5f;
+	}
+	pCache->m_Min.x = max(aMin[0]+Size.x, aMin[1]-Size.x) + Margin;
+	pCache->m_Max.x = min(aMax[0]+Size.x, aMax[1]-Size.x) - Margin;
+	pCache->m_Min.y = max(aMin[2]+Size.y, aMin[3]-Size.y) + Margin;
+	pCache->m_Max.y = min(aMax[2]+Size.y, aMax[3]-Size.y) - Margin;
+	return pCache->m_Result;
+}
+
+void CCollision::MoveBoxSampled(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity)
 {
 	// do the move
 	vec2 Pos = *pInoutPos;
@@ -227,3 +438,58 @@ void CCollision::MoveBox(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elas
 	*pInoutPos = Pos;
 	*pInoutVel = Vel;
 }
+
+void CCollision::MoveBox(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity)
+{
+	// do the move
+	vec2 Pos = *pInoutPos;
+	vec2 Vel = *pInoutVel;
+
+	float Distance = length(Vel);
+	int Max = (int)Distance;
+
+	if(Distance > 0.00001f)
+	{
+		CBoxCache Cache;
+		Cache.m_Min = Cache.m_Max = vec2(0, 0);
+		float Fraction = 1.0f/(float)(Max+1);
+		for(int i = 0; i <= Max; i++)
+		{
+			vec2 NewPos = Pos + Vel*Fraction; // TODO: this row is not nice
+
+			if(TestBoxCached(NewPos, Size, &Cache))
+			{
+				int Hits = 0;
+
+				if(TestBox(vec2(Pos.x, NewPos.y), Size))
+				{
+					NewPos.y = Pos.y;
+					Vel.y *= -Elasticity;
+					Hits++;
+				}
+
+				if(TestBox(vec2(NewPos.x, Pos.y), Size))
+				{
+					NewPos.x = Pos.x;
+					Vel.x *= -Elasticity;
+					Hits++;
+				}
+
+				// neither of the tests got a collision.
+				// this is a real _corner case_!
+				if(Hits == 0)
+				{
+					NewPos.y = Pos.y;
+					Vel.y *= -Elasticity;
+					NewPos.x = Pos.x;
+					Vel.x *= -Elasticity;
+				}
+			}
+
+			Pos = NewPos;
+		}
+	}
+
+	*pInoutPos = Pos;
+	*pInoutVel = Vel;
+}
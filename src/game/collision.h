@@ -3,17 +3,50 @@
 #ifndef GAME_COLLISION_H
 #define GAME_COLLISION_H
 
+#include <base/math.h>
 #include <base/vmath.h>
 
+/*
+	Class: Collision
+		Answers the collision queries of a game instance. The game
+		layer is packed into one byte of flags per tile when a map is
+		loaded, games playing the same map share the packed layer.
+		The low bit is COLFLAG_SOLID, so solid checks are a single
+		load. Spike tiles set the high bit and keep their FLAG_SPIKE_*
+		bits above the low one.
+*/
 class CCollision
 {
-	class CTile *m_pTiles;
+	const unsigned char *m_pFlags;
+	class CCollisionLayer *m_pLayer;
 	int m_Width;
 	int m_Height;
 	class CLayers *m_pLayers;
 
+	void ReleaseLayer();
+
 	bool IsTileSolid(int x, int y);
 	int GetTile(int x, int y);
+	int GetTileFlags(int Nx, int Ny);
+
+	// tile column or row of a world coordinate, as used by GetTile
+	int TileX(float x) const { return clamp(round_to_int(x)/32, 0, m_Width-1); }
+	int TileY(float y) const { return clamp(round_to_int(y)/32, 0, m_Height-1); }
+
+	// the results of TestBox inside a range of positions, see MoveBox
+	struct CBoxCache
+	{
+		vec2 m_Min;
+		vec2 m_Max;
+		bool m_Result;
+	};
+	bool TestBoxCached(vec2 Pos, vec2 Size, CBoxCache *pCache);
+
+	// testing every step, the reference IntersectLine and MoveBox have
+	// to match. The test compares them
+	int IntersectLineSampled(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision);
+	void MoveBoxSampled(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity);
+	friend class CCollisionTest;
 
 public:
 	enum
@@ -54,14 +87,34 @@ public:
 	};
 
 	CCollision();
+	~CCollision();
 	void Init(class CLayers *pLayers);
 	bool CheckPoint(float x, float y) { return IsTileSolid(round_to_int(x), round_to_int(y)); }
 	bool CheckPoint(vec2 Pos) { return CheckPoint(Pos.x, Pos.y); }
 	int GetCollisionAt(float x, float y) { return GetTile(round_to_int(x), round_to_int(y)); }
 	int GetWidth() { return m_Width; };
 	int GetHeight() { return m_Height; };
+
+	/*
+		Function: IntersectLine
+			Finds the first solid point when walking from Pos0 to Pos1
+			in steps of one unit. Walks the crossed tiles and only
+			tests the steps near solid ones, the result is the same as
+			testing every step.
+
+		Returns:
+			The collision flags of the hit tile, 0 if nothing was hit.
+	*/
 	int IntersectLine(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision);
 	void MovePoint(vec2 *pInoutPos, vec2 *pInoutVel, float Elasticity, int *pBounces);
+
+	/*
+		Function: MoveBox
+			Moves a box by its velocity in steps of at most one unit
+			and bounces it off solid tiles. The tiles under the box are
+			only looked up again when a step leaves the range of
+			positions that covers the same tiles.
+	*/
 	void MoveBox(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity);
 	bool TestBox(vec2 Pos, vec2 Size);
 };
@@ -55,10 +55,30 @@ float VelocityRamp(float Value, float Start, float Range, float Curvature)
 	return 1.0f/powf(Curvature, (Value-Start)/Range);
 }
 
+void CWorldCore::SetCharacter(int ClientID, CCharacterCore *pCore)
+{
+	m_apCharacters[ClientID] = pCore;
+	if(pCore)
+	{
+		pCore->m_ClientID = ClientID;
+		m_Grid.Update(ClientID, pCore->m_Pos);
+	}
+	else
+		m_Grid.Remove(ClientID);
+}
+
+void CWorldCore::UpdateCharacter(const CCharacterCore *pCore)
+{
+	// copies of a core, like the reckoning core, aren't part of the world
+	if(pCore->m_ClientID != -1 && m_apCharacters[pCore->m_ClientID] == pCore)
+		m_Grid.Update(pCore->m_ClientID, pCore->m_Pos);
+}
+
 void CCharacterCore::Init(CWorldCore *pWorld, CCollision *pCollision)
 {
 	m_pWorld = pWorld;
 	m_pCollision = pCollision;
+	m_ClientID = -1;
 }
 
 void CCharacterCore::Reset()
@@ -215,8 +235,11 @@ void CCharacterCore::Tick(bool UseInput)
 		if(m_pWorld && m_pWorld->m_Tuning.m_PlayerHooking)
 		{
 			float Distance = 0.0f;
-			for(int i = 0; i < MAX_CLIENTS; i++)
+			int aIDs[MAX_CLIENTS];
+			int Num = m_pWorld->FindCharacters(m_HookPos, NewPos, PhysSize+2.0f, aIDs);
+			for(int n = 0; n < Num; n++)
 			{
+				int i = aIDs[n];
 				CCharacterCore *pCharCore = m_pWorld->m_apCharacters[i];
 				if(!pCharCore || pCharCore == this)
 					continue;
@@ -314,8 +337,27 @@ void CCharacterCore::TickDeferred()
 
 	if(m_pWorld)
 	{
-		for(int i = 0; i < MAX_CLIENTS; i++)
+		// only players close enough to collide with and the hooked one
+		// have an effect, in the order of their ids like before
+		int aIDs[MAX_CLIENTS];
+		int Num = m_pWorld->FindCharacters(m_Pos, m_Pos, PhysSize*1.25f, aIDs);
+		if(m_HookedPlayer >= 0 && m_HookedPlayer < MAX_CLIENTS)
 		{
+			int Insert = 0;
+			while(Insert < Num && aIDs[Insert] < m_HookedPlayer)
+				Insert++;
+			if(Insert == Num || aIDs[Insert] != m_HookedPlayer)
+			{
+				for(int n = Num; n > Insert; n--)
+					aIDs[n] = aIDs[n-1];
+				aIDs[Insert] = m_HookedPlayer;
+				Num++;
+			}
+		}
+
+		for(int n = 0; n < Num; n++)
+		{
+			int i = aIDs[n];
 			CCharacterCore *pCharCore = m_pWorld->m_apCharacters[i];
 			if(!pCharCore)
 				continue;
@@ -340,10 +382,9 @@ void CCharacterCore::TickDeferred()
 				m_Vel += Dir*a*(Velocity*0.75f);
 				m_Vel *= 0.85f;
 				
-				if(m_CoreStats.m_HadCollision[i] == 0) {
-					m_CoreStats.m_HadCollision[i] = 1;
+				if(m_CoreStats.m_HadCollision[i] == 0)
 					++m_CoreStats.m_NumTeeCollisions;
-				}
+				m_CoreStats.m_HadCollision[i] = 2;
 			}
 			//only set it to null here... should be rare that a tee bounces from another tee in the exact tick the other tee spawns and bounced from him when he died
 			else m_CoreStats.m_HadCollision[i] = 0;
@@ -366,6 +407,15 @@ void CCharacterCore::TickDeferred()
 				}
 			}
 		}
+
+		// the players that weren't found are too far away to collide
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			if(m_CoreStats.m_HadCollision[i] == 2)
+				m_CoreStats.m_HadCollision[i] = 1;
+			else if(m_CoreStats.m_HadCollision[i] && m_pWorld->m_apCharacters[i])
+				m_CoreStats.m_HadCollision[i] = 0;
+		}
 	}
 
 	// clamp the velocity to something sane
@@ -394,13 +444,15 @@ void CCharacterCore::Move()
 		float Distance = distance(m_Pos, NewPos);
 		int End = Distance+1;
 		vec2 LastPos = m_Pos;
+		int aIDs[MAX_CLIENTS];
+		int Num = m_pWorld->FindCharacters(m_Pos, NewPos, 28.0f, aIDs);
 		for(int i = 0; i < End; i++)
 		{
 			float a = i/Distance;
 			vec2 Pos = mix(m_Pos, NewPos, a);
-			for(int p = 0; p < MAX_CLIENTS; p++)
+			for(int n = 0; n < Num; n++)
 			{
-				CCharacterCore *pCharCore = m_pWorld->m_apCharacters[p];
+				CCharacterCore *pCharCore = m_pWorld->m_apCharacters[aIDs[n]];
 				if(!pCharCore || pCharCore == this)
 					continue;
 				float D = distance(Pos, pCharCore->m_Pos);
@@ -414,6 +466,7 @@ void CCharacterCore::Move()
 						m_CoreStats.m_NumTilesMoved += distance(m_Pos, NewPos);
 						m_Pos = NewPos;
 					}
+					m_pWorld->UpdateCharacter(this);
 					return;
 				}
 			}
@@ -423,6 +476,8 @@ void CCharacterCore::Move()
 
 	m_CoreStats.m_NumTilesMoved += distance(m_Pos, NewPos);
 	m_Pos = NewPos;
+	if(m_pWorld)
+		m_pWorld->UpdateCharacter(this);
 }
 
 void CCharacterCore::Write(CNetObj_CharacterCore *pObjCore)
@@ -460,6 +515,8 @@ void CCharacterCore::Read(const CNetObj_CharacterCore *pObjCore)
 	m_Jumped = pObjCore->m_Jumped;
 	m_Direction = pObjCore->m_Direction;
 	m_Angle = pObjCore->m_Angle;
+	if(m_pWorld)
+		m_pWorld->UpdateCharacter(this);
 }
 
 void CCharacterCore::Quantize()
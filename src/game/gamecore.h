@@ -8,6 +8,7 @@
 
 #include <math.h>
 #include "collision.h"
+#include "spatialgrid.h"
 #include <engine/shared/protocol.h>
 #include <game/generated/protocol.h>
 
@@ -71,11 +72,12 @@ inline float GetAngle(vec2 Dir)
 
 inline void StrToInts(int *pInts, int Num, const char *pStr)
 {
+	int Length = str_length(pStr);
 	int Index = 0;
 	while(Num)
 	{
 		char aBuf[4] = {0,0,0,0};
-		for(int c = 0; c < 4 && pStr[Index]; c++, Index++)
+		for(int c = 0; c < 4 && Index < Length; c++, Index++)
 			aBuf[c] = pStr[Index];
 		*pInts = ((aBuf[0]+128)<<24)|((aBuf[1]+128)<<16)|((aBuf[2]+128)<<8)|(aBuf[3]+128);
 		pInts++;
@@ -162,6 +164,9 @@ enum
 
 class CWorldCore
 {
+	// the characters by position, so a character only tests the ones near it
+	CSpatialGrid m_Grid;
+
 public:
 	CWorldCore()
 	{
@@ -170,12 +175,31 @@ public:
 
 	CTuningParams m_Tuning;
 	class CCharacterCore *m_apCharacters[MAX_CLIENTS];
+
+	// adds or removes (pCore = 0) the character of a client, don't write m_apCharacters directly
+	void SetCharacter(int ClientID, class CCharacterCore *pCore);
+	// moves a character to the grid cell of its current position
+	void UpdateCharacter(const class CCharacterCore *pCore);
+
+	/*
+		Function: FindCharacters
+			Finds the characters that could be within Radius of the
+			line from From to To.
+
+		Returns:
+			Number of client ids written to pIDs, sorted ascending.
+			pIDs has to fit MAX_CLIENTS ids.
+	*/
+	int FindCharacters(vec2 From, vec2 To, float Radius, int *pIDs) const { return m_Grid.Query(From, To, Radius, pIDs); }
 };
 
 class CCharacterCore
 {
+	friend class CWorldCore;
 	CWorldCore *m_pWorld;
 	CCollision *m_pCollision;
+	// client id in m_pWorld, -1 if it isn't part of the world
+	int m_ClientID;
 public:
 	vec2 m_Pos;
 	vec2 m_Vel;
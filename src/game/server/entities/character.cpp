@@ -80,7 +80,7 @@ bool CCharacter::Spawn(CPlayer *pPlayer, vec2 Pos)
 	m_Core.Reset();
 	m_Core.Init(&GameServer()->m_World.m_Core, GameServer()->Collision());
 	m_Core.m_Pos = m_Pos;
-	GameServer()->m_World.m_Core.m_apCharacters[m_pPlayer->GetCID()] = &m_Core;
+	GameServer()->m_World.m_Core.SetCharacter(m_pPlayer->GetCID(), &m_Core);
 
 	m_ReckoningTick = 0;
 	mem_zero(&m_SendCore, sizeof(m_SendCore));
@@ -110,7 +110,7 @@ void CCharacter::Destroy()
 {
 	if(g_Config.m_SvSmoothFreezeMode)
 		GameServer()->SendTuningParams(m_pPlayer->GetCID());
-	GameServer()->m_World.m_Core.m_apCharacters[m_pPlayer->GetCID()] = 0;
+	GameServer()->m_World.m_Core.SetCharacter(m_pPlayer->GetCID(), 0);
 	m_Alive = false;
 }
 
@@ -689,6 +689,7 @@ void CCharacter::TickDefered()
 		m_Pos.x = m_Input.m_TargetX;
 		m_Pos.y = m_Input.m_TargetY;
 	}
+	GameWorld()->UpdateEntity(this);
 
 	// update the m_SendCore if needed
 	{
@@ -778,7 +779,7 @@ void CCharacter::Die(int Killer, int Weapon)
 
 	m_Alive = false;
 	GameServer()->m_World.RemoveEntity(this);
-	GameServer()->m_World.m_Core.m_apCharacters[m_pPlayer->GetCID()] = 0;
+	GameServer()->m_World.m_Core.SetCharacter(m_pPlayer->GetCID(), 0);
 	GameServer()->CreateDeath(m_Pos, m_pPlayer->GetCID());
 }
 
@@ -20,6 +20,7 @@ CEntity::CEntity(CGameWorld *pGameWorld, int ObjType)
 
 	m_pPrevTypeEntity = 0;
 	m_pNextTypeEntity = 0;
+	m_GridID = -1;
 }
 
 CEntity::~CEntity()
@@ -36,17 +37,13 @@ int CEntity::NetworkClipped(int SnappingClient)
 int CEntity::NetworkClipped(int SnappingClient, vec2 CheckPos)
 {
 	if(SnappingClient == -1)
+	{
+		// shared snap: clipping is done per client on the cached items
+		GameWorld()->SetSnapClipPos(CheckPos);
 		return 0;
+	}
 
-	float dx = GameServer()->m_apPlayers[SnappingClient]->m_ViewPos.x-CheckPos.x;
-	float dy = GameServer()->m_apPlayers[SnappingClient]->m_ViewPos.y-CheckPos.y;
-
-	if(absolute(dx) > 1000.0f || absolute(dy) > 800.0f)
-		return 1;
-
-	if(distance(GameServer()->m_apPlayers[SnappingClient]->m_ViewPos, CheckPos) > 1100.0f)
-		return 1;
-	return 0;
+	return GameWorld()->NetworkClipped(SnappingClient, CheckPos) ? 1 : 0;
 }
 
 bool CEntity::GameLayerClipped(vec2 CheckPos)
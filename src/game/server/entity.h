@@ -61,6 +61,8 @@ class CEntity
 	friend class CGameWorld;	// entity list handling
 	CEntity *m_pPrevTypeEntity;
 	CEntity *m_pNextTypeEntity;
+	// id in the character grid of the world, -1 if it isn't in the grid
+	int m_GridID;
 
 	class CGameWorld *m_pGameWorld;
 protected:
@@ -51,7 +51,21 @@ void CEventHandler::Snap(int SnappingClient)
 			{
 				void *d = GameServer()->Server()->SnapNewItem(m_aTypes[i], i, m_aSizes[i]);
 				if(d)
+				{
 					mem_copy(d, &m_aData[m_aOffsets[i]], m_aSizes[i]);
+
+					// the client only knows the ids it got mapped, take the chat slot for the others.
+					// without a player the client keeps the ids as they are
+					CPlayer *pViewer = SnappingClient != -1 ? GameServer()->m_apPlayers[SnappingClient] : 0;
+					if(m_aTypes[i] == NETEVENTTYPE_DEATH && pViewer)
+					{
+						CNetEvent_Death *pDeath = (CNetEvent_Death *)d;
+						int ID = pDeath->m_ClientID;
+						if(!pViewer->IsSnappingClient(pDeath->m_ClientID, pViewer->m_ClientVersion, ID))
+							ID = pViewer->m_ClientVersion == CPlayer::CLIENT_VERSION_DDNET ? CPlayer::DDNET_CLIENT_MAX_CLIENTS - 1 : CPlayer::VANILLA_CLIENT_MAX_CLIENTS - 1;
+						pDeath->m_ClientID = ID;
+					}
+				}
 			}
 		}
 	}
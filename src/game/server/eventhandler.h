@@ -68,7 +68,7 @@ struct QuadroMask {
 	
 	int PositionOfNonZeroBit(int Offset){
 		for(int i = (Offset/64); i < 4; ++i){
-			for(int n = (Offset%64); n < 64; ++n){
+			for(int n = (i == Offset/64 ? Offset%64 : 0); n < 64; ++n){
 				if((m_Mask[i] & (1ll << n)) != 0){
 					return i * 64 + n;
 				}
@@ -78,7 +78,7 @@ struct QuadroMask {
 	}
 	
 	void SetBitOfPosition(int Pos){
-		m_Mask[Pos / 64] |= 1 << (Pos % 64);
+		m_Mask[Pos / 64] |= 1ll << (Pos % 64);
 	}
 };
 #endif
@@ -486,8 +486,8 @@ void CGameContext::SendTuningParams(int ClientID)
 //tune for frozen tees
 void CGameContext::SendFakeTuningParams(int ClientID)
 {
-	static CTuningParams FakeTuning;
-	
+	CTuningParams FakeTuning;
+
 	FakeTuning.m_GroundControlSpeed = 0;
 	FakeTuning.m_GroundJumpImpulse = 0;
 	FakeTuning.m_GroundControlAccel = 0;
@@ -532,6 +532,7 @@ void CGameContext::OnTick()
 
 	//if(world.paused) // make sure that the game object always updates
 	m_pController->Tick();
+	m_Rating.Tick();
 
 	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
@@ -1896,6 +1897,7 @@ void CGameContext::OnInit(/*class IKernel *pKernel*/)
 
 	m_Layers.Init(Kernel());
 	m_Collision.Init(&m_Layers);
+	m_Rating.Init(Server()->DbPool());
 
 	// select gametype
 	if (str_comp(m_Config->m_SvGametype, "fng2") == 0)
@@ -1979,6 +1981,7 @@ void CGameContext::OnInit(IKernel *pKernel, IMap* pMap, CConfiguration* pConfigF
 
 	m_Layers.Init(kernel, pMap);
 	m_Collision.Init(&m_Layers);
+	m_Rating.Init(Server()->DbPool());
 
 	
 	CConfiguration* pConfig;
@@ -2037,6 +2040,7 @@ void CGameContext::OnInit(IKernel *pKernel, IMap* pMap, CConfiguration* pConfigF
 
 void CGameContext::OnShutdown()
 {
+	m_Rating.Flush(true);
 	delete m_pController;
 	m_pController = 0;
 	Clear();
@@ -2053,7 +2057,7 @@ void CGameContext::OnSnap(int ClientID)
 {
 	// add tuning to demo
 	CTuningParams StandardTuning;
-	if(ClientID == -1 && Server()->DemoRecorder_IsRecording() && mem_comp(&StandardTuning, &m_Tuning, sizeof(CTuningParams)) != 0)
+	if(ClientID == -1 && Server()->DemoRecorder_IsRecording(this) && mem_comp(&StandardTuning, &m_Tuning, sizeof(CTuningParams)) != 0)
 	{
 		CMsgPacker Msg(NETMSGTYPE_SV_TUNEPARAMS);
 		int *pParams = (int *)&m_Tuning;
@@ -2086,7 +2090,11 @@ void CGameContext::OnSnap(int ClientID)
 		}
 	}
 }
-void CGameContext::OnPreSnap() {}
+void CGameContext::OnPreSnap()
+{
+	m_World.PreSnap();
+}
+
 void CGameContext::OnPostSnap()
 {
 	m_Events.Clear();
@@ -2151,6 +2159,11 @@ void CGameContext::SendRoundStats() {
 		SendChatTarget(i, "╚══════════════════════════");
 		SendChatTarget(i, "Press F1 to view stats now!!");
 
+		int aStats[CRating::NUM_STATS] = {1, p->m_Stats.m_Kills, p->m_Stats.m_Hits, p->m_Stats.m_Deaths, p->m_Stats.m_Shots,
+			p->m_Stats.m_GrabsNormal, p->m_Stats.m_GrabsTeam, p->m_Stats.m_GrabsGold, p->m_Stats.m_GrabsGreen, p->m_Stats.m_GrabsPurple,
+			p->m_Stats.m_GrabsFalse, p->m_Stats.m_Selfkills, p->m_Stats.m_Teamkills, p->m_Stats.m_Unfreezes};
+		m_Rating.AddRoundStats(Server()->ClientName(i), aStats);
+
 		float kd = ((p->m_Stats.m_Hits != 0) ? (float)((float)p->m_Stats.m_Kills / (float)p->m_Stats.m_Hits) : (float)p->m_Stats.m_Kills);
 		if (bestKD < kd) {
 			bestKD = kd;
@@ -2172,6 +2185,9 @@ void CGameContext::SendRoundStats() {
 		}
 	}
 
+	// the round is over, write it out right away
+	m_Rating.Flush();
+
 	int bestKDCount = bestKDPlayerIDs.Count();
 	if (bestKDCount > 0) {
 		char buff[300];
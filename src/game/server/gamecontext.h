@@ -14,6 +14,7 @@
 #include "gamecontroller.h"
 #include "gameworld.h"
 #include "player.h"
+#include "rating.h"
 
 #include <string>
 
@@ -80,7 +81,7 @@ struct QuadroMask {
 
 	int PositionOfNonZeroBit(int Offset) {
 		for (int i = (Offset / 64); i < 4; ++i) {
-			for (int n = (Offset % 64); n < 64; ++n) {
+			for (int n = (i == Offset / 64 ? Offset % 64 : 0); n < 64; ++n) {
 				if ((m_Mask[i] & (1ll << n)) != 0) {
 					return i * 64 + n;
 				}
@@ -90,7 +91,7 @@ struct QuadroMask {
 	}
 	
 	void SetBitOfPosition(int Pos){
-		m_Mask[Pos / 64] |= 1 << (Pos % 64);
+		m_Mask[Pos / 64] |= 1ll << (Pos % 64);
 	}
 };
 #endif
@@ -213,6 +214,7 @@ public:
 
 	IGameController *m_pController;
 	CGameWorld m_World;
+	CRating m_Rating;
 
 	// helper functions
 	class CCharacter *GetPlayerChar(int ClientID);
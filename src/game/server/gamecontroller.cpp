@@ -250,7 +250,7 @@ void IGameController::StartRound()
 	m_aTeamscore[TEAM_RED] = 0;
 	m_aTeamscore[TEAM_BLUE] = 0;
 	m_ForceBalanced = false;
-	Server()->DemoRecorder_HandleAutoStart();
+	Server()->DemoRecorder_HandleAutoStart(GameServer());
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "start round type='%s' teamplay='%d'", m_pGameType, m_GameFlags&GAMEFLAG_TEAMS);
 	GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
@@ -270,6 +270,8 @@ void IGameController::CycleMap()
 		str_format(aBuf, sizeof(aBuf), "rotating map to %s", m_aMapWish);
 		GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
 		str_copy(m_Config.m_SvMap, m_aMapWish, sizeof(m_Config.m_SvMap));
+		if(!m_CustomConfig)
+			Server()->ChangeGameServerMap(0, m_Config.m_SvMap);
 		m_aMapWish[0] = 0;
 		m_RoundCount = 0;
 		return;
@@ -336,6 +338,8 @@ void IGameController::CycleMap()
 	str_format(aBufMsg, sizeof(aBufMsg), "rotating map to %s", &aBuf[i]);
 	GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
 	str_copy(m_Config.m_SvMap, &aBuf[i], sizeof(m_Config.m_SvMap));
+	if(!m_CustomConfig)
+		Server()->ChangeGameServerMap(0, m_Config.m_SvMap);
 }
 
 void IGameController::PostReset()
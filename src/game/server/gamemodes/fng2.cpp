@@ -357,5 +357,5 @@ void CGameControllerFNG2::EndRound()
 }
 void CGameControllerFNG2::UpdatePlayerRating(const char* pName, int Points)
 {
-	
+	GameServer()->m_Rating.AddPoints(pName, Points);
 }
\ No newline at end of file
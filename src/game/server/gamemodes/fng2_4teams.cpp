@@ -608,7 +608,7 @@ void CGameControllerFNG24Teams::StartRound()
 	m_a4TeamLastScore[TEAM_GREEN] = 0;
 	m_a4TeamLastScore[TEAM_PURPLE] = 0;
 	m_ForceBalanced = false;
-	Server()->DemoRecorder_HandleAutoStart();
+	Server()->DemoRecorder_HandleAutoStart(GameServer());
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "start round type='%s' teamplay='%d'", m_pGameType, m_GameFlags&GAMEFLAG_TEAMS);
 	GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
@@ -4,6 +4,7 @@
 #include "gameworld.h"
 #include "entity.h"
 #include "gamecontext.h"
+#include "entities/character.h"
 
 //////////////////////////////////////////////////
 // game world
@@ -17,6 +18,14 @@ CGameWorld::CGameWorld()
 	m_ResetRequested = false;
 	for(int i = 0; i < NUM_ENTTYPES; i++)
 		m_apFirstEntityTypes[i] = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		m_apGridCharacters[i] = 0;
+
+	m_NumSnapCacheItems = 0;
+	m_SnapCacheDataSize = 0;
+	m_SnapCacheTick = -1;
+	m_SnapCaching = false;
+	m_SnapCacheClipPos = vec2(0,0);
 }
 
 CGameWorld::~CGameWorld()
@@ -44,6 +53,25 @@ int CGameWorld::FindEntities(vec2 Pos, float Radius, CEntity **ppEnts, int Max,
 		return 0;
 
 	int Num = 0;
+	if(Type == ENTTYPE_CHARACTER)
+	{
+		int aIDs[MAX_CLIENTS];
+		int NumFound = m_CharacterGrid.Query(Pos, Pos, Radius+CCharacter::ms_PhysSize, aIDs);
+		for(int i = 0; i < NumFound; i++)
+		{
+			CEntity *pEnt = m_apGridCharacters[aIDs[i]];
+			if(distance(pEnt->m_Pos, Pos) < Radius+pEnt->m_ProximityRadius)
+			{
+				if(ppEnts)
+					ppEnts[Num] = pEnt;
+				Num++;
+				if(Num == Max)
+					break;
+			}
+		}
+		return Num;
+	}
+
 	for(CEntity *pEnt = m_apFirstEntityTypes[Type];	pEnt; pEnt = pEnt->m_pNextTypeEntity)
 	{
 		if(distance(pEnt->m_Pos, Pos) < Radius+pEnt->m_ProximityRadius)
@@ -72,6 +100,19 @@ void CGameWorld::InsertEntity(CEntity *pEnt)
 	pEnt->m_pNextTypeEntity = m_apFirstEntityTypes[pEnt->m_ObjType];
 	pEnt->m_pPrevTypeEntity = 0x0;
 	m_apFirstEntityTypes[pEnt->m_ObjType] = pEnt;
+
+	if(pEnt->m_ObjType == ENTTYPE_CHARACTER)
+	{
+		pEnt->m_GridID = ((CCharacter *)pEnt)->GetPlayer()->GetCID();
+		m_apGridCharacters[pEnt->m_GridID] = pEnt;
+		m_CharacterGrid.Update(pEnt->m_GridID, pEnt->m_Pos);
+	}
+}
+
+void CGameWorld::UpdateEntity(CEntity *pEnt)
+{
+	if(pEnt->m_GridID != -1)
+		m_CharacterGrid.Update(pEnt->m_GridID, pEnt->m_Pos);
 }
 
 void CGameWorld::DestroyEntity(CEntity *pEnt)
@@ -99,18 +140,100 @@ void CGameWorld::RemoveEntity(CEntity *pEnt)
 
 	pEnt->m_pNextTypeEntity = 0;
 	pEnt->m_pPrevTypeEntity = 0;
+
+	if(pEnt->m_GridID != -1)
+	{
+		m_CharacterGrid.Remove(pEnt->m_GridID);
+		m_apGridCharacters[pEnt->m_GridID] = 0;
+		pEnt->m_GridID = -1;
+	}
 }
 
 //
-void CGameWorld::Snap(int SnappingClient)
+bool CGameWorld::NetworkClipped(int SnappingClient, vec2 CheckPos)
+{
+	CPlayer *pPlayer = GameServer()->m_apPlayers[SnappingClient];
+	if(!pPlayer)
+		return true;
+
+	float dx = pPlayer->m_ViewPos.x-CheckPos.x;
+	float dy = pPlayer->m_ViewPos.y-CheckPos.y;
+
+	if(absolute(dx) > 1000.0f || absolute(dy) > 800.0f)
+		return true;
+
+	if(distance(pPlayer->m_ViewPos, CheckPos) > 1100.0f)
+		return true;
+	return false;
+}
+
+void *CGameWorld::SnapNewItem(int Type, int ID, int Size)
 {
+	if(!m_SnapCaching)
+		return Server()->SnapNewItem(Type, ID, Size);
+
+	if(m_NumSnapCacheItems == SNAPCACHE_MAX_ITEMS || m_SnapCacheDataSize+Size > SNAPCACHE_MAX_DATASIZE)
+		return 0;
+
+	CSnapCacheItem *pItem = &m_aSnapCacheItems[m_NumSnapCacheItems++];
+	pItem->m_Type = Type;
+	pItem->m_ID = ID;
+	pItem->m_Size = Size;
+	pItem->m_Offset = m_SnapCacheDataSize;
+	pItem->m_ClipPos = m_SnapCacheClipPos;
+
+	void *pData = (char *)m_aSnapCacheData + m_SnapCacheDataSize;
+	mem_zero(pData, Size);
+	m_SnapCacheDataSize += (Size+sizeof(int)-1)&~(sizeof(int)-1);
+	return pData;
+}
+
+void CGameWorld::PreSnap()
+{
+	m_NumSnapCacheItems = 0;
+	m_SnapCacheDataSize = 0;
+	m_SnapCacheTick = Server()->Tick();
+
+	// characters depend on the viewer (id translation, health, hook), snap them per client
+	m_SnapCaching = true;
 	for(int i = 0; i < NUM_ENTTYPES; i++)
+	{
+		if(i == ENTTYPE_CHARACTER)
+			continue;
 		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
 		{
 			m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
-			pEnt->Snap(SnappingClient);
+			m_SnapCacheClipPos = pEnt->m_Pos;
+			pEnt->Snap(-1);
 			pEnt = m_pNextTraverseEntity;
 		}
+	}
+	m_SnapCaching = false;
+}
+
+void CGameWorld::Snap(int SnappingClient)
+{
+	if(m_SnapCacheTick != Server()->Tick())
+		PreSnap();
+
+	for(int i = 0; i < m_NumSnapCacheItems; i++)
+	{
+		const CSnapCacheItem *pItem = &m_aSnapCacheItems[i];
+		if(SnappingClient != -1 && NetworkClipped(SnappingClient, pItem->m_ClipPos))
+			continue;
+
+		void *pData = Server()->SnapNewItem(pItem->m_Type, pItem->m_ID, pItem->m_Size);
+		if(!pData)
+			break;
+		mem_copy(pData, (char *)m_aSnapCacheData + pItem->m_Offset, pItem->m_Size);
+	}
+
+	for(CEntity *pEnt = m_apFirstEntityTypes[ENTTYPE_CHARACTER]; pEnt; )
+	{
+		m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
+		pEnt->Snap(SnappingClient);
+		pEnt = m_pNextTraverseEntity;
+	}
 }
 
 void CGameWorld::Reset()
@@ -205,9 +328,11 @@ CCharacter *CGameWorld::IntersectCharacter(vec2 Pos0, vec2 Pos1, float Radius, v
 	float ClosestLen = distance(Pos0, Pos1) * 100.0f;
 	CCharacter *pClosest = 0;
 
-	CCharacter *p = (CCharacter *)FindFirst(ENTTYPE_CHARACTER);
-	for(; p; p = (CCharacter *)p->TypeNext())
+	int aIDs[MAX_CLIENTS];
+	int Num = m_CharacterGrid.Query(Pos0, Pos1, Radius+CCharacter::ms_PhysSize, aIDs);
+	for(int i = 0; i < Num; i++)
  	{
+		CCharacter *p = (CCharacter *)m_apGridCharacters[aIDs[i]];
 		if(p == pNotThis)
 			continue;
 
@@ -235,9 +360,11 @@ CCharacter *CGameWorld::ClosestCharacter(vec2 Pos, float Radius, CEntity *pNotTh
 	float ClosestRange = Radius*2;
 	CCharacter *pClosest = 0;
 
-	CCharacter *p = (CCharacter *)GameServer()->m_World.FindFirst(ENTTYPE_CHARACTER);
-	for(; p; p = (CCharacter *)p->TypeNext())
+	int aIDs[MAX_CLIENTS];
+	int Num = m_CharacterGrid.Query(Pos, Pos, Radius+CCharacter::ms_PhysSize, aIDs);
+	for(int i = 0; i < Num; i++)
  	{
+		CCharacter *p = (CCharacter *)m_apGridCharacters[aIDs[i]];
 		if(p == pNotThis)
 			continue;
 
@@ -4,6 +4,7 @@
 #define GAME_SERVER_GAMEWORLD_H
 
 #include <game/gamecore.h>
+#include <game/spatialgrid.h>
 
 class CEntity;
 class CCharacter;
@@ -33,9 +34,38 @@ private:
 	CEntity *m_pNextTraverseEntity;
 	CEntity *m_apFirstEntityTypes[NUM_ENTTYPES];
 
+	// the characters by position, indexed by client id
+	CSpatialGrid m_CharacterGrid;
+	CEntity *m_apGridCharacters[MAX_CLIENTS];
+
 	class CGameContext *m_pGameServer;
 	class IServer *m_pServer;
 
+	// client-independent snap items, built once per snap tick and
+	// copied into every client's snapshot after clipping
+	enum
+	{
+		SNAPCACHE_MAX_ITEMS=1024,
+		SNAPCACHE_MAX_DATASIZE=64*1024,
+	};
+
+	struct CSnapCacheItem
+	{
+		int m_Type;
+		int m_ID;
+		int m_Size;
+		int m_Offset;
+		vec2 m_ClipPos;
+	};
+
+	CSnapCacheItem m_aSnapCacheItems[SNAPCACHE_MAX_ITEMS];
+	int m_aSnapCacheData[SNAPCACHE_MAX_DATASIZE/sizeof(int)];
+	int m_NumSnapCacheItems;
+	int m_SnapCacheDataSize;
+	int m_SnapCacheTick;
+	bool m_SnapCaching;
+	vec2 m_SnapCacheClipPos;
+
 public:
 	class CGameContext *GameServer() { return m_pGameServer; }
 	class IServer *Server() { return m_pServer; }
@@ -116,6 +146,16 @@ public:
 	*/
 	void RemoveEntity(CEntity *pEntity);
 
+	/*
+		Function: update_entity
+			Moves an entity to its new position in the grid, has to be
+			called whenever the position of a character changes.
+
+		Arguments:
+			entity - Entity that moved
+	*/
+	void UpdateEntity(CEntity *pEntity);
+
 	/*
 		Function: destroy_entity
 			Destroys an entity in the world.
@@ -136,6 +176,36 @@ public:
 	*/
 	void Snap(int SnappingClient);
 
+	/*
+		Function: pre_snap
+			Snaps all viewer independent entities once into the shared
+			snap cache. Snap() copies the cached items that pass the
+			clipping test for the snapping client instead of snapping
+			those entities again.
+	*/
+	void PreSnap();
+
+	/*
+		Function: snap_new_item
+			Allocates a snapshot item for an entity. While the shared
+			snap cache is being built the item is stored in the cache,
+			otherwise it goes straight into the server's snapshot.
+	*/
+	void *SnapNewItem(int Type, int ID, int Size);
+
+	/*
+		Function: snap_clip_pos
+			Sets the position the following cached items are clipped
+			against. Called by CEntity::NetworkClipped for shared snaps.
+	*/
+	void SetSnapClipPos(vec2 Pos) { m_SnapCacheClipPos = Pos; }
+
+	/*
+		Function: network_clipped
+			Returns true if CheckPos is out of the view of the snapping client.
+	*/
+	bool NetworkClipped(int SnappingClient, vec2 CheckPos);
+
 	/*
 		Function: tick
 			Calls tick on all the entities in the world to progress
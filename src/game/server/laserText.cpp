@@ -490,7 +490,7 @@ void CLaserText::Snap(int SnappingClient)
 		return;
 	
 	for(int i = 0; i < m_CharNum; ++i){
-		CNetObj_Laser *pObj = static_cast<CNetObj_Laser *>(Server()->SnapNewItem(NETOBJTYPE_LASER, m_Chars[i]->getID(), sizeof(CNetObj_Laser)));
+		CNetObj_Laser *pObj = static_cast<CNetObj_Laser *>(GameWorld()->SnapNewItem(NETOBJTYPE_LASER, m_Chars[i]->getID(), sizeof(CNetObj_Laser)));
 		if(!pObj)
 			return;
 
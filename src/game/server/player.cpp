@@ -34,8 +34,11 @@ CPlayer::CPlayer(CGameContext *pGameServer, int ClientID, int Team)
 	m_UnknownPlayerFlag = 0;
 	
 	memset(m_SnappingClients, -1, sizeof(m_SnappingClients));
+	memset(m_aSnapIDs, -1, sizeof(m_aSnapIDs));
 	m_SnappingClients[0].id = ClientID;
 	m_SnappingClients[0].distance = 0;
+	m_aSnapIDs[ClientID] = 0;
+	m_NextSnapID = 1;
 	for (int i = 1; i < DDNET_CLIENT_MAX_CLIENTS; ++i) {
 		m_SnappingClients[i].distance = INFINITY;
 	}
@@ -319,6 +322,7 @@ void CPlayer::SetTeam(int Team, bool DoChatMsg)
 	m_Team = Team;
 	m_LastActionTick = Server()->Tick();
 	m_SpectatorID = SPEC_FREEVIEW;
+	Server()->ExpireServerInfo();
 	// we got to wait 0.5 secs before respawning
 	m_RespawnTick = Server()->Tick()+Server()->TickSpeed()/2;
 	str_format(aBuf, sizeof(aBuf), "team_join player='%d:%s' m_Team=%d", m_ClientID, Server()->ClientName(m_ClientID), m_Team);
@@ -347,6 +351,7 @@ void CPlayer::SetTeamSilent(int Team)
 	m_Team = Team;
 	m_LastActionTick = Server()->Tick();
 	m_SpectatorID = SPEC_FREEVIEW;
+	Server()->ExpireServerInfo();
 
 	GameServer()->m_pController->OnPlayerInfoChange(GameServer()->m_apPlayers[m_ClientID]);
 
@@ -391,108 +396,84 @@ void CPlayer::ResetStats(){
 	mem_zero(&m_Stats, sizeof(m_Stats));
 }
 
+int CPlayer::NumSnapIDs(char ClientVersion) {
+	// VANILLA_CLIENT_MAX_CLIENTS - 1 to allow chatting!!
+	if (ClientVersion == CLIENT_VERSION_NORMAL && (int)MAX_CLIENTS > (int)VANILLA_CLIENT_MAX_CLIENTS) return VANILLA_CLIENT_MAX_CLIENTS - 1;
+	if ((int)MAX_CLIENTS > (int)DDNET_CLIENT_MAX_CLIENTS) return DDNET_CLIENT_MAX_CLIENTS - 1;
+	return 0;
+}
+
+void CPlayer::SetSnapID(int SnapID, int RealID, float Distance) {
+	if (m_SnappingClients[SnapID].id != -1) m_aSnapIDs[m_SnappingClients[SnapID].id] = -1;
+	m_SnappingClients[SnapID].id = RealID;
+	m_SnappingClients[SnapID].distance = Distance;
+	m_aSnapIDs[RealID] = SnapID;
+}
+
 bool CPlayer::AddSnappingClient(int RealID, float Distance, char ClientVersion, int& pId) {
+	int NumIDs = NumSnapIDs(ClientVersion);
 	if (RealID == m_ClientID) {
-		if ((ClientVersion == CLIENT_VERSION_NORMAL && (int)MAX_CLIENTS > (int)VANILLA_CLIENT_MAX_CLIENTS) || ((int)MAX_CLIENTS > (int)DDNET_CLIENT_MAX_CLIENTS)) pId = 0;
+		if (NumIDs) pId = 0;
 		return true;
 	}
-	else if (ClientVersion == CLIENT_VERSION_NORMAL && (int)MAX_CLIENTS > (int)VANILLA_CLIENT_MAX_CLIENTS) {
-		int id = -1;
-		float highestDistance = 0;
-		// VANILLA_CLIENT_MAX_CLIENTS - 1 to allow chatting!!
-		for (int i = 1; i < VANILLA_CLIENT_MAX_CLIENTS - 1; ++i) {
-			if (m_SnappingClients[i].id == -1 || m_SnappingClients[i].id == RealID) {
-				m_SnappingClients[i].id = RealID;
-				m_SnappingClients[i].distance = Distance;
-				pId = i;
-				return true;
-			}
-			if (highestDistance < m_SnappingClients[i].distance || (!GameServer()->m_apPlayers[m_SnappingClients[i].id] || !GameServer()->m_apPlayers[m_SnappingClients[i].id]->GetCharacter())) {
-				id = i;
-				if (!GameServer()->m_apPlayers[m_SnappingClients[i].id] || !GameServer()->m_apPlayers[m_SnappingClients[i].id]->GetCharacter()) highestDistance = INFINITY;
-				else highestDistance = m_SnappingClients[i].distance;
-			}
-		}
-		
-		if (id > -1 && highestDistance > Distance) {
-			m_SnappingClients[id].id = RealID;
-			m_SnappingClients[id].distance = Distance;
-			pId = id;
-			return false;
-		}
+	else if (!NumIDs) return true;
+
+	int SnapID = m_aSnapIDs[RealID];
+	if (SnapID != -1 && SnapID < NumIDs) {
+		m_SnappingClients[SnapID].distance = Distance;
+		pId = SnapID;
+		return true;
 	}
-	else {
-		if ((int)MAX_CLIENTS > (int)DDNET_CLIENT_MAX_CLIENTS) {
-			int id = -1;
-			float highestDistance = 0;
-			for (int i = 1; i < DDNET_CLIENT_MAX_CLIENTS - 1; ++i) {
-				if (m_SnappingClients[i].id == -1 || m_SnappingClients[i].id == RealID) {
-					m_SnappingClients[i].id = RealID;
-					m_SnappingClients[i].distance = Distance;
-					pId = i;
-					return true;
-				}
-				if (highestDistance < m_SnappingClients[i].distance || (!GameServer()->m_apPlayers[m_SnappingClients[i].id] || !GameServer()->m_apPlayers[m_SnappingClients[i].id]->GetCharacter())) {
-					id = i;
-					if (!GameServer()->m_apPlayers[m_SnappingClients[i].id] || !GameServer()->m_apPlayers[m_SnappingClients[i].id]->GetCharacter()) highestDistance = INFINITY;
-					else highestDistance = m_SnappingClients[i].distance;
-				}
-			}
-			
-			if (id > -1 && highestDistance > Distance) {
-				m_SnappingClients[id].id = RealID;
-				m_SnappingClients[id].distance = Distance;
-				pId = id;
-				return false;
-			}
+	if (m_NextSnapID < NumIDs) {
+		SetSnapID(m_NextSnapID, RealID, Distance);
+		pId = m_NextSnapID++;
+		return true;
+	}
+
+	// all ids are taken, replace the farthest client or one without a character
+	int id = -1;
+	float highestDistance = 0;
+	for (int i = 1; i < NumIDs; ++i) {
+		if (highestDistance < m_SnappingClients[i].distance || (!GameServer()->m_apPlayers[m_SnappingClients[i].id] || !GameServer()->m_apPlayers[m_SnappingClients[i].id]->GetCharacter())) {
+			id = i;
+			if (!GameServer()->m_apPlayers[m_SnappingClients[i].id] || !GameServer()->m_apPlayers[m_SnappingClients[i].id]->GetCharacter()) highestDistance = INFINITY;
+			else highestDistance = m_SnappingClients[i].distance;
 		}
-		else return true;
+	}
+
+	if (id > -1 && highestDistance > Distance) {
+		SetSnapID(id, RealID, Distance);
+		pId = id;
 	}
 	return false;
 }
 
 bool CPlayer::IsSnappingClient(int RealID, char ClientVersion, int& id) {
 	if (RealID == -1) return false;
-	else if (RealID == m_ClientID) {
-		if ((ClientVersion == CLIENT_VERSION_NORMAL && (int)MAX_CLIENTS > (int)VANILLA_CLIENT_MAX_CLIENTS) || ((int)MAX_CLIENTS > (int)DDNET_CLIENT_MAX_CLIENTS)) id = 0;
+
+	int NumIDs = NumSnapIDs(ClientVersion);
+	if (RealID == m_ClientID) {
+		if (NumIDs) id = 0;
 		return true;
 	}
-	else if (ClientVersion == CLIENT_VERSION_NORMAL && (int)MAX_CLIENTS > (int)VANILLA_CLIENT_MAX_CLIENTS) {
-		// VANILLA_CLIENT_MAX_CLIENTS - 1 to allow chatting!!
-		for (int i = 0; i < VANILLA_CLIENT_MAX_CLIENTS - 1; ++i) {
-			if (m_SnappingClients[i].id == -1 || m_SnappingClients[i].id == RealID) {
-				m_SnappingClients[i].id = RealID;
-				id = i;
-				return true;
-			}
-		}
+	else if (!NumIDs) return true;
+
+	int SnapID = m_aSnapIDs[RealID];
+	if (SnapID != -1 && SnapID < NumIDs) {
+		id = SnapID;
+		return true;
 	}
-	else {
-		if ((int)MAX_CLIENTS > (int)DDNET_CLIENT_MAX_CLIENTS) {
-			for (int i = 0; i < DDNET_CLIENT_MAX_CLIENTS - 1; ++i) {
-				if (m_SnappingClients[i].id == -1 || m_SnappingClients[i].id == RealID) {
-					m_SnappingClients[i].id = RealID;
-					id = i;
-					return true;
-				}
-			}
-		}
-		else return true;
+	if (m_NextSnapID < NumIDs) {
+		SetSnapID(m_NextSnapID, RealID, m_SnappingClients[m_NextSnapID].distance);
+		id = m_NextSnapID++;
+		return true;
 	}
 	return false;
 }
 
 int CPlayer::GetRealIDFromSnappingClients(int SnapID) {
 	if(SnapID < 0 || SnapID >= DDNET_CLIENT_MAX_CLIENTS) return -1;
-	if (m_ClientVersion == CLIENT_VERSION_NORMAL && (int)MAX_CLIENTS > (int)VANILLA_CLIENT_MAX_CLIENTS) {
-		if (m_SnappingClients[SnapID].id != -1) return m_SnappingClients[SnapID].id;
-	}
-	else {
-		if ((int)MAX_CLIENTS > (int)DDNET_CLIENT_MAX_CLIENTS) {			
-			if (m_SnappingClients[SnapID].id != -1) return m_SnappingClients[SnapID].id;
-		}
-		else return SnapID;
-	}
+	if (NumSnapIDs(m_ClientVersion) && m_SnappingClients[SnapID].id != -1) return m_SnappingClients[SnapID].id;
 	return SnapID;
 }
 
@@ -94,11 +94,19 @@ public:
 	int GetRealIDFromSnappingClients(int SnapID);
 	void FakeSnap(int PlayerID = (VANILLA_CLIENT_MAX_CLIENTS - 1));
 
-	//the clients this clients is snapping from
+	//the clients this clients is snapping from, indexed by the id this client sees
 	struct {
 		float distance;
 		int id;
 	} m_SnappingClients[DDNET_CLIENT_MAX_CLIENTS];
+	//the other way around: the id this client sees for every real id, -1 if it has none
+	int m_aSnapIDs[MAX_CLIENTS];
+	//ids are handed out in order and only get replaced afterwards, all from here on are unused
+	int m_NextSnapID;
+
+	//number of ids a client can see when they need to be translated, 0 if they don't
+	static int NumSnapIDs(char ClientVersion);
+	void SetSnapID(int SnapID, int RealID, float Distance);
 
 	//A Player we are whispering to
 	struct sWhisperPlayer {
@@ -0,0 +1,206 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <engine/shared/config.h>
+#include <engine/server/databases/connection.h>
+#include <engine/server/databases/connection_pool.h>
+
+#include "rating.h"
+
+static const char *s_apStatColumns[CRating::NUM_STATS] = {
+	"Rounds",
+	"Kills",
+	"Hits",
+	"Deaths",
+	"Shots",
+	"GrabsNormal",
+	"GrabsTeam",
+	"GrabsGold",
+	"GrabsGreen",
+	"GrabsPurple",
+	"GrabsFalse",
+	"Selfkills",
+	"Teamkills",
+	"Unfreezes",
+};
+
+struct CSqlRatingData : ISqlData
+{
+	CSqlRatingData(std::shared_ptr<ISqlResult> pResult) :
+		ISqlData(std::move(pResult))
+	{
+	}
+
+	CRating::CEntry m_aEntries[CRating::MAX_PENDING];
+	int m_NumEntries;
+};
+
+static bool SaveEntry(IDbConnection *pSqlServer, const CRating::CEntry *pEntry, char *pError, int ErrorSize)
+{
+	if(pEntry->m_Points && pSqlServer->AddPoints(pEntry->m_aName, pEntry->m_Points, pError, ErrorSize))
+		return true;
+
+	if(!pEntry->m_HasStats)
+		return false;
+
+	char aBuf[1024];
+	int NumUpdated;
+	str_format(aBuf, sizeof(aBuf), "%s INTO %s_stats(Name) VALUES (?)", pSqlServer->InsertIgnore(), pSqlServer->GetPrefix());
+	if(pSqlServer->PrepareStatement(aBuf, pError, ErrorSize))
+		return true;
+	pSqlServer->BindString(1, pEntry->m_aName);
+	if(pSqlServer->ExecuteUpdate(&NumUpdated, pError, ErrorSize))
+		return true;
+
+	str_format(aBuf, sizeof(aBuf), "UPDATE %s_stats SET ", pSqlServer->GetPrefix());
+	for(int i = 0; i < CRating::NUM_STATS; i++)
+	{
+		str_append(aBuf, s_apStatColumns[i], sizeof(aBuf));
+		str_append(aBuf, "=", sizeof(aBuf));
+		str_append(aBuf, s_apStatColumns[i], sizeof(aBuf));
+		str_append(aBuf, i < CRating::NUM_STATS-1 ? "+?, " : "+? ", sizeof(aBuf));
+	}
+	str_append(aBuf, "WHERE Name=?", sizeof(aBuf));
+	if(pSqlServer->PrepareStatement(aBuf, pError, ErrorSize))
+		return true;
+	for(int i = 0; i < CRating::NUM_STATS; i++)
+		pSqlServer->BindInt(i+1, pEntry->m_aStats[i]);
+	pSqlServer->BindString(CRating::NUM_STATS+1, pEntry->m_aName);
+	return pSqlServer->ExecuteUpdate(&NumUpdated, pError, ErrorSize);
+}
+
+static bool SaveBatch(IDbConnection *pSqlServer, const ISqlData *pGameData, Write w, char *pError, int ErrorSize)
+{
+	// the values are added up, so a copy in the backup database can't be
+	// told apart from a later batch. only write to it if the real write failed
+	if(w == Write::BACKUP_FIRST || w == Write::NORMAL_SUCCEEDED)
+		return false;
+
+	const CSqlRatingData *pData = dynamic_cast<const CSqlRatingData *>(pGameData);
+
+	if(pSqlServer->BeginTransaction(pError, ErrorSize))
+		return true;
+	for(int i = 0; i < pData->m_NumEntries; i++)
+	{
+		if(SaveEntry(pSqlServer, &pData->m_aEntries[i], pError, ErrorSize))
+		{
+			char aError[256];
+			pSqlServer->RollbackTransaction(aError, sizeof(aError));
+			return true;
+		}
+	}
+	return pSqlServer->CommitTransaction(pError, ErrorSize);
+}
+
+CRating::CRating()
+{
+	m_pPool = 0;
+	m_NumPending = 0;
+	m_NumDropped = 0;
+	m_NextFlush = 0;
+}
+
+void CRating::Init(CDbConnectionPool *pPool)
+{
+	m_pPool = pPool;
+	m_NextFlush = time_get() + time_freq()*g_Config.m_SvRatingFlushInterval;
+}
+
+CRating::CEntry *CRating::FindEntry(const char *pName)
+{
+	for(int i = 0; i < m_NumPending; i++)
+		if(str_comp(m_aPending[i].m_aName, pName) == 0)
+			return &m_aPending[i];
+
+	if(m_NumPending == MAX_PENDING)
+	{
+		m_NumDropped++;
+		return 0;
+	}
+
+	CEntry *pEntry = &m_aPending[m_NumPending++];
+	str_copy(pEntry->m_aName, pName, sizeof(pEntry->m_aName));
+	pEntry->m_Points = 0;
+	mem_zero(pEntry->m_aStats, sizeof(pEntry->m_aStats));
+	pEntry->m_HasStats = false;
+	return pEntry;
+}
+
+void CRating::AddPoints(const char *pName, int Points)
+{
+	if(!m_pPool)
+		return;
+
+	CEntry *pEntry = FindEntry(pName);
+	if(pEntry)
+		pEntry->m_Points += Points;
+}
+
+void CRating::AddRoundStats(const char *pName, const int *pStats)
+{
+	if(!m_pPool)
+		return;
+
+	CEntry *pEntry = FindEntry(pName);
+	if(!pEntry)
+		return;
+
+	for(int i = 0; i < NUM_STATS; i++)
+		pEntry->m_aStats[i] += pStats[i];
+	pEntry->m_HasStats = true;
+}
+
+void CRating::Tick()
+{
+	if(!m_pPool || time_get() < m_NextFlush)
+		return;
+
+	m_NextFlush = time_get() + time_freq()*g_Config.m_SvRatingFlushInterval;
+	Flush();
+}
+
+void CRating::Flush(bool Final)
+{
+	if(!m_pPool || !m_NumPending)
+		return;
+
+	if(m_NumDropped)
+	{
+		dbg_msg("rating", "dropped points of %d players, too many players between two writes", m_NumDropped);
+		m_NumDropped = 0;
+	}
+
+	// players are split by name into shards with at most one batch in
+	// flight each. The shard is the ordering key of the database pool, so
+	// all writes for one player, from every game, run in order
+	std::unique_ptr<CSqlRatingData> apData[MAX_BATCHES];
+	for(int i = 0; i < MAX_BATCHES; i++)
+	{
+		// don't pile up batches while the database is slow, the pending
+		// entries keep summing up in the meantime. there is no next write
+		// after the final one, the shard keeps the batches in order
+		if(!Final && m_apBatches[i] && !m_apBatches[i]->m_Completed)
+			continue;
+		m_apBatches[i] = std::make_shared<ISqlResult>();
+		apData[i] = std::make_unique<CSqlRatingData>(m_apBatches[i]);
+		apData[i]->m_NumEntries = 0;
+	}
+
+	int NumKept = 0;
+	for(int i = 0; i < m_NumPending; i++)
+	{
+		CSqlRatingData *pData = apData[str_quickhash(m_aPending[i].m_aName) % MAX_BATCHES].get();
+		if(pData)
+			pData->m_aEntries[pData->m_NumEntries++] = m_aPending[i];
+		else
+			m_aPending[NumKept++] = m_aPending[i];
+	}
+	m_NumPending = NumKept;
+
+	for(int i = 0; i < MAX_BATCHES; i++)
+	{
+		if(apData[i] && apData[i]->m_NumEntries)
+			m_pPool->ExecuteWrite(SaveBatch, std::move(apData[i]), "save rating", i);
+		else if(apData[i])
+			m_apBatches[i] = nullptr;
+	}
+}
@@ -0,0 +1,98 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_SERVER_RATING_H
+#define GAME_SERVER_RATING_H
+
+#include <base/system.h>
+#include <engine/shared/protocol.h>
+
+#include <memory>
+
+/*
+	Class: Rating
+		Collects the rating points and round stats of one game and
+		writes them to the database in batches. Everything a player
+		gained since the last write is summed up into one entry, so a
+		batch is a single transaction with at most one row per player.
+		The queries run on the database threads, the game only hands
+		over finished batches.
+*/
+class CRating
+{
+public:
+	enum
+	{
+		STAT_ROUNDS=0,
+		STAT_KILLS,
+		STAT_HITS,
+		STAT_DEATHS,
+		STAT_SHOTS,
+		STAT_GRABS_NORMAL,
+		STAT_GRABS_TEAM,
+		STAT_GRABS_GOLD,
+		STAT_GRABS_GREEN,
+		STAT_GRABS_PURPLE,
+		STAT_GRABS_FALSE,
+		STAT_SELFKILLS,
+		STAT_TEAMKILLS,
+		STAT_UNFREEZES,
+		NUM_STATS,
+
+		// more players than this between two writes lose their points
+		MAX_PENDING=128,
+		// players are written in this many shards, each with at most one
+		// batch the database hasn't finished yet
+		MAX_BATCHES=4,
+	};
+
+	class CEntry
+	{
+	public:
+		char m_aName[MAX_NAME_LENGTH];
+		int m_Points;
+		int m_aStats[NUM_STATS];
+		bool m_HasStats;
+	};
+
+private:
+	class CDbConnectionPool *m_pPool;
+
+	CEntry m_aPending[MAX_PENDING];
+	int m_NumPending;
+	int m_NumDropped;
+	int64 m_NextFlush;
+
+	std::shared_ptr<struct ISqlResult> m_apBatches[MAX_BATCHES];
+
+	CEntry *FindEntry(const char *pName);
+
+public:
+	CRating();
+
+	/*
+		Function: Init
+			Sets the database to write to, 0 disables the rating.
+	*/
+	void Init(class CDbConnectionPool *pPool);
+
+	void AddPoints(const char *pName, int Points);
+	void AddRoundStats(const char *pName, const int *pStats);
+
+	/*
+		Function: Tick
+			Writes the collected data every sv_rating_flush_interval
+			seconds.
+	*/
+	void Tick();
+
+	/*
+		Function: Flush
+			Hands the collected data to the database. Players whose
+			shard still has a batch in flight are kept for the next
+			write, unless it's the final write of the game. Their
+			batch then queues behind the one in flight.
+	*/
+	void Flush(bool Final = false);
+};
+
+#endif
@@ -0,0 +1,122 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include "spatialgrid.h"
+
+// keeps the cell coordinates and the cell counts of queries in range
+static const int CELL_LIMIT = 1<<20;
+
+CSpatialGrid::CSpatialGrid()
+{
+	Clear();
+}
+
+void CSpatialGrid::Clear()
+{
+	for(int i = 0; i < NUM_BUCKETS; i++)
+		m_aFirst[i] = -1;
+	for(int i = 0; i < MAX_ITEMS; i++)
+		m_aBucket[i] = -1;
+}
+
+int CSpatialGrid::CellCoord(float Value)
+{
+	// also catches nan
+	if(!(Value > -(float)CELL_LIMIT*CELL_SIZE))
+		return -CELL_LIMIT;
+	if(!(Value < (float)CELL_LIMIT*CELL_SIZE))
+		return CELL_LIMIT;
+	return (int)floorf(Value/CELL_SIZE);
+}
+
+void CSpatialGrid::Unlink(int ID)
+{
+	if(m_aPrev[ID] != -1)
+		m_aNext[m_aPrev[ID]] = m_aNext[ID];
+	else
+		m_aFirst[m_aBucket[ID]] = m_aNext[ID];
+	if(m_aNext[ID] != -1)
+		m_aPrev[m_aNext[ID]] = m_aPrev[ID];
+	m_aBucket[ID] = -1;
+}
+
+void CSpatialGrid::Update(int ID, vec2 Pos)
+{
+	int CellX = CellCoord(Pos.x);
+	int CellY = CellCoord(Pos.y);
+	if(m_aBucket[ID] != -1)
+	{
+		if(m_aCellX[ID] == CellX && m_aCellY[ID] == CellY)
+			return;
+		Unlink(ID);
+	}
+
+	int Index = Bucket(CellX, CellY);
+	m_aCellX[ID] = CellX;
+	m_aCellY[ID] = CellY;
+	m_aBucket[ID] = Index;
+	m_aPrev[ID] = -1;
+	m_aNext[ID] = m_aFirst[Index];
+	if(m_aFirst[Index] != -1)
+		m_aPrev[m_aFirst[Index]] = ID;
+	m_aFirst[Index] = ID;
+}
+
+void CSpatialGrid::Remove(int ID)
+{
+	if(m_aBucket[ID] != -1)
+		Unlink(ID);
+}
+
+int CSpatialGrid::Query(vec2 Min, vec2 Max, int *pIDs) const
+{
+	int MinX = CellCoord(Min.x);
+	int MinY = CellCoord(Min.y);
+	int MaxX = CellCoord(Max.x);
+	int MaxY = CellCoord(Max.y);
+	int Num = 0;
+
+	// a box larger than the table visits every bucket anyway
+	if((int64)(MaxX-MinX+1)*(MaxY-MinY+1) > NUM_BUCKETS)
+	{
+		for(int i = 0; i < MAX_ITEMS; i++)
+			if(m_aBucket[i] != -1 && m_aCellX[i] >= MinX && m_aCellX[i] <= MaxX && m_aCellY[i] >= MinY && m_aCellY[i] <= MaxY)
+				pIDs[Num++] = i;
+		return Num;
+	}
+
+	// several cells of the box can share a bucket, collect the ids in a
+	// mask to drop the duplicates and to hand them out sorted
+	unsigned aFound[MAX_ITEMS/32] = {0};
+	bool Found = false;
+	for(int y = MinY; y <= MaxY; y++)
+		for(int x = MinX; x <= MaxX; x++)
+			for(int i = m_aFirst[Bucket(x, y)]; i != -1; i = m_aNext[i])
+			{
+				// other cells hashed to the same bucket
+				if(m_aCellX[i] < MinX || m_aCellX[i] > MaxX || m_aCellY[i] < MinY || m_aCellY[i] > MaxY)
+					continue;
+				aFound[i/32] |= 1u<<(i%32);
+				Found = true;
+			}
+
+	if(!Found)
+		return 0;
+	for(int w = 0; w < MAX_ITEMS/32; w++)
+		for(unsigned Bits = aFound[w]; Bits; Bits &= Bits-1)
+		{
+			int Bit = 0;
+			while(!(Bits&(1u<<Bit)))
+				Bit++;
+			pIDs[Num++] = w*32+Bit;
+		}
+	return Num;
+}
+
+int CSpatialGrid::Query(vec2 From, vec2 To, float Radius, int *pIDs) const
+{
+	vec2 Min = vec2(min(From.x, To.x)-Radius, min(From.y, To.y)-Radius);
+	vec2 Max = vec2(max(From.x, To.x)+Radius, max(From.y, To.y)+Radius);
+	return Query(Min, Max, pIDs);
+}
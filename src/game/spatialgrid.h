@@ -0,0 +1,72 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_SPATIALGRID_H
+#define GAME_SPATIALGRID_H
+
+#include <base/math.h>
+#include <base/vmath.h>
+#include <engine/shared/protocol.h>
+
+/*
+	Class: Spatial grid
+		Sorts up to MAX_ITEMS ids into square cells by position, so
+		range queries only look at the items in the cells they
+		overlap. The cells are hashed into a fixed number of buckets,
+		which keeps the grid independent of the map size. Positions
+		are updated whenever an item moves, an update inside the same
+		cell costs nothing.
+*/
+class CSpatialGrid
+{
+public:
+	enum
+	{
+		MAX_ITEMS=MAX_CLIENTS,
+		CELL_SIZE=64,
+		NUM_BUCKETS=256,
+	};
+
+private:
+	int m_aFirst[NUM_BUCKETS];
+	int m_aNext[MAX_ITEMS];
+	int m_aPrev[MAX_ITEMS];
+	// -1 if the item isn't in the grid
+	int m_aBucket[MAX_ITEMS];
+	int m_aCellX[MAX_ITEMS];
+	int m_aCellY[MAX_ITEMS];
+
+	static int CellCoord(float Value);
+	static int Bucket(int CellX, int CellY) { return ((unsigned)CellX*73856093u ^ (unsigned)CellY*19349663u)&(NUM_BUCKETS-1); }
+
+	void Unlink(int ID);
+
+public:
+	CSpatialGrid();
+
+	void Clear();
+
+	/*
+		Function: Update
+			Moves an item to the cell of Pos, adds it if it isn't in
+			the grid yet.
+	*/
+	void Update(int ID, vec2 Pos);
+	void Remove(int ID);
+
+	/*
+		Function: Query
+			Finds the items in the cells overlapping the box from Min to
+			Max. The items are candidates only, the caller still has to
+			test their real position.
+
+		Returns:
+			Number of ids written to pIDs, sorted ascending. pIDs has to
+			fit MAX_ITEMS ids.
+	*/
+	int Query(vec2 Min, vec2 Max, int *pIDs) const;
+
+	// the box around the line from From to To widened by Radius
+	int Query(vec2 From, vec2 To, float Radius, int *pIDs) const;
+};
+
+#endif
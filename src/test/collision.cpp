@@ -0,0 +1,189 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/map.h>
+
+#include <game/collision.h>
+#include <game/layers.h>
+#include <game/mapitems.h>
+
+#include <cstdlib>
+#include <vector>
+
+/*
+	Compares the tile walking IntersectLine and MoveBox with the unit
+	stepping reference ones on random game layers. Both have to give
+	exactly the same results.
+*/
+
+// a map with one group holding only the game layer
+class CTestMap : public IMap
+{
+	CMapItemGroup m_Group;
+	CMapItemLayerTilemap m_Layer;
+	std::vector<CTile> m_Tiles;
+
+public:
+	CTestMap(int Width, int Height, float Density, unsigned Seed)
+	{
+		mem_zero(&m_Group, sizeof(m_Group));
+		m_Group.m_Version = CMapItemGroup::CURRENT_VERSION;
+		m_Group.m_StartLayer = 0;
+		m_Group.m_NumLayers = 1;
+
+		mem_zero(&m_Layer, sizeof(m_Layer));
+		m_Layer.m_Layer.m_Type = LAYERTYPE_TILES;
+		m_Layer.m_Width = Width;
+		m_Layer.m_Height = Height;
+		m_Layer.m_Flags = TILESLAYERFLAG_GAME;
+		m_Layer.m_Data = 0;
+
+		// mostly solid tiles, some with other flags, and solid borders
+		static const int s_aTiles[] = {TILE_SOLID, TILE_SOLID, TILE_SOLID, TILE_NOHOOK, TILE_DEATH, CCollision::TILE_SPIKE_NORMAL, CCollision::TILE_SPIKE_RED};
+		srand(Seed);
+		m_Tiles.resize(Width*Height);
+		for(int y = 0; y < Height; y++)
+		{
+			for(int x = 0; x < Width; x++)
+			{
+				CTile *pTile = &m_Tiles[y*Width+x];
+				mem_zero(pTile, sizeof(*pTile));
+				if(x == 0 || y == 0 || x == Width-1 || y == Height-1)
+					pTile->m_Index = TILE_SOLID;
+				else if(rand() < Density*RAND_MAX)
+					pTile->m_Index = s_aTiles[rand()%(sizeof(s_aTiles)/sizeof(s_aTiles[0]))];
+			}
+		}
+	}
+
+	virtual void *GetData(int Index) { return &m_Tiles[0]; }
+	virtual void *GetDataSwapped(int Index) { return &m_Tiles[0]; }
+	virtual void UnloadData(int Index) {}
+	virtual void *GetItem(int Index, int *pType, int *pID)
+	{
+		if(Index == 0)
+			return &m_Group;
+		return &m_Layer;
+	}
+	virtual void GetType(int Type, int *pStart, int *pNum)
+	{
+		*pStart = Type == MAPITEMTYPE_GROUP ? 0 : 1;
+		*pNum = Type == MAPITEMTYPE_GROUP || Type == MAPITEMTYPE_LAYER ? 1 : 0;
+	}
+	virtual void *FindItem(int Type, int ID) { return 0; }
+	virtual int NumItems() { return 2; }
+};
+
+static float RandomFloat(float Min, float Max)
+{
+	return Min + (Max-Min)*(rand()/(float)RAND_MAX);
+}
+
+static const float s_aDensities[] = {0.0f, 0.05f, 0.2f, 0.5f, 0.9f};
+
+class CCollisionTest
+{
+public:
+	enum
+	{
+		WIDTH=64,
+		HEIGHT=48,
+	};
+
+	CTestMap m_Map;
+	CLayers m_Layers;
+	CCollision m_Collision;
+
+	CCollisionTest(float Density) : m_Map(WIDTH, HEIGHT, Density, (unsigned)(Density*1000))
+	{
+		m_Layers.Init(0, &m_Map);
+		m_Collision.Init(&m_Layers);
+	}
+
+	vec2 RandomPos(float Margin)
+	{
+		return vec2(RandomFloat(-Margin, WIDTH*32+Margin), RandomFloat(-Margin, HEIGHT*32+Margin));
+	}
+
+	// the references are private, this class is a friend of CCollision
+	int IntersectLineSampled(vec2 Pos0, vec2 Pos1, vec2 *pOutCollision, vec2 *pOutBeforeCollision)
+	{
+		return m_Collision.IntersectLineSampled(Pos0, Pos1, pOutCollision, pOutBeforeCollision);
+	}
+
+	void MoveBoxSampled(vec2 *pInoutPos, vec2 *pInoutVel, vec2 Size, float Elasticity)
+	{
+		m_Collision.MoveBoxSampled(pInoutPos, pInoutVel, Size, Elasticity);
+	}
+};
+
+TEST(Collision, IntersectLineTiles)
+{
+	for(unsigned d = 0; d < sizeof(s_aDensities)/sizeof(s_aDensities[0]); d++)
+	{
+		CCollisionTest Test(s_aDensities[d]);
+		for(int i = 0; i < 20000; i++)
+		{
+			vec2 Pos0 = Test.RandomPos(64.0f);
+			vec2 Pos1;
+			// short rays like lasers and hooks, and rays across the map
+			if(i%4)
+				Pos1 = Pos0 + vec2(RandomFloat(-400.0f, 400.0f), RandomFloat(-400.0f, 400.0f));
+			else
+				Pos1 = Test.RandomPos(64.0f);
+			// axis aligned and whole unit rays hit tile borders exactly
+			if(i%7 == 0)
+				Pos1.y = Pos0.y;
+			if(i%11 == 0)
+			{
+				Pos0 = vec2(round_to_int(Pos0.x), round_to_int(Pos0.y));
+				Pos1 = vec2(round_to_int(Pos1.x), round_to_int(Pos1.y));
+			}
+
+			vec2 Collision, BeforeCollision, TilesCollision, TilesBeforeCollision;
+			int Hit = Test.IntersectLineSampled(Pos0, Pos1, &Collision, &BeforeCollision);
+			int TilesHit = Test.m_Collision.IntersectLine(Pos0, Pos1, &TilesCollision, &TilesBeforeCollision);
+
+			ASSERT_EQ(Hit, TilesHit) << "density " << s_aDensities[d] << " from " << Pos0.x << "," << Pos0.y << " to " << Pos1.x << "," << Pos1.y;
+			ASSERT_EQ(Collision.x, TilesCollision.x) << "density " << s_aDensities[d] << " from " << Pos0.x << "," << Pos0.y << " to " << Pos1.x << "," << Pos1.y;
+			ASSERT_EQ(Collision.y, TilesCollision.y) << "density " << s_aDensities[d] << " from " << Pos0.x << "," << Pos0.y << " to " << Pos1.x << "," << Pos1.y;
+			ASSERT_EQ(BeforeCollision.x, TilesBeforeCollision.x) << "density " << s_aDensities[d] << " from " << Pos0.x << "," << Pos0.y << " to " << Pos1.x << "," << Pos1.y;
+			ASSERT_EQ(BeforeCollision.y, TilesBeforeCollision.y) << "density " << s_aDensities[d] << " from " << Pos0.x << "," << Pos0.y << " to " << Pos1.x << "," << Pos1.y;
+		}
+	}
+}
+
+TEST(Collision, MoveBoxTiles)
+{
+	static const float s_aElasticities[] = {0.0f, 0.5f, 1.0f};
+	const vec2 Size(28.0f, 28.0f);
+	for(unsigned d = 0; d < sizeof(s_aDensities)/sizeof(s_aDensities[0]); d++)
+	{
+		CCollisionTest Test(s_aDensities[d]);
+		for(int i = 0; i < 20000; i++)
+		{
+			vec2 Pos = Test.RandomPos(0.0f);
+			vec2 Vel;
+			// walking speed most of the time, sometimes hook or explosion speed
+			if(i%5)
+				Vel = vec2(RandomFloat(-15.0f, 15.0f), RandomFloat(-15.0f, 15.0f));
+			else
+				Vel = vec2(RandomFloat(-60.0f, 60.0f), RandomFloat(-60.0f, 60.0f));
+			if(i%9 == 0)
+				Vel.x = 0.0f;
+			float Elasticity = s_aElasticities[i%3];
+
+			vec2 SampledPos = Pos, SampledVel = Vel;
+			Test.MoveBoxSampled(&SampledPos, &SampledVel, Size, Elasticity);
+			vec2 TilesPos = Pos, TilesVel = Vel;
+			Test.m_Collision.MoveBox(&TilesPos, &TilesVel, Size, Elasticity);
+
+			ASSERT_EQ(SampledPos.x, TilesPos.x) << "density " << s_aDensities[d] << " pos " << Pos.x << "," << Pos.y << " vel " << Vel.x << "," << Vel.y;
+			ASSERT_EQ(SampledPos.y, TilesPos.y) << "density " << s_aDensities[d] << " pos " << Pos.x << "," << Pos.y << " vel " << Vel.x << "," << Vel.y;
+			ASSERT_EQ(SampledVel.x, TilesVel.x) << "density " << s_aDensities[d] << " pos " << Pos.x << "," << Pos.y << " vel " << Vel.x << "," << Vel.y;
+			ASSERT_EQ(SampledVel.y, TilesVel.y) << "density " << s_aDensities[d] << " pos " << Pos.x << "," << Pos.y << " vel " << Vel.x << "," << Vel.y;
+		}
+	}
+}
@@ -0,0 +1,162 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/console.h>
+#include <engine/storage.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/network.h>
+#include <engine/shared/snapshot.h>
+
+#include <game/generated/protocol.h>
+
+/*
+	Replays the snapshots of a demo through CSnapshotDelta, compares
+	the deltas of CreateDelta with the ones of CreateDeltaHashed and
+	times both, and UnpackDelta.
+*/
+
+class CSnapshotCollector : public CDemoPlayer::IListner
+{
+public:
+	enum
+	{
+		MAX_SNAPSHOTS=5000,
+	};
+
+	CSnapshot *m_apSnapshots[MAX_SNAPSHOTS];
+	int m_NumSnapshots;
+
+	CSnapshotCollector() : m_NumSnapshots(0) {}
+
+	virtual void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		if(m_NumSnapshots == MAX_SNAPSHOTS)
+			return;
+		m_apSnapshots[m_NumSnapshots] = (CSnapshot *)mem_alloc(Size, 1);
+		mem_copy(m_apSnapshots[m_NumSnapshots], pData, Size);
+		m_NumSnapshots++;
+	}
+
+	virtual void OnDemoPlayerMessage(void *pData, int Size) {}
+};
+
+static CSnapshotCollector s_Collector;
+static CSnapshotDelta s_SnapshotDelta;
+static char s_aDeltaData[CSnapshot::MAX_SIZE];
+static char s_aHashedData[CSnapshot::MAX_SIZE];
+static char s_aSnapshotData[CSnapshot::MAX_SIZE];
+
+static double Micros(int64 Time, int Num)
+{
+	return Num ? Time*1000000.0/time_freq()/Num : 0.0;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+	if(argc < 2) // ignore_convention
+	{
+		dbg_msg("snapshot_bench", "usage: %s <demo> [rounds]", argv[0]); // ignore_convention
+		return -1;
+	}
+	int Rounds = argc > 2 ? max(str_toint(argv[2]), 1) : 20; // ignore_convention
+
+	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv); // ignore_convention
+	IConsole *pConsole = CreateConsole(0);
+	if(!pStorage || !pConsole)
+		return -1;
+
+	// the demo chunks are huffman compressed
+	CNetBase::Init();
+
+	CNetObjHandler NetObjHandler;
+	for(int i = 0; i < NUM_NETOBJTYPES; i++)
+		s_SnapshotDelta.SetStaticsize(i, NetObjHandler.GetObjSize(i));
+
+	// the player stores the map of the demo there
+	pStorage->CreateFolder("downloadedmaps", IStorage::TYPE_SAVE);
+
+	// play the demo as fast as possible, it pauses at the end
+	CDemoPlayer *pPlayer = new CDemoPlayer(&s_SnapshotDelta);
+	pPlayer->SetListner(&s_Collector);
+	if(pPlayer->Load(pStorage, pConsole, argv[1], IStorage::TYPE_ALL)) // ignore_convention
+		return -1;
+	pPlayer->Play();
+	pPlayer->SetSpeed(1000000.0f);
+	while(pPlayer->IsPlaying() && !pPlayer->BaseInfo()->m_Paused)
+		pPlayer->Update();
+	pPlayer->Stop();
+
+	int Num = s_Collector.m_NumSnapshots;
+	if(Num < 2)
+	{
+		dbg_msg("snapshot_bench", "not enough snapshots in '%s'", argv[1]); // ignore_convention
+		return -1;
+	}
+
+	// the same bytes for every pair, and the deltas have to give the snapshot back
+	int NumItems = 0, NumDiffering = 0, NumBroken = 0, NumUnsorted = 0;
+	int64 DeltaBytes = 0;
+	for(int i = 1; i < Num; i++)
+	{
+		CSnapshot *pFrom = s_Collector.m_apSnapshots[i-1];
+		CSnapshot *pTo = s_Collector.m_apSnapshots[i];
+		NumItems += pTo->NumItems();
+		NumUnsorted += !pTo->IsSorted();
+
+		int Size = s_SnapshotDelta.CreateDelta(pFrom, pTo, s_aDeltaData);
+		int HashedSize = s_SnapshotDelta.CreateDeltaHashed(pFrom, pTo, s_aHashedData);
+		if(Size != HashedSize || mem_comp(s_aDeltaData, s_aHashedData, Size) != 0)
+			NumDiffering++;
+		DeltaBytes += Size;
+
+		if(!Size)
+			continue;
+		int SnapSize = s_SnapshotDelta.UnpackDelta(pFrom, (CSnapshot *)s_aSnapshotData, s_aDeltaData, Size);
+		if(SnapSize < 0 || ((CSnapshot *)s_aSnapshotData)->Crc() != pTo->Crc())
+			NumBroken++;
+	}
+
+	int64 aTimes[3] = {0, 0, 0};
+	for(int r = 0; r < Rounds; r++)
+	{
+		int64 Start = time_get();
+		for(int i = 1; i < Num; i++)
+			s_SnapshotDelta.CreateDeltaHashed(s_Collector.m_apSnapshots[i-1], s_Collector.m_apSnapshots[i], s_aHashedData);
+		int64 Hashed = time_get();
+		for(int i = 1; i < Num; i++)
+			s_SnapshotDelta.CreateDelta(s_Collector.m_apSnapshots[i-1], s_Collector.m_apSnapshots[i], s_aDeltaData);
+		int64 Sorted = time_get();
+		aTimes[0] += Hashed-Start;
+		aTimes[1] += Sorted-Hashed;
+	}
+
+	for(int r = 0; r < Rounds; r++)
+	{
+		for(int i = 1; i < Num; i++)
+		{
+			CSnapshot *pFrom = s_Collector.m_apSnapshots[i-1];
+			int Size = s_SnapshotDelta.CreateDelta(pFrom, s_Collector.m_apSnapshots[i], s_aDeltaData);
+			int64 Start = time_get();
+			if(Size)
+				s_SnapshotDelta.UnpackDelta(pFrom, (CSnapshot *)s_aSnapshotData, s_aDeltaData, Size);
+			aTimes[2] += time_get()-Start;
+		}
+	}
+
+	int NumDeltas = (Num-1)*Rounds;
+	dbg_msg("snapshot_bench", "snapshots=%d items/snapshot=%.1f unsorted=%d delta bytes/snapshot=%.1f",
+		Num, NumItems/(float)(Num-1), NumUnsorted, DeltaBytes/(float)(Num-1));
+	dbg_msg("snapshot_bench", "differing deltas=%d broken deltas=%d", NumDiffering, NumBroken);
+	dbg_msg("snapshot_bench", "create hashed=%.3fus sorted=%.3fus unpack=%.3fus per snapshot, %d rounds",
+		Micros(aTimes[0], NumDeltas), Micros(aTimes[1], NumDeltas), Micros(aTimes[2], NumDeltas), Rounds);
+
+	for(int i = 0; i < Num; i++)
+		mem_free(s_Collector.m_apSnapshots[i]);
+	delete pPlayer;
+	delete pConsole;
+	delete pStorage;
+	return NumDiffering || NumBroken ? 1 : 0;
+}